@@ -1,10 +1,25 @@
 import json
 import random
+import sys
+
+# usage: generate_walls.py [world size] [walls count] [max wall length]
+worldSize = int(sys.argv[1]) if len(sys.argv) > 1 else 1000
+wallsCount = int(sys.argv[2]) if len(sys.argv) > 2 else 10000
+maxWallLength = int(sys.argv[3]) if len(sys.argv) > 3 else None
 
 def rand():
-	return random.randint(0, 1000)
+	return random.randint(0, worldSize)
+
+def randEnd(value):
+	if maxWallLength is None:
+		return rand()
+	return min(worldSize, max(0, value + random.randint(-maxWallLength, maxWallLength)))
+
+def randWall():
+	start = {"x": rand(), "y": rand()}
+	return {"start": start, "end": {"x": randEnd(start["x"]), "y": randEnd(start["y"])}}
 
-points = [{"start": {"x": rand(), "y": rand()}, "end": {"x": rand(), "y": rand()}} for i in range(0, 10000)]
+points = [randWall() for i in range(0, wallsCount)]
 
 j = json.dumps(points)
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <istream>
+
+#include <ostream>
+
+#include <vector>
+
+template <class T>
+void WriteBinary(std::ostream& stream, const T& value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+bool ReadBinary(std::istream& stream, T& outValue)
+{
+	stream.read(reinterpret_cast<char*>(&outValue), sizeof(T));
+
+	return static_cast<bool>(stream);
+}
+
+template <class T>
+void WriteBinaryArray(std::ostream& stream, const std::vector<T>& values)
+{
+	WriteBinary(stream, static_cast<unsigned long long>(values.size()));
+
+	if (!values.empty())
+	{
+		stream.write(reinterpret_cast<const char*>(values.data()), sizeof(T) * values.size());
+	}
+}
+
+template <class T>
+bool ReadBinaryArray(std::istream& stream, std::vector<T>& outValues)
+{
+	unsigned long long count;
+
+	if (!ReadBinary(stream, count))
+	{
+		return false;
+	}
+
+	outValues.resize(static_cast<size_t>(count));
+
+	if (!outValues.empty())
+	{
+		stream.read(reinterpret_cast<char*>(outValues.data()), sizeof(T) * outValues.size());
+	}
+
+	return static_cast<bool>(stream);
+}
@@ -0,0 +1,257 @@
+#include "BulletCommandRing.h"
+
+#include <cstring>
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr unsigned int bulletCommandRingMagic = 0x47525242; // "BRRG"
+
+static constexpr unsigned int bulletCommandRingVersion = 1;
+
+static_assert(sizeof(BulletCommandRingHeader) % alignof(BulletCommandCell) == 0, "Ring cells must stay aligned after the header");
+
+BulletCommandRing::~BulletCommandRing()
+{
+#ifndef _WIN32
+	if (header != nullptr)
+	{
+		munmap(header, regionSize);
+
+		if (bIsOwner)
+		{
+			shm_unlink(name.c_str());
+		}
+	}
+#endif
+}
+
+bool BulletCommandRing::Create(const std::string& inName, size_t capacity)
+{
+#ifdef _WIN32
+	std::cout << "The bullet command ring needs POSIX shared memory" << std::endl;
+	return false;
+#else
+	name = inName;
+
+	size_t roundedCapacity = 1;
+
+	while (roundedCapacity < capacity)
+	{
+		roundedCapacity *= 2;
+	}
+
+	regionSize = sizeof(BulletCommandRingHeader) + roundedCapacity * sizeof(BulletCommandCell);
+
+	const int fileDescriptor = shm_open(name.c_str(), O_CREAT | O_RDWR, 0666);
+
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	const bool bWasResized = ftruncate(fileDescriptor, static_cast<off_t>(regionSize)) == 0;
+
+	void* const region = bWasResized ? mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0) : MAP_FAILED;
+
+	close(fileDescriptor);
+
+	if (region == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	header = static_cast<BulletCommandRingHeader*>(region);
+
+	bIsOwner = true;
+
+	header->capacity = roundedCapacity;
+	header->consumerTimeBits.store(0, std::memory_order_relaxed);
+	header->enqueuePosition.store(0, std::memory_order_relaxed);
+	header->dequeuePosition.store(0, std::memory_order_relaxed);
+
+	BulletCommandCell* const cells = GetCells();
+
+	for (size_t cellIndex = 0; cellIndex < roundedCapacity; ++cellIndex)
+	{
+		cells[cellIndex].sequence.store(cellIndex, std::memory_order_relaxed);
+	}
+
+	header->version = bulletCommandRingVersion;
+
+	// written last, producers don't use a ring before they see it
+	std::atomic_thread_fence(std::memory_order_release);
+
+	header->magic = bulletCommandRingMagic;
+
+	return true;
+#endif
+}
+
+bool BulletCommandRing::Open(const std::string& inName)
+{
+#ifdef _WIN32
+	std::cout << "The bullet command ring needs POSIX shared memory" << std::endl;
+	return false;
+#else
+	name = inName;
+
+	const int fileDescriptor = shm_open(name.c_str(), O_RDWR, 0);
+
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStatus;
+
+	void* region = MAP_FAILED;
+
+	if (fstat(fileDescriptor, &fileStatus) == 0 && static_cast<size_t>(fileStatus.st_size) >= sizeof(BulletCommandRingHeader))
+	{
+		regionSize = static_cast<size_t>(fileStatus.st_size);
+
+		region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+	}
+
+	close(fileDescriptor);
+
+	if (region == MAP_FAILED)
+	{
+		return false;
+	}
+
+	header = static_cast<BulletCommandRingHeader*>(region);
+
+	const bool bIsValid = header->magic == bulletCommandRingMagic && header->version == bulletCommandRingVersion
+		&& regionSize >= sizeof(BulletCommandRingHeader) + header->capacity * sizeof(BulletCommandCell);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (!bIsValid)
+	{
+		munmap(region, regionSize);
+
+		header = nullptr;
+	}
+
+	return bIsValid;
+#endif
+}
+
+BulletCommandCell* BulletCommandRing::GetCells() const
+{
+	return reinterpret_cast<BulletCommandCell*>(reinterpret_cast<char*>(header) + sizeof(BulletCommandRingHeader));
+}
+
+bool BulletCommandRing::TryPush(const BulletManager::BulletDefinition& bullet)
+{
+	if (header == nullptr)
+	{
+		return false;
+	}
+
+	const unsigned long long mask = header->capacity - 1;
+
+	BulletCommandCell* const cells = GetCells();
+
+	unsigned long long position = header->enqueuePosition.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		BulletCommandCell& cell = cells[position & mask];
+
+		const unsigned long long sequence = cell.sequence.load(std::memory_order_acquire);
+
+		const long long difference = static_cast<long long>(sequence - position);
+
+		if (difference == 0)
+		{
+			// free for this position; claim it unless another producer was faster
+			if (header->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.bullet = bullet;
+
+				cell.sequence.store(position + 1, std::memory_order_release);
+
+				return true;
+			}
+		}
+		else if (difference < 0)
+		{
+			// still holds the bullet of the previous lap
+			return false;
+		}
+		else
+		{
+			position = header->enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+float BulletCommandRing::GetConsumerTime() const
+{
+	if (header == nullptr)
+	{
+		return 0;
+	}
+
+	const unsigned int timeBits = header->consumerTimeBits.load(std::memory_order_relaxed);
+
+	float time;
+
+	std::memcpy(&time, &timeBits, sizeof(time));
+
+	return time;
+}
+
+size_t BulletCommandRing::Drain(float consumerTime, std::vector<BulletManager::BulletDefinition>& outBullets)
+{
+	if (header == nullptr)
+	{
+		return 0;
+	}
+
+	unsigned int timeBits;
+
+	std::memcpy(&timeBits, &consumerTime, sizeof(timeBits));
+
+	header->consumerTimeBits.store(timeBits, std::memory_order_relaxed);
+
+	const unsigned long long capacity = header->capacity;
+
+	BulletCommandCell* const cells = GetCells();
+
+	unsigned long long position = header->dequeuePosition.load(std::memory_order_relaxed);
+
+	size_t drainedCount = 0;
+
+	while (drainedCount < capacity)
+	{
+		BulletCommandCell& cell = cells[position & (capacity - 1)];
+
+		if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+		{
+			break;
+		}
+
+		outBullets.push_back(cell.bullet);
+
+		// free for the producers of the next lap
+		cell.sequence.store(position + capacity, std::memory_order_release);
+
+		++position;
+		++drainedCount;
+	}
+
+	header->dequeuePosition.store(position, std::memory_order_relaxed);
+
+	return drainedCount;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <atomic>
+
+#include <string>
+
+#include <vector>
+
+// Shared memory layout: BulletCommandRingHeader, then capacity BulletCommandCell records.
+// A bounded queue after Dmitry Vyukov: producers claim a cell by moving enqueuePosition on with a compare-and-swap,
+// and the sequence of the cell tells whether it is free, filled or still being filled. A producer that dies
+// between claiming and filling a cell stops the consumer at that cell.
+struct BulletCommandRingHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long capacity;
+
+	// the simulation time at the last drain, for producers to start their bullets from
+	std::atomic<unsigned int> consumerTimeBits;
+
+	// apart from each other, so that producers and the consumer don't share a cache line
+	alignas(64) std::atomic<unsigned long long> enqueuePosition;
+
+	alignas(64) std::atomic<unsigned long long> dequeuePosition;
+};
+
+struct BulletCommandCell
+{
+	std::atomic<unsigned long long> sequence;
+
+	BulletManager::BulletDefinition bullet;
+};
+
+// Bullets written by any number of local processes, read by the one that simulates them
+class BulletCommandRing
+{
+public:
+	~BulletCommandRing();
+
+	// by the consumer, which also removes the ring again; the capacity is rounded up to a power of two
+	bool Create(const std::string& name, size_t capacity);
+
+	// by producers
+	bool Open(const std::string& name);
+
+	// false when the ring is full
+	bool TryPush(const BulletManager::BulletDefinition& bullet);
+
+	float GetConsumerTime() const;
+
+	// appends what is in the ring, at most a whole ring's worth; only one thread may drain
+	size_t Drain(float consumerTime, std::vector<BulletManager::BulletDefinition>& outBullets);
+
+private:
+	BulletCommandCell* GetCells() const;
+
+	std::string name;
+
+	BulletCommandRingHeader* header = nullptr;
+
+	size_t regionSize = 0;
+
+	bool bIsOwner = false;
+};
@@ -12,6 +12,81 @@
 
 #include "ParallelUtils.h"
 
+#include "FlightRecorder.h"
+
+#include "Scenario.h"
+
+#include "WallGrid.h"
+
+#include "BulletSchedule.h"
+
+#include "WallTileStore.h"
+
+#include "Checkpoint.h"
+
+#include "EventTrace.h"
+
+#include "SharedState.h"
+
+#include "BulletCommandRing.h"
+
+#include "WorldRegions.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <cstdio>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a over the fields, finished with a mix so that the XOR of many element hashes stays well spread
+static unsigned long long HashStateElement(unsigned long long key, const float* values, size_t valuesCount)
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	const auto hashBytes = [&hash](const void* data, size_t size)
+	{
+		const unsigned char* const bytes = static_cast<const unsigned char*>(data);
+
+		for (size_t byteIndex = 0; byteIndex < size; ++byteIndex)
+		{
+			hash ^= bytes[byteIndex];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	hashBytes(&key, sizeof(key));
+	hashBytes(values, valuesCount * sizeof(float));
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+static unsigned long long HashWall(int wallIndex, const BulletManager::Wall& wall)
+{
+	const float values[] = { wall.definition.start.X, wall.definition.start.Y, wall.definition.end.X, wall.definition.end.Y, wall.timeDestroyed };
+
+	return HashStateElement(static_cast<unsigned long long>(wallIndex), values, sizeof(values) / sizeof(float));
+}
+
+static unsigned long long HashBullet(const BulletManager::Bullet& bullet)
+{
+	const BulletManager::BulletDefinition& definition = bullet.definition;
+
+	const float values[] = { definition.startingPosition.X, definition.startingPosition.Y, definition.velocity.X, definition.velocity.Y, definition.startTime, definition.lifetime };
+
+	// keeps the bullets apart from the walls
+	constexpr unsigned long long bulletKey = 1ull << 32;
+
+	return HashStateElement(bulletKey | bullet.id, values, sizeof(values) / sizeof(float));
+}
+
 BulletManager::BulletManager(const std::vector<WallDefinition>& inWallDefinitions, const std::vector<BulletDefinition>& inBulletDefinitions)
 {
 	walls.reserve(inWallDefinitions.size());
@@ -26,6 +101,88 @@ BulletManager::BulletManager(const std::vector<WallDefinition>& inWallDefinition
 		bullets.push_back({ bulletDefinition });
 	}
 
+	InitializeBulletIds();
+
+	InitializeThreadPool();
+}
+
+BulletManager::BulletManager(const BulletManagerSnapshot& snapshot) : currentTime(snapshot.currentTime)
+{
+	walls.reserve(snapshot.walls.size());
+	for (const BulletManagerSnapshot::Wall& snapshotWall : snapshot.walls)
+	{
+		Wall wall{ WallDefinition(snapshotWall.start, snapshotWall.end) };
+
+		wall.timeDestroyed = snapshotWall.timeDestroyed;
+
+		walls.push_back(wall);
+	}
+
+	bullets.reserve(snapshot.bullets.size());
+	for (const BulletDefinition& bulletDefinition : snapshot.bullets)
+	{
+		bullets.push_back({ bulletDefinition });
+	}
+
+	InitializeBulletIds();
+
+	InitializeThreadPool();
+}
+
+BulletManager::BulletManager(const ScenarioView& scenario)
+{
+	walls.reserve(scenario.wallsCount);
+	for (size_t wallIndex = 0; wallIndex < scenario.wallsCount; ++wallIndex)
+	{
+		const PackedWall& packedWall = scenario.walls[wallIndex];
+
+		walls.push_back({ WallDefinition(packedWall.start, packedWall.end) });
+	}
+
+	bullets.reserve(scenario.bulletsCount);
+	for (size_t bulletIndex = 0; bulletIndex < scenario.bulletsCount; ++bulletIndex)
+	{
+		bullets.push_back({ scenario.bullets[bulletIndex] });
+	}
+
+	InitializeBulletIds();
+
+	InitializeThreadPool();
+}
+
+BulletManager::BulletManager(const CheckpointView& checkpoint) : currentTime(checkpoint.currentTime), nextBulletId(checkpoint.nextBulletId)
+{
+	walls.reserve(checkpoint.wallsCount);
+	for (size_t wallIndex = 0; wallIndex < checkpoint.wallsCount; ++wallIndex)
+	{
+		const BulletManagerSnapshot::Wall& wall = checkpoint.walls[wallIndex];
+
+		walls.push_back({ WallDefinition(wall.start, wall.end), wall.timeDestroyed });
+	}
+
+	// bullets are stored as they are kept, ids included
+	bullets.assign(checkpoint.bullets, checkpoint.bullets + checkpoint.bulletsCount);
+
+	InitializeThreadPool();
+}
+
+BulletManager::BulletManager(std::vector<Wall>&& inWalls, std::vector<Bullet>&& inBullets) : walls(std::move(inWalls)), bullets(std::move(inBullets))
+{
+	InitializeBulletIds();
+
+	InitializeThreadPool();
+}
+
+void BulletManager::InitializeBulletIds()
+{
+	for (Bullet& bullet : bullets)
+	{
+		bullet.id = nextBulletId++;
+	}
+}
+
+void BulletManager::InitializeThreadPool()
+{
 	constexpr static int defaultThreadsToUse = 4;
 
 	threadsToUse = std::thread::hardware_concurrency();
@@ -35,234 +192,2167 @@ BulletManager::BulletManager(const std::vector<WallDefinition>& inWallDefinition
 		threadsToUse = defaultThreadsToUse;
 	};
 
-	threadPool = std::make_unique<ThreadPool>(threadsToUse);
+	simulationBuffers = std::make_unique<SimulationBuffers>();
+}
+
+ThreadPool* BulletManager::GetThreadPool() const
+{
+	// created on first use, so that managers given a shared pool never start threads of their own
+	if (bUsesOwnThreadPool && !ownedThreadPool)
+	{
+		ownedThreadPool = std::make_unique<ThreadPool>(threadsToUse);
+
+		threadPool = ownedThreadPool.get();
+	}
+
+	return threadPool;
+}
+
+void BulletManager::SetThreadPool(ThreadPool* inThreadPool, int inStagesCount)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	bUsesOwnThreadPool = false;
+
+	ownedThreadPool.reset();
+
+	threadPool = inThreadPool;
+
+	threadsToUse = std::max(1, inStagesCount);
 }
 
-BulletManager::~BulletManager() = default;
+BulletManager::~BulletManager()
+{
+	ReapCheckpointProcess(true);
+
+	if (wallTileStore)
+	{
+		WriteBackWallTiles();
+	}
+}
 
 
 void BulletManager::AddBullet(const Vector2& position, const Vector2& velocity, float time, float lifetime)
 {
 	std::unique_lock<std::mutex> bulletAdditionLock(bulletAdditionMutex);
 
-	bullets.push_back(Bullet{ BulletDefinition(position, velocity, time, lifetime) });
+	bullets.push_back(Bullet{ BulletDefinition(position, velocity, time, lifetime), nextBulletId++ });
+
+	if (bIsTrackingStateHash)
+	{
+		stateHash ^= HashBullet(bullets.back());
+	}
+
+	RecordTrajectoryStart(bullets.back());
+
+	if (eventTrace != nullptr)
+	{
+		eventTrace->RecordSpawn(bullets.back().id, bullets.back().definition);
+	}
+
+	if (flightRecorder != nullptr)
+	{
+		flightRecorder->RecordBulletAddition(currentTime, bullets.back().id, bullets.back().definition);
+	}
 }
 
-void BulletManager::GenerateState(GraphicsState& outGraphicsState) const
+void BulletManager::TakeSnapshot(BulletManagerSnapshot& outSnapshot) const
 {
-	for (const auto& bullet : bullets)
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	outSnapshot.currentTime = currentTime;
+
+	outSnapshot.nextBulletId = nextBulletId;
+
+	if (outSnapshot.wallsSource == this && outSnapshot.wallsRevision == wallsRevision && outSnapshot.walls.size() == walls.size())
 	{
-		if (bullet.definition.startTime < currentTime && currentTime < (bullet.definition.startTime + bullet.definition.lifetime))
+		for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
 		{
-			outGraphicsState.bullets.push_back({ bullet.definition.startingPosition + bullet.definition.velocity * (currentTime - bullet.definition.startTime), bullet.definition.velocity });
+			outSnapshot.walls[wallIndex].timeDestroyed = walls[wallIndex].timeDestroyed;
 		}
 	}
-
-	for (const auto& wall : walls)
+	else
 	{
-		if (wall.timeDestroyed >= 0)
+		outSnapshot.walls.clear();
+		outSnapshot.walls.reserve(walls.size());
+		for (const Wall& wall : walls)
 		{
-			continue;
+			outSnapshot.walls.push_back({ wall.definition.start, wall.definition.end, wall.timeDestroyed });
 		}
 
-		outGraphicsState.walls.push_back({ wall.definition.start, wall.definition.end });
+		outSnapshot.wallsSource = this;
+		outSnapshot.wallsRevision = wallsRevision;
+	}
+
+	outSnapshot.bullets.resize(bullets.size());
+	for (size_t bulletIndex = 0; bulletIndex < bullets.size(); ++bulletIndex)
+	{
+		outSnapshot.bullets[bulletIndex] = bullets[bulletIndex].definition;
 	}
 }
 
-struct WallDestructionData
+void BulletManager::DropExpiredBullets()
 {
-	int bulletIndex = -1;
-	float time = std::numeric_limits<float>::max();
-};
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
 
-struct BulletHitData
+	RemoveExpiredBullets();
+}
+
+bool BulletManager::BeginCheckpoint(const std::string& path)
 {
-	int wallIndex = -1;
-	float time = std::numeric_limits<float>::max();
-};
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
 
-struct BulletManager::FilterStage
+	if (!ReapCheckpointProcess(false))
+	{
+		std::cout << "The previous checkpoint is still being written" << std::endl;
+		return false;
+	}
+
+#ifdef _WIN32
+	return WriteCheckpointFile(path.c_str(), currentTime, nextBulletId, walls.data(), walls.size(), bullets.data(), bullets.size());
+#else
+	// prepared before the fork, the child should not allocate
+	const std::string partialPath = path + ".partial";
+
+	const pid_t processId = fork();
+
+	if (processId < 0)
+	{
+		std::cout << "Failed to fork for the checkpoint " << path << std::endl;
+		return false;
+	}
+
+	if (processId == 0)
+	{
+		// only this thread exists in the child and the lock is held, so the state stays as it was at the fork
+		const bool bWasWritten = WriteCheckpointFile(partialPath.c_str(), currentTime, nextBulletId, walls.data(), walls.size(), bullets.data(), bullets.size())
+			&& std::rename(partialPath.c_str(), path.c_str()) == 0;
+
+		_exit(bWasWritten ? 0 : 1);
+	}
+
+	checkpointProcessId = processId;
+
+	return true;
+#endif
+}
+
+bool BulletManager::IsCheckpointInProgress()
 {
-	struct Setup
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	return !ReapCheckpointProcess(false);
+}
+
+bool BulletManager::ReapCheckpointProcess(bool bWait)
+{
+#ifndef _WIN32
+	if (checkpointProcessId == 0)
 	{
-		Setup(int startWallIndex,
+		return true;
+	}
 
-			int endWallIndex,
+	int status = 0;
 
-			float startTime,
-			float endTime,
+	const pid_t reapedProcessId = waitpid(checkpointProcessId, &status, bWait ? 0 : WNOHANG);
 
-			const std::vector<Wall>& walls,
+	if (reapedProcessId == 0)
+	{
+		return false;
+	}
 
-			const std::vector<Bullet>& bullets) : startWallIndex(startWallIndex), endWallIndex(endWallIndex), startTime(startTime), endTime(endTime), walls(walls), bullets(bullets)
-		{}
+	if (reapedProcessId < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		std::cout << "Failed to write a checkpoint" << std::endl;
+	}
 
+	checkpointProcessId = 0;
+#endif
 
+	return true;
+}
 
-		int startWallIndex;
+bool BulletManager::LoadOrBuildWallIndex(const std::string& indexPath)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
 
-		int endWallIndex;
+	if (!wallGrid)
+	{
+		wallGrid = std::make_unique<WallGrid>();
+	}
 
-		float startTime;
-		float endTime;
+	const unsigned long long wallsHash = WallGrid::HashWalls(walls);
 
-		const std::vector<Wall>& walls;
+	if (wallGrid->Load(indexPath, wallsHash, walls))
+	{
+		return true;
+	}
 
-		const std::vector<Bullet>& bullets;
-	};
+	wallGrid->Build(walls);
 
-	FilterStage(const Setup& setup) : setup(setup),
-		calculatedWalls(setup.endWallIndex - setup.startWallIndex)
+	if (!wallGrid->Save(indexPath, wallsHash))
 	{
+		std::cout << "Failed to store the wall index to " << indexPath << std::endl;
+	}
+
+	return false;
+}
 
+void BulletManager::EnsureWallGrid()
+{
+	if (!wallGrid)
+	{
+		wallGrid = std::make_unique<WallGrid>();
 	}
 
-	void DoWork()
+	if (!wallGrid->IsBuilt())
 	{
-		for (int bulletIndex = 0; bulletIndex < setup.bullets.size(); ++bulletIndex)
-		{
-			//std::cout << "Starting bullet " << bulletIndex << std::endl;
-			const Bullet& bullet = setup.bullets[bulletIndex];
+		wallGrid->Build(walls);
+	}
+}
 
-			for (int wallIndex = setup.startWallIndex; wallIndex < setup.endWallIndex; ++wallIndex)
-			{
-				const Wall& wall = setup.walls[wallIndex];
+void BulletManager::SetBulletSchedule(std::unique_ptr<BulletScheduleReader> inBulletSchedule, float inScheduleLookAhead)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
 
-				if (!CanCollide(wall, bullet, setup.startTime, setup.endTime))
-				{
-					continue;
-				}
+	bulletSchedule = std::move(inBulletSchedule);
 
-				float timeToHit;
-				if (TryGetTimeDestroyed(wall.definition, bullet.definition, timeToHit) && timeToHit < setup.endTime)
-				{
-					const int calculatedWallIndex = wallIndex - setup.startWallIndex;
+	scheduleLookAhead = inScheduleLookAhead;
+}
 
-					WallDestructionData& data = calculatedWalls[calculatedWallIndex];
+void BulletManager::PullScheduledBullets(float time)
+{
+	pulledBullets.clear();
 
-					if (timeToHit < data.time)
-					{
-						bWereAnyCollisionHitsFound = true;
-						data.time = timeToHit;
-						data.bulletIndex = bulletIndex;
-					}
-				}
-			}
+	bulletSchedule->ReadUntil(time, pulledBullets);
+
+	AddPulledBullets();
+}
+
+void BulletManager::DrainCommandRing()
+{
+	pulledBullets.clear();
+
+	commandRing->Drain(currentTime, pulledBullets);
+
+	AddPulledBullets();
+}
+
+void BulletManager::AddPulledBullets()
+{
+	bullets.reserve(bullets.size() + pulledBullets.size());
+
+	for (const BulletDefinition& bulletDefinition : pulledBullets)
+	{
+		bullets.push_back({ bulletDefinition, nextBulletId++ });
+
+		if (bIsTrackingStateHash)
+		{
+			stateHash ^= HashBullet(bullets.back());
 		}
-	
-		//printf("Done work\r\n");
-	}
 
-	Setup setup;
+		RecordTrajectoryStart(bullets.back());
 
-	std::vector<WallDestructionData> calculatedWalls;
+		if (eventTrace != nullptr)
+		{
+			eventTrace->RecordSpawn(bullets.back().id, bulletDefinition);
+		}
 
-	bool bWereAnyCollisionHitsFound = false;
-};
+		if (flightRecorder != nullptr)
+		{
+			flightRecorder->RecordBulletAddition(currentTime, bullets.back().id, bulletDefinition);
+		}
+	}
+}
 
-struct BulletManager::ApplyBulletStage
+void BulletManager::RemoveExpiredBullets()
 {
-	struct Setup
+	const float time = currentTime;
+
+	const auto expiredBullets = std::stable_partition(bullets.begin(), bullets.end(), [time](const Bullet& bullet)
 	{
-		Setup(
-			int startBulletIndex,
-		int endBulletIndex,
+		return bullet.definition.startTime + bullet.definition.lifetime > time;
+	});
+
+	if (bIsTrackingStateDelta)
+	{
+		for (auto bullet = expiredBullets; bullet != bullets.end(); ++bullet)
+		{
+			// bullets added after the previous delta were never reported, the ones that ended before it already were
+			if (bullet->id < lastDeltaBulletId && bullet->definition.startTime + bullet->definition.lifetime > lastDeltaTime)
+			{
+				pendingExpiredBulletIds.push_back(bullet->id);
+			}
+		}
+	}
+
+	if (bIsTrackingStateHash)
+	{
+		for (auto bullet = expiredBullets; bullet != bullets.end(); ++bullet)
+		{
+			stateHash ^= HashBullet(*bullet);
+		}
+	}
+
+	if (eventTrace != nullptr)
+	{
+		for (auto bullet = expiredBullets; bullet != bullets.end(); ++bullet)
+		{
+			eventTrace->RecordExpiry(bullet->id, bullet->definition.startTime + bullet->definition.lifetime);
+		}
+	}
+
+	if (!rewindSteps.empty())
+	{
+		for (auto bullet = expiredBullets; bullet != bullets.end(); ++bullet)
+		{
+			rewindJournal.push_back({ *bullet, -1, bullet->definition.startTime + bullet->definition.lifetime });
+		}
+
+		rewindSteps.back().entriesCount += bullets.end() - expiredBullets;
+	}
+
+	// the bullets and the state hash follow the removal, so a replay has to make it at the same point
+	if (flightRecorder != nullptr && expiredBullets != bullets.end())
+	{
+		flightRecorder->RecordExpiredBulletsRemoval(currentTime);
+	}
+
+	bullets.erase(expiredBullets, bullets.end());
+}
+
+void BulletManager::HandOffBulletsOutside(const Vector2& boxMin, const Vector2& boxMax, std::vector<BulletDefinition>& outBullets)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	const float time = currentTime;
+
+	const auto removedBullets = std::stable_partition(bullets.begin(), bullets.end(), [time, &boxMin, &boxMax](const Bullet& bullet)
+	{
+		const Vector2 location = EvaluateBulletLocation(bullet.definition, time);
+
+		const bool bIsInBox = location.X >= boxMin.X && location.Y >= boxMin.Y && location.X <= boxMax.X && location.Y <= boxMax.Y;
+
+		return bIsInBox && bullet.definition.startTime + bullet.definition.lifetime > time;
+	});
+
+	for (auto bullet = removedBullets; bullet != bullets.end(); ++bullet)
+	{
+		if (bullet->definition.startTime + bullet->definition.lifetime > time)
+		{
+			outBullets.push_back(bullet->definition);
+		}
+
+		if (bIsTrackingStateDelta && bullet->id < lastDeltaBulletId && bullet->definition.startTime + bullet->definition.lifetime > lastDeltaTime)
+		{
+			pendingExpiredBulletIds.push_back(bullet->id);
+		}
+
+		if (bIsTrackingStateHash)
+		{
+			stateHash ^= HashBullet(*bullet);
+		}
+
+		if (eventTrace != nullptr)
+		{
+			eventTrace->RecordExpiry(bullet->id, std::fmin(time, bullet->definition.startTime + bullet->definition.lifetime));
+		}
+	}
+
+	bullets.erase(removedBullets, bullets.end());
+
+	ClearRewindJournal();
+}
+
+bool BulletManager::DestroyWall(int wallIndex, float time)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	Wall& wall = walls[wallIndex];
+
+	if (wall.timeDestroyed >= 0)
+	{
+		return false;
+	}
+
+	if (bIsTrackingStateHash)
+	{
+		stateHash ^= HashWall(wallIndex, wall);
+	}
+
+	wall.timeDestroyed = time;
+
+	if (bIsTrackingStateHash)
+	{
+		stateHash ^= HashWall(wallIndex, wall);
+	}
+
+	lastDestroyedWalls.push_back(wall.definition);
+
+	if (bIsTrackingStateDelta)
+	{
+		pendingDestroyedWalls.push_back(wall.definition);
+	}
+
+	if (worldRegions)
+	{
+		worldRegions->MarkWallDestroyed(wallIndex, time);
+	}
+
+	if (eventTrace != nullptr)
+	{
+		eventTrace->RecordWallDestruction(wallIndex, time);
+	}
+
+	ClearRewindJournal();
+
+	return true;
+}
+
+void BulletManager::SetWallDestructionLog(std::vector<WallDestruction>* inDestructionLog)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	destructionLog = inDestructionLog;
+}
+
+void BulletManager::SetWallTileStore(std::unique_ptr<WallTileStore> inWallTileStore, float inTileLookAhead)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	if (wallTileStore)
+	{
+		WriteBackWallTiles();
+	}
+
+	wallTileStore = std::move(inWallTileStore);
+
+	tileLookAhead = inTileLookAhead;
+
+	walls.clear();
+
+	residentWallTiles.clear();
+
+	wallGrid.reset();
+
+	++wallsRevision;
+
+	ClearRewindJournal();
+
+	if (eventTrace != nullptr)
+	{
+		eventTrace->RecordWalls(currentTime, walls);
+	}
+}
+
+void BulletManager::PageWallTiles(float horizonTime)
+{
+	enum TileState : char
+	{
+		NotNeeded,
+		Needed,
+		Resident,
+	};
+
+	std::vector<char> tileStates(wallTileStore->GetTilesCount(), NotNeeded);
+
+	for (const Bullet& bullet : bullets)
+	{
+		const float flightStartTime = std::fmax(currentTime, bullet.definition.startTime);
+		const float flightEndTime = std::fmin(horizonTime, bullet.definition.startTime + bullet.definition.lifetime);
+
+		if (flightEndTime < flightStartTime)
+		{
+			continue;
+		}
+
+		// reflections may turn the bullet anywhere, so take everything within its travel distance
+		const Vector2 position = EvaluateBulletLocation(bullet.definition, flightStartTime);
+
+		const float reach = bullet.definition.velocity.GetMagnitude() * (flightEndTime - flightStartTime);
+
+		wallTileStore->ForEachTileInBox(position - Vector2{ reach, reach }, position + Vector2{ reach, reach }, [&tileStates](int tileIndex) { tileStates[tileIndex] = Needed; });
+	}
+
+	bool bHaveTilesChanged = false;
+
+	std::vector<Wall> pagedWalls;
+
+	// the new index of every current wall, -1 for the evicted ones
+	std::vector<int> pagedWallIndices(rewindJournal.empty() ? 0 : walls.size(), -1);
+
+	std::vector<ResidentWallTile> pagedTiles;
+
+	for (const ResidentWallTile& residentTile : residentWallTiles)
+	{
+		if (tileStates[residentTile.tileIndex] == NotNeeded)
+		{
+			wallTileStore->WriteTile(residentTile.tileIndex, walls.data() + residentTile.firstWall);
+
+			bHaveTilesChanged = true;
+
+			continue;
+		}
+
+		tileStates[residentTile.tileIndex] = Resident;
+
+		for (int tileWall = 0; tileWall < residentTile.wallsCount && !pagedWallIndices.empty(); ++tileWall)
+		{
+			pagedWallIndices[residentTile.firstWall + tileWall] = static_cast<int>(pagedWalls.size()) + tileWall;
+		}
+
+		pagedTiles.push_back({ residentTile.tileIndex, static_cast<int>(pagedWalls.size()), residentTile.wallsCount });
+
+		pagedWalls.insert(pagedWalls.end(), walls.begin() + residentTile.firstWall, walls.begin() + residentTile.firstWall + residentTile.wallsCount);
+	}
+
+	for (int tileIndex = 0; tileIndex < static_cast<int>(tileStates.size()); ++tileIndex)
+	{
+		if (tileStates[tileIndex] != Needed)
+		{
+			continue;
+		}
+
+		const int firstWall = static_cast<int>(pagedWalls.size());
+
+		if (!wallTileStore->ReadTile(tileIndex, pagedWalls))
+		{
+			std::cout << "Failed to read wall tile " << tileIndex << std::endl;
+			continue;
+		}
+
+		pagedTiles.push_back({ tileIndex, firstWall, static_cast<int>(pagedWalls.size()) - firstWall });
+
+		bHaveTilesChanged = true;
+	}
+
+	if (!bHaveTilesChanged)
+	{
+		return;
+	}
+
+	walls.swap(pagedWalls);
+
+	residentWallTiles.swap(pagedTiles);
+
+	++wallsRevision;
+
+	// the wall indices have changed
+	wallGrid.reset();
+
+	RemapRewindJournal(pagedWallIndices);
+
+	if (eventTrace != nullptr)
+	{
+		eventTrace->RecordWalls(currentTime, walls);
+	}
+}
+
+void BulletManager::WriteBackWallTiles()
+{
+	for (const ResidentWallTile& residentTile : residentWallTiles)
+	{
+		wallTileStore->WriteTile(residentTile.tileIndex, walls.data() + residentTile.firstWall);
+	}
+}
+
+unsigned long long BulletManager::GetStateHash()
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	// paged tiles move the walls to other indices, the whole hash is rebuilt then
+	if (!bIsTrackingStateHash || stateHashWallsRevision != wallsRevision)
+	{
+		RebuildStateHash();
+	}
+
+	const float values[] = { currentTime };
+
+	return stateHash ^ HashStateElement(~0ull, values, 1);
+}
+
+void BulletManager::RebuildStateHash()
+{
+	bIsTrackingStateHash = true;
+
+	stateHashWallsRevision = wallsRevision;
+
+	stateHash = 0;
+
+	for (int wallIndex = 0; wallIndex < static_cast<int>(walls.size()); ++wallIndex)
+	{
+		stateHash ^= HashWall(wallIndex, walls[wallIndex]);
+	}
+
+	for (const Bullet& bullet : bullets)
+	{
+		stateHash ^= HashBullet(bullet);
+	}
+}
+
+void BulletManager::SetRewindWindow(float inRewindWindow)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	rewindWindow = std::fmax(0.0f, inRewindWindow);
+
+	if (rewindWindow <= 0)
+	{
+		rewindJournal.clear();
+		rewindSteps.clear();
+	}
+	else if (rewindSteps.empty())
+	{
+		rewindSteps.push_back({ currentTime, 0 });
+	}
+}
+
+float BulletManager::GetEarliestRewindTime() const
+{
+	return rewindSteps.empty() ? currentTime : rewindSteps.front().startTime;
+}
+
+void BulletManager::BeginRewindStep()
+{
+	if (rewindWindow <= 0)
+	{
+		return;
+	}
+
+	rewindSteps.push_back({ currentTime, 0 });
+
+	// a step is only needed while the one after it starts within the window
+	while (rewindSteps.size() > 1 && rewindSteps[1].startTime <= currentTime - rewindWindow)
+	{
+		rewindJournal.erase(rewindJournal.begin(), rewindJournal.begin() + rewindSteps.front().entriesCount);
+
+		rewindSteps.pop_front();
+	}
+}
+
+void BulletManager::RemapRewindJournal(const std::vector<int>& newWallIndices)
+{
+	size_t droppedEntriesCount = 0;
+
+	for (size_t entryIndex = 0; entryIndex < rewindJournal.size(); ++entryIndex)
+	{
+		RewindEntry& entry = rewindJournal[entryIndex];
+
+		if (entry.wallIndex < 0)
+		{
+			continue;
+		}
+
+		entry.wallIndex = newWallIndices[entry.wallIndex];
+
+		if (entry.wallIndex < 0)
+		{
+			droppedEntriesCount = entryIndex + 1;
+		}
+	}
+
+	// an evicted wall was written back destroyed and can't be restored, so the steps up to its entry go
+	while (droppedEntriesCount > 0 && !rewindSteps.empty())
+	{
+		const size_t stepEntriesCount = rewindSteps.front().entriesCount;
+
+		rewindJournal.erase(rewindJournal.begin(), rewindJournal.begin() + stepEntriesCount);
+
+		rewindSteps.pop_front();
+
+		droppedEntriesCount -= std::min(droppedEntriesCount, stepEntriesCount);
+	}
+
+	if (rewindSteps.empty() && rewindWindow > 0)
+	{
+		rewindSteps.push_back({ currentTime, 0 });
+	}
+}
+
+void BulletManager::ClearRewindJournal()
+{
+	rewindJournal.clear();
+	rewindSteps.clear();
+
+	if (rewindWindow > 0)
+	{
+		rewindSteps.push_back({ currentTime, 0 });
+	}
+}
+
+bool BulletManager::RewindTo(float time)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	if (rewindSteps.empty() || time < rewindSteps.front().startTime || time > currentTime)
+	{
+		return false;
+	}
+
+	bool bWereWallsRestored = false;
+
+	// the steps the time falls into or follows
+	size_t undoneEntriesCount = 0;
+
+	for (auto step = rewindSteps.rbegin(); step != rewindSteps.rend(); ++step)
+	{
+		undoneEntriesCount += step->entriesCount;
+
+		if (step->startTime <= time)
+		{
+			break;
+		}
+	}
+
+	// inserting each expired bullet into the bullets would move all that follow it
+	restoredBullets.clear();
+
+	for (auto entry = rewindJournal.end() - undoneEntriesCount; entry != rewindJournal.end(); ++entry)
+	{
+		if (entry->time > time && entry->wallIndex < 0)
+		{
+			restoredBullets.push_back(entry->bullet);
+		}
+	}
+
+	std::sort(restoredBullets.begin(), restoredBullets.end(), [](const Bullet& first, const Bullet& second) { return first.id < second.id; });
+
+	while (true)
+	{
+		RewindStep& step = rewindSteps.back();
+
+		const auto firstEntry = rewindJournal.end() - step.entriesCount;
+
+		// newest first, so that a bullet hit several times ends up as it was before the earliest undone hit
+		for (auto entry = rewindJournal.end(); entry != firstEntry;)
+		{
+			--entry;
+
+			if (entry->time > time)
+			{
+				UndoRewindEntry(*entry);
+
+				bWereWallsRestored |= entry->wallIndex >= 0;
+			}
+		}
+
+		if (step.startTime > time)
+		{
+			rewindJournal.erase(firstEntry, rewindJournal.end());
+
+			rewindSteps.pop_back();
+
+			continue;
+		}
+
+		// the step the time falls into keeps the events up to it
+		const auto keptEntriesEnd = std::remove_if(firstEntry, rewindJournal.end(), [time](const RewindEntry& entry) { return entry.time > time; });
+
+		step.entriesCount = keptEntriesEnd - firstEntry;
+
+		rewindJournal.erase(keptEntriesEnd, rewindJournal.end());
+
+		break;
+	}
+
+	if (!restoredBullets.empty())
+	{
+		const size_t keptBulletsCount = bullets.size();
+
+		bullets.insert(bullets.end(), restoredBullets.begin(), restoredBullets.end());
+
+		std::inplace_merge(bullets.begin(), bullets.begin() + keptBulletsCount, bullets.end(), [](const Bullet& first, const Bullet& second) { return first.id < second.id; });
+
+		restoredBullets.clear();
+	}
+
+	currentTime = time;
+
+	lastDestroyedWalls.clear();
+
+	if (worldRegions)
+	{
+		// expired bullets may have been put back; restored walls split the world again through the revision
+		worldRegions->ResetBullets();
+	}
+
+	if (bWereWallsRestored)
+	{
+		// walls standing again can't be patched into a renderer's wall layer
+		++wallsRevision;
+
+		stateHashWallsRevision = bIsTrackingStateHash ? wallsRevision : stateHashWallsRevision;
+	}
+
+	lastDeltaTime = std::fmin(lastDeltaTime, time);
+
+	if (eventTrace != nullptr)
+	{
+		eventTrace->RecordRewind(time);
+	}
+
+	if (flightRecorder != nullptr)
+	{
+		flightRecorder->RecordRewind(time);
+	}
+
+	return true;
+}
+
+void BulletManager::UndoRewindEntry(const RewindEntry& entry)
+{
+	const auto isBulletBefore = [](const Bullet& bullet, unsigned int id)
+	{
+		return bullet.id < id;
+	};
+
+	// bullets are kept in the order of their ids; one that expired later is among the restored ones
+	auto bullet = std::lower_bound(bullets.begin(), bullets.end(), entry.bullet.id, isBulletBefore);
+
+	if (bullet == bullets.end() || bullet->id != entry.bullet.id)
+	{
+		bullet = std::lower_bound(restoredBullets.begin(), restoredBullets.end(), entry.bullet.id, isBulletBefore);
+
+		if (bullet == restoredBullets.end() || bullet->id != entry.bullet.id)
+		{
+			return;
+		}
+	}
+
+	// an expired bullet is already restored as it was when it expired
+	if (entry.wallIndex >= 0)
+	{
+		Wall& wall = walls[entry.wallIndex];
+
+		if (bIsTrackingStateHash)
+		{
+			stateHash ^= HashBullet(*bullet) ^ HashWall(entry.wallIndex, wall);
+		}
+
+		*bullet = entry.bullet;
+
+		wall.timeDestroyed = -1;
+
+		if (bIsRecordingTrajectories)
+		{
+			std::vector<BulletLeg>& legs = bulletTrajectories[entry.bullet.id].legs;
+
+			if (legs.size() > 1 && legs.back().startTime >= entry.time)
+			{
+				legs.pop_back();
+			}
+		}
+
+		if (bIsTrackingStateHash)
+		{
+			stateHash ^= HashWall(entry.wallIndex, wall);
+		}
+	}
+
+	if (bIsTrackingStateHash)
+	{
+		stateHash ^= HashBullet(entry.bullet);
+	}
+
+	if (bIsTrackingStateDelta)
+	{
+		// reported as reflected, also when the bullet had been reported as expired
+		pendingReflectedBulletIds.push_back(entry.bullet.id);
+	}
+}
+
+void BulletManager::SetTrajectoryRecording(bool bInIsRecordingTrajectories)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	if (bInIsRecordingTrajectories == bIsRecordingTrajectories)
+	{
+		return;
+	}
+
+	bIsRecordingTrajectories = bInIsRecordingTrajectories;
+
+	bulletTrajectories.clear();
+
+	if (!bIsRecordingTrajectories)
+	{
+		bulletTrajectories.shrink_to_fit();
+		return;
+	}
+
+	// the live bullets start with their current leg, the ones before it are gone
+	bulletTrajectories.resize(nextBulletId);
+
+	for (const Bullet& bullet : bullets)
+	{
+		RecordTrajectoryStart(bullet);
+	}
+}
+
+void BulletManager::RecordTrajectoryStart(const Bullet& bullet)
+{
+	if (!bIsRecordingTrajectories)
+	{
+		return;
+	}
+
+	if (bulletTrajectories.size() <= bullet.id)
+	{
+		bulletTrajectories.resize(bullet.id + 1);
+	}
+
+	BulletTrajectory& trajectory = bulletTrajectories[bullet.id];
+
+	trajectory.endTime = bullet.definition.startTime + bullet.definition.lifetime;
+
+	trajectory.legs.assign(1, { bullet.definition.startTime, bullet.definition.startingPosition, bullet.definition.velocity });
+}
+
+bool BulletManager::GetBulletLocationAt(unsigned int bulletId, float time, Vector2& outLocation) const
+{
+	if (bulletId >= bulletTrajectories.size())
+	{
+		return false;
+	}
+
+	const BulletTrajectory& trajectory = bulletTrajectories[bulletId];
+
+	if (trajectory.legs.empty() || time < trajectory.legs.front().startTime || time > trajectory.endTime || time > currentTime)
+	{
+		return false;
+	}
+
+	// the last leg starting at or before the time
+	const auto leg = std::upper_bound(trajectory.legs.begin(), trajectory.legs.end(), time, [](float time, const BulletLeg& leg)
+	{
+		return time < leg.startTime;
+	}) - 1;
+
+	outLocation = leg->startingPosition + leg->velocity * (time - leg->startTime);
+
+	return true;
+}
+
+const std::vector<BulletManager::BulletLeg>* BulletManager::GetBulletTrajectory(unsigned int bulletId) const
+{
+	if (bulletId >= bulletTrajectories.size() || bulletTrajectories[bulletId].legs.empty())
+	{
+		return nullptr;
+	}
+
+	return &bulletTrajectories[bulletId].legs;
+}
+
+void BulletManager::SetFlightRecorder(FlightRecorder* inFlightRecorder)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	flightRecorder = inFlightRecorder;
+}
+
+void BulletManager::SetCommandRing(BulletCommandRing* inCommandRing)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	commandRing = inCommandRing;
+}
+
+void BulletManager::SetStatePublisher(SharedStatePublisher* inStatePublisher)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	statePublisher = inStatePublisher;
+}
+
+void BulletManager::SetEventTrace(EventTraceWriter* inEventTrace)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	eventTrace = inEventTrace;
+
+	if (eventTrace == nullptr)
+	{
+		return;
+	}
+
+	eventTrace->RecordWalls(currentTime, walls);
+
+	for (const Bullet& bullet : bullets)
+	{
+		eventTrace->RecordSpawn(bullet.id, bullet.definition);
+	}
+}
+
+// hits are chosen by the earliest time, ties go to the lower index;
+// the order is total, so the outcome doesn't depend on how the work is split between the stages
+static bool IsEarlierHit(float time, int index, float otherTime, int otherIndex)
+{
+	return time < otherTime || (time == otherTime && index < otherIndex);
+}
+
+struct WallDestructionData
+{
+	int bulletIndex = -1;
+	float time = std::numeric_limits<float>::max();
+};
+
+struct BulletHitData
+{
+	int wallIndex = -1;
+	float time = std::numeric_limits<float>::max();
+};
+
+struct SimulationBuffers
+{
+	std::vector<WallDestructionData> wallVsBullets;
+
+	std::vector<BulletHitData> bulletsVsWall;
+
+	// the collision islands of the current window: the union-find parent of every bullet, -1 for bullets that can't reach a wall,
+	// the first bullet that reached every wall, and the bullets of every island back to back in the order of their indices
+	std::vector<int> islandParents;
+
+	std::vector<int> wallFirstBullets;
+
+	std::vector<int> touchedWalls;
+
+	std::vector<int> bulletIslands;
+
+	std::vector<int> islandStarts;
+
+	std::vector<int> islandFillPositions;
+
+	std::vector<int> islandBullets;
+};
+
+struct CollisionIslandHit
+{
+	int bulletIndex;
+
+	int wallIndex;
+
+	float time;
+
+	// the bullet before the hit and where it flies after it
+	BulletManager::Bullet bullet;
+
+	BulletManager::BulletDefinition reflected;
+};
+
+struct BulletManager::FilterStage
+{
+	struct Setup
+	{
+		Setup(int startWallIndex,
+
+			int endWallIndex,
+
+			float startTime,
+			float endTime,
+
+			const std::vector<Wall>& walls,
+
+			const std::vector<Bullet>& bullets,
+
+			const WallGrid& wallGrid,
+
+			bool bTestWallBoxes,
+
+			const std::vector<int>* bulletIndices = nullptr,
+
+			const std::vector<int>* wallIndices = nullptr) : startWallIndex(startWallIndex), endWallIndex(endWallIndex), startTime(startTime), endTime(endTime), walls(walls), bullets(bullets), wallGrid(wallGrid), bTestWallBoxes(bTestWallBoxes), bulletIndices(bulletIndices), wallIndices(wallIndices)
+		{}
+
+
+
+		int startWallIndex;
+
+		int endWallIndex;
+
+		float startTime;
+		float endTime;
+
+		const std::vector<Wall>& walls;
+
+		const std::vector<Bullet>& bullets;
+
+		const WallGrid& wallGrid;
+
+		bool bTestWallBoxes;
+
+		// the bullets to test, nullptr for all of them
+		const std::vector<int>* bulletIndices;
+
+		// the index of every wall in the manager's walls when the walls are a region's copies, nullptr when they are the manager's
+		const std::vector<int>* wallIndices;
+	};
+
+	FilterStage(const Setup& setup) : setup(setup),
+		calculatedWalls(setup.endWallIndex - setup.startWallIndex)
+	{
+
+	}
+
+	void DoWork()
+	{
+		const int testedBulletsCount = static_cast<int>(setup.bulletIndices != nullptr ? setup.bulletIndices->size() : setup.bullets.size());
+
+		for (int testedBulletIndex = 0; testedBulletIndex < testedBulletsCount; ++testedBulletIndex)
+		{
+			const int bulletIndex = setup.bulletIndices != nullptr ? (*setup.bulletIndices)[testedBulletIndex] : testedBulletIndex;
+
+			//std::cout << "Starting bullet " << bulletIndex << std::endl;
+			const Bullet& bullet = setup.bullets[bulletIndex];
+
+			// only the walls in the cells the bullet sweeps during the step can be hit
+			Vector2 sweepMin;
+			Vector2 sweepMax;
+
+			if (!TryGetBulletSweepBounds(bullet.definition, setup.startTime, setup.endTime, sweepMin, sweepMax))
+			{
+				continue;
+			}
+
+			candidateWallIndices.clear();
+
+			const size_t testedWallsCount = setup.bTestWallBoxes
+				? setup.wallGrid.GetWallsOverlappingBox(sweepMin, sweepMax, setup.startWallIndex, setup.endWallIndex, candidateWallIndices)
+				: setup.wallGrid.GetWallsInCells(sweepMin, sweepMax, setup.startWallIndex, setup.endWallIndex, candidateWallIndices);
+
+			broadPhaseStats.testedPairsCount += testedWallsCount;
+			broadPhaseStats.rejectedPairsCount += testedWallsCount - candidateWallIndices.size();
+
+			for (const int wallIndex : candidateWallIndices)
+			{
+				const Wall& wall = setup.walls[wallIndex];
+
+				if (wall.timeDestroyed >= 0)
+				{
+					continue;
+				}
+
+				float timeToHit;
+				if (TryGetTimeDestroyed(wall.definition, bullet.definition, timeToHit) && timeToHit >= setup.startTime && timeToHit < setup.endTime)
+				{
+					++broadPhaseStats.hitPairsCount;
+
+					const int calculatedWallIndex = wallIndex - setup.startWallIndex;
+
+					WallDestructionData& data = calculatedWalls[calculatedWallIndex];
+
+					if (IsEarlierHit(timeToHit, bulletIndex, data.time, data.bulletIndex))
+					{
+						bWereAnyCollisionHitsFound = true;
+						data.time = timeToHit;
+						data.bulletIndex = bulletIndex;
+					}
+				}
+			}
+		}
+	
+		//printf("Done work\r\n");
+	}
+
+	Setup setup;
+
+	std::vector<WallDestructionData> calculatedWalls;
+
+	bool bWereAnyCollisionHitsFound = false;
+
+	BroadPhaseStats broadPhaseStats;
+
+	// the walls of the bullet being tested that passed the bounding boxes
+	std::vector<int> candidateWallIndices;
+};
+
+struct BulletManager::ApplyBulletStage
+{
+	struct Setup
+	{
+		Setup(
+			int startBulletIndex,
+		int endBulletIndex,
+
+		const std::vector<BulletHitData>& bulletsVsWall,
+
+		std::vector<Bullet>& bullets,
+
+		std::vector<Wall>& walls,
+
+		bool bHashState,
+
+		std::vector<BulletTrajectory>* trajectories):startBulletIndex(startBulletIndex), endBulletIndex(endBulletIndex), bulletsVsWall(bulletsVsWall), bullets(bullets), walls(walls), bHashState(bHashState), trajectories(trajectories)
+		{
+		}
+
+		int startBulletIndex;
+		int endBulletIndex;
+
+		const std::vector<BulletHitData>& bulletsVsWall;
+
+		std::vector<Bullet>& bullets;
+
+		std::vector<Wall>& walls;
+
+		bool bHashState;
+
+		// nullptr when the trajectories aren't recorded; every bullet only appends to its own
+		std::vector<BulletTrajectory>* trajectories;
+	};
+
+	ApplyBulletStage(const Setup& setup) : setup(setup)
+	{
+
+	}
+
+	void DoWork()
+	{
+		for (int bulletIndex = setup.startBulletIndex; bulletIndex < setup.endBulletIndex; ++bulletIndex)
+		{
+			const BulletHitData& bulletData = setup.bulletsVsWall[bulletIndex];
+
+			if (bulletData.wallIndex < 0)
+			{
+				continue;
+			}
+
+			Wall& wall = setup.walls[bulletData.wallIndex];
+
+			Bullet& bullet = setup.bullets[bulletIndex];
+
+			if (setup.bHashState)
+			{
+				stateHashChange ^= HashWall(bulletData.wallIndex, wall) ^ HashBullet(bullet);
+			}
+
+			wall.timeDestroyed = bulletData.time;
+
+			ReflectBullet(bullet.definition, wall.definition, bulletData.time);
+
+			if (setup.trajectories != nullptr)
+			{
+				(*setup.trajectories)[bullet.id].legs.push_back({ bulletData.time, bullet.definition.startingPosition, bullet.definition.velocity });
+			}
+
+			if (setup.bHashState)
+			{
+				stateHashChange ^= HashWall(bulletData.wallIndex, wall) ^ HashBullet(bullet);
+			}
+		}
+	}
+
+	Setup setup;
+
+	// XOR of the hashes of the changed walls and bullets before and after the change
+	unsigned long long stateHashChange = 0;
+};
+
+// more than the padding of the sweeps, so that every sweep of a bullet within a window lies inside its reach
+static constexpr float collisionReachPadding = 0.1f;
+
+struct BulletManager::CollisionReachStage
+{
+	CollisionReachStage(int startBulletIndex, int endBulletIndex, float startTime, float endTime, const std::vector<Wall>& walls, const std::vector<Bullet>& bullets, const WallGrid& wallGrid) :
+		startBulletIndex(startBulletIndex), endBulletIndex(endBulletIndex), startTime(startTime), endTime(endTime), walls(&walls), bullets(&bullets), wallGrid(&wallGrid)
+	{
+	}
+
+	void DoWork()
+	{
+		for (int bulletIndex = startBulletIndex; bulletIndex < endBulletIndex; ++bulletIndex)
+		{
+			const BulletDefinition& bullet = (*bullets)[bulletIndex].definition;
+
+			const float flightStartTime = std::fmax(startTime, bullet.startTime);
+			const float flightEndTime = std::fmin(endTime, bullet.startTime + bullet.lifetime);
+
+			if (flightEndTime < flightStartTime)
+			{
+				continue;
+			}
+
+			// reflections keep the speed, so this bounds the path whatever it hits
+			const Vector2 location = EvaluateBulletLocation(bullet, flightStartTime);
+
+			const float reach = bullet.velocity.GetMagnitude() * (flightEndTime - flightStartTime) + collisionReachPadding;
+
+			const size_t firstReachWall = reachWalls.size();
+
+			wallGrid->GetWallsOverlappingBox(location - Vector2{ reach, reach }, location + Vector2{ reach, reach }, 0, static_cast<int>(walls->size()), reachWalls);
+
+			// walls destroyed before the window can't be hit any more and don't tie bullets together
+			reachWalls.erase(std::remove_if(reachWalls.begin() + firstReachWall, reachWalls.end(), [this](int wallIndex) { return (*walls)[wallIndex].timeDestroyed >= 0; }), reachWalls.end());
+
+			if (reachWalls.size() > firstReachWall)
+			{
+				reachBulletIndices.push_back(bulletIndex);
+				reachStarts.push_back(static_cast<int>(firstReachWall));
+			}
+		}
+
+		reachStarts.push_back(static_cast<int>(reachWalls.size()));
+	}
+
+	int startBulletIndex;
+	int endBulletIndex;
+
+	float startTime;
+	float endTime;
+
+	const std::vector<Wall>* walls;
+
+	const std::vector<Bullet>* bullets;
+
+	const WallGrid* wallGrid;
+
+	// the bullets that can reach standing walls, and those walls, back to back
+	std::vector<int> reachBulletIndices;
+
+	std::vector<int> reachStarts;
+
+	std::vector<int> reachWalls;
+};
+
+struct BulletManager::CollisionIslandStage
+{
+	struct Setup
+	{
+		Setup(int startIsland,
+			int endIsland,
+
+			float startTime,
+			float endTime,
+
+			std::vector<Wall>& walls,
+
+			std::vector<Bullet>& bullets,
+
+			const WallGrid& wallGrid,
+
+			const SimulationBuffers& islands,
+
+			bool bHashState,
+
+			std::vector<BulletTrajectory>* trajectories) : startIsland(startIsland), endIsland(endIsland), startTime(startTime), endTime(endTime), walls(walls), bullets(bullets), wallGrid(wallGrid), islands(islands), bHashState(bHashState), trajectories(trajectories)
+		{
+		}
+
+		int startIsland;
+		int endIsland;
+
+		float startTime;
+		float endTime;
+
+		// the islands share no standing walls, so every stage only changes walls and bullets no other stage looks at
+		std::vector<Wall>& walls;
+
+		std::vector<Bullet>& bullets;
+
+		const WallGrid& wallGrid;
+
+		const SimulationBuffers& islands;
+
+		bool bHashState;
+
+		// nullptr when the trajectories aren't recorded; every bullet only appends to its own
+		std::vector<BulletTrajectory>* trajectories;
+	};
+
+	// the next hit of a bullet; every bullet of the island has at most one in the queue
+	struct Event
+	{
+		float time;
+
+		int bulletIndex;
+
+		int wallIndex;
+
+		int islandBullet;
+	};
+
+	CollisionIslandStage(const Setup& setup) : setup(setup)
+	{
+	}
+
+	void DoWork()
+	{
+		for (int island = setup.startIsland; island < setup.endIsland; ++island)
+		{
+			SimulateIsland(setup.islands.islandStarts[island], setup.islands.islandStarts[island + 1]);
+		}
+	}
+
+	// orders the queue so that its top is the earliest hit, ties going to the lower bullet and then wall index
+	static bool IsLaterEvent(const Event& first, const Event& second)
+	{
+		if (first.time != second.time || first.bulletIndex != second.bulletIndex)
+		{
+			return IsEarlierHit(second.time, second.bulletIndex, first.time, first.bulletIndex);
+		}
+
+		return second.wallIndex < first.wallIndex;
+	}
+
+	// a wall destroyed after the time still stands for a hit at it
+	static bool IsWallMissing(const Wall& wall, float time)
+	{
+		return wall.timeDestroyed >= 0 && wall.timeDestroyed <= time;
+	}
+
+	// the hits of the island one at a time in the order of their times, up to the end of the window
+	void SimulateIsland(int islandStart, int islandEnd)
+	{
+		events.clear();
+
+		for (int islandBullet = islandStart; islandBullet < islandEnd; ++islandBullet)
+		{
+			PushNextHit(islandBullet);
+		}
+
+		while (!events.empty())
+		{
+			std::pop_heap(events.begin(), events.end(), IsLaterEvent);
+
+			const Event event = events.back();
+
+			events.pop_back();
+
+			Wall& wall = setup.walls[event.wallIndex];
+
+			if (IsWallMissing(wall, event.time))
+			{
+				// an earlier hit of another bullet took the wall, the bullet flies on to its next one
+				PushNextHit(event.islandBullet);
+				continue;
+			}
+
+			Bullet& bullet = setup.bullets[event.bulletIndex];
+
+			CollisionIslandHit hit{ event.bulletIndex, event.wallIndex, event.time, bullet, BulletDefinition() };
+
+			if (setup.bHashState)
+			{
+				stateHashChange ^= HashWall(event.wallIndex, wall) ^ HashBullet(bullet);
+			}
+
+			wall.timeDestroyed = event.time;
+
+			ReflectBullet(bullet.definition, wall.definition, event.time);
+
+			if (setup.trajectories != nullptr)
+			{
+				(*setup.trajectories)[bullet.id].legs.push_back({ event.time, bullet.definition.startingPosition, bullet.definition.velocity });
+			}
+
+			if (setup.bHashState)
+			{
+				stateHashChange ^= HashWall(event.wallIndex, wall) ^ HashBullet(bullet);
+			}
+
+			hit.reflected = bullet.definition;
+
+			hits.push_back(hit);
+
+			PushNextHit(event.islandBullet);
+		}
+	}
+
+	// the walls still standing then only go away, so the earliest hit found now stays the next one unless its wall is taken
+	void PushNextHit(int islandBullet)
+	{
+		const int bulletIndex = setup.islands.islandBullets[islandBullet];
+
+		const Bullet& bullet = setup.bullets[bulletIndex];
+
+		Vector2 sweepMin;
+		Vector2 sweepMax;
+
+		if (!TryGetBulletSweepBounds(bullet.definition, setup.startTime, setup.endTime, sweepMin, sweepMax))
+		{
+			return;
+		}
+
+		candidateWallIndices.clear();
+
+		const size_t testedWallsCount = setup.wallGrid.GetWallsOverlappingBox(sweepMin, sweepMax, 0, static_cast<int>(setup.walls.size()), candidateWallIndices);
+
+		broadPhaseStats.testedPairsCount += testedWallsCount;
+		broadPhaseStats.rejectedPairsCount += testedWallsCount - candidateWallIndices.size();
+
+		Event nextHit{ std::numeric_limits<float>::max(), bulletIndex, -1, islandBullet };
+
+		for (const int wallIndex : candidateWallIndices)
+		{
+			const Wall& wall = setup.walls[wallIndex];
+
+			float timeToHit;
+			if (TryGetTimeDestroyed(wall.definition, bullet.definition, timeToHit) && timeToHit >= setup.startTime && timeToHit < setup.endTime && !IsWallMissing(wall, timeToHit))
+			{
+				++broadPhaseStats.hitPairsCount;
+
+				if (IsEarlierHit(timeToHit, wallIndex, nextHit.time, nextHit.wallIndex))
+				{
+					nextHit.time = timeToHit;
+					nextHit.wallIndex = wallIndex;
+				}
+			}
+		}
+
+		if (nextHit.wallIndex >= 0)
+		{
+			events.push_back(nextHit);
+
+			std::push_heap(events.begin(), events.end(), IsLaterEvent);
+		}
+	}
+
+	Setup setup;
+
+	// in the order of the islands and, within one, of the times
+	std::vector<CollisionIslandHit> hits;
+
+	unsigned long long stateHashChange = 0;
+
+	BroadPhaseStats broadPhaseStats;
+
+	std::vector<Event> events;
+
+	std::vector<int> candidateWallIndices;
+};
+
+template <class TContainer>
+std::pair<int, int> GetInterval(const TContainer& container, int totalParts, int partIndex)
+{
+	const int containerSize = static_cast<int>(container.size());
+
+	return std::make_pair((containerSize * partIndex) / totalParts, (containerSize * (partIndex + 1)) / totalParts);
+}
+
+static const Vector2 worldMin{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+static const Vector2 worldMax{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+
+static bool IsWallInView(const BulletManager::WallDefinition& wall, const Vector2& viewMin, const Vector2& viewMax)
+{
+	return std::fmax(wall.start.X, wall.end.X) >= viewMin.X && std::fmax(wall.start.Y, wall.end.Y) >= viewMin.Y && std::fmin(wall.start.X, wall.end.X) <= viewMax.X && std::fmin(wall.start.Y, wall.end.Y) <= viewMax.Y;
+}
+
+struct BulletManager::GenerateStateStage
+{
+	// counts the visible walls and bullets of the intervals when there are no outputs, fills the outputs otherwise
+	GenerateStateStage(const BulletManager& manager, std::pair<int, int> wallsInterval, std::pair<int, int> bulletsInterval, const Vector2& viewMin, const Vector2& viewMax, GraphicsState::Wall* wallsOutput, GraphicsState::Bullet* bulletsOutput) :
+		manager(manager), wallsInterval(wallsInterval), bulletsInterval(bulletsInterval), viewMin(viewMin), viewMax(viewMax), wallsOutput(wallsOutput), bulletsOutput(bulletsOutput)
+	{
+	}
+
+	void DoWork()
+	{
+		for (int wallIndex = wallsInterval.first; wallIndex < wallsInterval.second; ++wallIndex)
+		{
+			const Wall& wall = manager.walls[wallIndex];
+
+			if (wall.timeDestroyed >= 0 || !IsWallInView(wall.definition, viewMin, viewMax))
+			{
+				continue;
+			}
+
+			if (wallsOutput != nullptr)
+			{
+				wallsOutput[visibleWallsCount] = { wall.definition.start, wall.definition.end };
+			}
+
+			++visibleWallsCount;
+		}
+
+		for (int bulletIndex = bulletsInterval.first; bulletIndex < bulletsInterval.second; ++bulletIndex)
+		{
+			const Bullet& bullet = manager.bullets[bulletIndex];
+
+			if (!IsBulletVisible(bullet.definition, manager.currentTime))
+			{
+				continue;
+			}
+
+			const Vector2 location = EvaluateBulletLocation(bullet.definition, manager.currentTime);
+
+			if (location.X < viewMin.X || location.Y < viewMin.Y || location.X > viewMax.X || location.Y > viewMax.Y)
+			{
+				continue;
+			}
+
+			if (bulletsOutput != nullptr)
+			{
+				bulletsOutput[visibleBulletsCount] = { location, bullet.definition.velocity };
+			}
+
+			++visibleBulletsCount;
+		}
+	}
+
+	const BulletManager& manager;
+
+	std::pair<int, int> wallsInterval;
+
+	std::pair<int, int> bulletsInterval;
+
+	Vector2 viewMin;
+
+	Vector2 viewMax;
+
+	GraphicsState::Wall* wallsOutput;
+
+	GraphicsState::Bullet* bulletsOutput;
+
+	int visibleWallsCount = 0;
+
+	int visibleBulletsCount = 0;
+};
+
+struct BulletManager::BulletDeltaStage
+{
+	BulletDeltaStage(const BulletManager& manager, std::pair<int, int> bulletsInterval, const std::vector<unsigned int>& sortedReflectedBulletIds) :
+		manager(manager), bulletsInterval(bulletsInterval), sortedReflectedBulletIds(sortedReflectedBulletIds)
+	{
+	}
+
+	void DoWork()
+	{
+		for (int bulletIndex = bulletsInterval.first; bulletIndex < bulletsInterval.second; ++bulletIndex)
+		{
+			const Bullet& bullet = manager.bullets[bulletIndex];
+
+			const bool bIsVisible = IsBulletVisible(bullet.definition, manager.currentTime);
+
+			const GraphicsStateDelta::Bullet bulletChange{ bullet.id, EvaluateBulletLocation(bullet.definition, manager.currentTime), bullet.definition.velocity };
+
+			if (std::binary_search(sortedReflectedBulletIds.begin(), sortedReflectedBulletIds.end(), bullet.id))
+			{
+				// the definition has changed, so there's no telling whether the bullet was reported before
+				if (bIsVisible)
+				{
+					reflectedBullets.push_back(bulletChange);
+				}
+				else
+				{
+					expiredBulletIds.push_back(bullet.id);
+				}
+
+				continue;
+			}
+
+			const bool bWasVisible = bullet.id < manager.lastDeltaBulletId && IsBulletVisible(bullet.definition, manager.lastDeltaTime);
+
+			if (bIsVisible && !bWasVisible)
+			{
+				spawnedBullets.push_back(bulletChange);
+			}
+			else if (!bIsVisible && bWasVisible)
+			{
+				expiredBulletIds.push_back(bullet.id);
+			}
+		}
+	}
+
+	const BulletManager& manager;
+
+	std::pair<int, int> bulletsInterval;
+
+	const std::vector<unsigned int>& sortedReflectedBulletIds;
+
+	std::vector<GraphicsStateDelta::Bullet> spawnedBullets;
+
+	std::vector<GraphicsStateDelta::Bullet> reflectedBullets;
+
+	std::vector<unsigned int> expiredBulletIds;
+};
+
+int BulletManager::GetStateStagesCount(size_t elementsCount) const
+{
+	// below this the threads cost more than they save
+	constexpr size_t minimalElementsPerStage = 16 * 1024;
+
+	return static_cast<int>(std::min<size_t>(threadsToUse, elementsCount / minimalElementsPerStage + 1));
+}
+
+template <class GetOutputs>
+bool BulletManager::FillVisibleStateInto(bool bFillWalls, bool bFillBullets, const Vector2& viewMin, const Vector2& viewMax, const GetOutputs& getOutputs) const
+{
+	const std::vector<Wall> noWalls;
+	const std::vector<Bullet> noBullets;
+
+	const std::vector<Wall>& wallsToFill = bFillWalls ? walls : noWalls;
+	const std::vector<Bullet>& bulletsToFill = bFillBullets ? bullets : noBullets;
+
+	const int stagesCount = GetStateStagesCount(wallsToFill.size() + bulletsToFill.size());
+
+	const auto runStages = [this, stagesCount](std::function<GenerateStateStage(int)> allocator)
+	{
+		return RunStage<GenerateStateStage>(allocator, stagesCount, stagesCount > 1 ? GetThreadPool() : nullptr);
+	};
+
+	// count first, so that every stage knows where its part of the output starts
+	const std::vector<GenerateStateStage> countStages = runStages([&](int stageIndex)
+	{
+		return GenerateStateStage(*this, GetInterval(wallsToFill, stagesCount, stageIndex), GetInterval(bulletsToFill, stagesCount, stageIndex), viewMin, viewMax, nullptr, nullptr);
+	});
+
+	std::vector<int> wallOffsets(stagesCount + 1, 0);
+	std::vector<int> bulletOffsets(stagesCount + 1, 0);
+
+	for (int stageIndex = 0; stageIndex < stagesCount; ++stageIndex)
+	{
+		wallOffsets[stageIndex + 1] = wallOffsets[stageIndex] + countStages[stageIndex].visibleWallsCount;
+		bulletOffsets[stageIndex + 1] = bulletOffsets[stageIndex] + countStages[stageIndex].visibleBulletsCount;
+	}
+
+	GraphicsState::Wall* wallsOutput = nullptr;
+	GraphicsState::Bullet* bulletsOutput = nullptr;
+
+	if (!getOutputs(wallOffsets[stagesCount], bulletOffsets[stagesCount], wallsOutput, bulletsOutput))
+	{
+		return false;
+	}
+
+	runStages([&](int stageIndex)
+	{
+		return GenerateStateStage(*this, GetInterval(wallsToFill, stagesCount, stageIndex), GetInterval(bulletsToFill, stagesCount, stageIndex), viewMin, viewMax, wallsOutput + wallOffsets[stageIndex], bulletsOutput + bulletOffsets[stageIndex]);
+	});
+
+	return true;
+}
+
+void BulletManager::FillVisibleState(GraphicsState& outGraphicsState, bool bFillWalls, bool bFillBullets, const Vector2& viewMin, const Vector2& viewMax) const
+{
+	FillVisibleStateInto(bFillWalls, bFillBullets, viewMin, viewMax, [&outGraphicsState, bFillWalls, bFillBullets](size_t wallsCount, size_t bulletsCount, GraphicsState::Wall*& outWalls, GraphicsState::Bullet*& outBullets)
+	{
+		if (bFillWalls)
+		{
+			outGraphicsState.walls.resize(wallsCount);
+		}
+
+		if (bFillBullets)
+		{
+			outGraphicsState.bullets.resize(bulletsCount);
+		}
+
+		outWalls = outGraphicsState.walls.data();
+		outBullets = outGraphicsState.bullets.data();
+
+		return true;
+	});
+}
+
+void BulletManager::FillDestroyedWalls(GraphicsState& outGraphicsState, const Vector2& viewMin, const Vector2& viewMax) const
+{
+	outGraphicsState.destroyedWalls.clear();
+
+	for (const WallDefinition& destroyedWall : lastDestroyedWalls)
+	{
+		if (IsWallInView(destroyedWall, viewMin, viewMax))
+		{
+			outGraphicsState.destroyedWalls.push_back({ destroyedWall.start, destroyedWall.end });
+		}
+	}
+
+	outGraphicsState.wallsRevision = wallsRevision;
+}
+
+void BulletManager::GenerateState(GraphicsState& outGraphicsState) const
+{
+	FillVisibleState(outGraphicsState, true, true, worldMin, worldMax);
+
+	FillDestroyedWalls(outGraphicsState, worldMin, worldMax);
+}
+
+void BulletManager::GenerateState(GraphicsState& outGraphicsState, const Vector2& viewMin, const Vector2& viewMax) const
+{
+	if (!wallGrid || !wallGrid->IsBuilt())
+	{
+		FillVisibleState(outGraphicsState, true, true, viewMin, viewMax);
+
+		FillDestroyedWalls(outGraphicsState, viewMin, viewMax);
+
+		return;
+	}
+
+	// bullets move every step and have no index of their own, so they are still scanned
+	FillVisibleState(outGraphicsState, false, true, viewMin, viewMax);
+
+	visibleWallIndices.clear();
+
+	wallGrid->GetWallsOverlappingBox(viewMin, viewMax, 0, static_cast<int>(walls.size()), visibleWallIndices);
+
+	// the grid gives the walls cell by cell; keeping the index order keeps connected walls together for the renderer
+	std::sort(visibleWallIndices.begin(), visibleWallIndices.end());
+
+	outGraphicsState.walls.clear();
+
+	for (const int wallIndex : visibleWallIndices)
+	{
+		const Wall& wall = walls[wallIndex];
+
+		if (wall.timeDestroyed < 0 && IsWallInView(wall.definition, viewMin, viewMax))
+		{
+			outGraphicsState.walls.push_back({ wall.definition.start, wall.definition.end });
+		}
+	}
+
+	FillDestroyedWalls(outGraphicsState, viewMin, viewMax);
+}
+
+void BulletManager::GenerateStateDelta(GraphicsStateDelta& outDelta)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	outDelta.time = currentTime;
+
+	outDelta.spawnedBullets.clear();
+	outDelta.reflectedBullets.clear();
+	outDelta.destroyedWalls.clear();
+
+	outDelta.expiredBulletIds.swap(pendingExpiredBulletIds);
+	pendingExpiredBulletIds.clear();
+
+	outDelta.bWereWallsReplaced = !bIsTrackingStateDelta || lastDeltaWallsRevision != wallsRevision;
+
+	if (outDelta.bWereWallsReplaced)
+	{
+		// reuse the buffer of the delta
+		GraphicsState wallsState;
+
+		wallsState.walls.swap(outDelta.walls);
+
+		FillVisibleState(wallsState, true, false, worldMin, worldMax);
+
+		outDelta.walls.swap(wallsState.walls);
+	}
+	else
+	{
+		outDelta.walls.clear();
+
+		for (const WallDefinition& destroyedWall : pendingDestroyedWalls)
+		{
+			outDelta.destroyedWalls.push_back({ destroyedWall.start, destroyedWall.end });
+		}
+	}
+
+	std::sort(pendingReflectedBulletIds.begin(), pendingReflectedBulletIds.end());
+
+	const int stagesCount = GetStateStagesCount(bullets.size());
+
+	const std::function<BulletDeltaStage(int)> allocator = [this, stagesCount](int stageIndex)
+	{
+		return BulletDeltaStage(*this, GetInterval(bullets, stagesCount, stageIndex), pendingReflectedBulletIds);
+	};
+
+	const std::vector<BulletDeltaStage> deltaStages = RunStage<BulletDeltaStage>(allocator, stagesCount, stagesCount > 1 ? GetThreadPool() : nullptr);
+
+	for (const BulletDeltaStage& stage : deltaStages)
+	{
+		outDelta.spawnedBullets.insert(outDelta.spawnedBullets.end(), stage.spawnedBullets.begin(), stage.spawnedBullets.end());
+		outDelta.reflectedBullets.insert(outDelta.reflectedBullets.end(), stage.reflectedBullets.begin(), stage.reflectedBullets.end());
+		outDelta.expiredBulletIds.insert(outDelta.expiredBulletIds.end(), stage.expiredBulletIds.begin(), stage.expiredBulletIds.end());
+	}
+
+	pendingDestroyedWalls.clear();
+	pendingReflectedBulletIds.clear();
+
+	bIsTrackingStateDelta = true;
+	lastDeltaTime = currentTime;
+	lastDeltaBulletId = nextBulletId;
+	lastDeltaWallsRevision = wallsRevision;
+}
+
+void BulletManager::Update(const float deltaTime)
+{
+	const float time = currentTime + deltaTime;
+
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	lastDestroyedWalls.clear();
+
+	BeginRewindStep();
+
+	if (commandRing != nullptr)
+	{
+		DrainCommandRing();
+	}
+
+	if (bulletSchedule)
+	{
+		RemoveExpiredBullets();
+
+		PullScheduledBullets(time + scheduleLookAhead);
+	}
+
+	// after every addition, so that the tiles the new bullets can reach are in memory for this step
+	if (wallTileStore)
+	{
+		PageWallTiles(time + tileLookAhead);
+	}
+
+	EnsureWallGrid();
+
+	// after the additions and removals of the step, which the recorder keeps in the order they were made
+	if (flightRecorder != nullptr)
+	{
+		flightRecorder->RecordUpdate(deltaTime);
+	}
+
+	SimulateHorizon(time);
+
+	if (statePublisher != nullptr)
+	{
+		PublishState();
+	}
+}
+
+void BulletManager::PublishState()
+{
+	// the stages write straight into the shared slot
+	const bool bWasPublished = FillVisibleStateInto(true, true, worldMin, worldMax, [this](size_t wallsCount, size_t bulletsCount, GraphicsState::Wall*& outWalls, GraphicsState::Bullet*& outBullets)
+	{
+		return statePublisher->BeginPublish(wallsCount, bulletsCount, outWalls, outBullets);
+	});
+
+	if (bWasPublished)
+	{
+		statePublisher->EndPublish(currentTime, wallsRevision);
+	}
+}
+
+void BulletManager::Solve(std::vector<WallDestruction>& outDestructionLog)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	const size_t firstLogEntry = outDestructionLog.size();
+
+	std::vector<WallDestruction>* const updateDestructionLog = destructionLog;
+
+	destructionLog = &outDestructionLog;
+
+	while (true)
+	{
+		lastDestroyedWalls.clear();
+
+		BeginRewindStep();
+
+		// expired bullets would only be skipped over in every following step
+		RemoveExpiredBullets();
+
+		EnsureWallGrid();
+
+		const float horizonTime = currentTime + GetSolveHorizon();
+
+		if (bulletSchedule)
+		{
+			PullScheduledBullets(horizonTime);
+		}
+
+		if (bullets.empty() && (!bulletSchedule || bulletSchedule->IsFinished()))
+		{
+			break;
+		}
+
+		if (wallTileStore)
+		{
+			PageWallTiles(horizonTime + tileLookAhead);
+
+			EnsureWallGrid();
+		}
+
+		SimulateUntil(horizonTime);
+	}
+
+	destructionLog = updateDestructionLog;
+
+	std::stable_sort(outDestructionLog.begin() + firstLogEntry, outDestructionLog.end(), [](const WallDestruction& first, const WallDestruction& second)
+	{
+		return first.time < second.time;
+	});
+}
+
+void BulletManager::SetWorldRegions(int inRegionsCount)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	worldRegionsCount = std::max(0, inRegionsCount);
+
+	worldRegions.reset();
+}
+
+void BulletManager::SetWallBoxTest(bool bInIsTestingWallBoxes)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	bIsTestingWallBoxes = bInIsTestingWallBoxes;
+}
+
+void BulletManager::SetCollisionCells(float inCollisionCellSize)
+{
+	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+
+	collisionCellSize = std::fmax(0.0f, inCollisionCellSize);
+
+	// the region copies of the walls aren't kept destroyed meanwhile, they are built again if the regions come back
+	worldRegions.reset();
+}
+
+void BulletManager::BeginWorldRegionsStep(float time)
+{
+	ThreadPool* const pool = GetThreadPool();
+
+	if (!worldRegions || worldRegionsWallsRevision != wallsRevision)
+	{
+		worldRegions = std::make_unique<WorldRegions>();
+
+		worldRegions->Build(walls, *wallGrid, worldRegionsCount, pool);
+
+		worldRegionsWallsRevision = wallsRevision;
+	}
+
+	worldRegions->BeginStep(bullets, nextBulletId, currentTime, time, pool);
+}
+
+float BulletManager::GetSolveHorizon() const
+{
+	float maxSpeed = 0;
+
+	float lastEndTime = currentTime;
+
+	for (const Bullet& bullet : bullets)
+	{
+		maxSpeed = std::fmax(maxSpeed, bullet.definition.velocity.GetMagnitude());
 
-		const std::vector<BulletHitData>& bulletsVsWall,
+		lastEndTime = std::fmax(lastEndTime, bullet.definition.startTime + bullet.definition.lifetime);
+	}
 
-		std::vector<Bullet>& bullets,
+	// don't let a tiny grid or a very fast bullet turn the solve into millions of steps
+	constexpr float minimalHorizon = 0.001f;
 
-		std::vector<Wall>& walls):startBulletIndex(startBulletIndex), endBulletIndex(endBulletIndex), bulletsVsWall(bulletsVsWall), bullets(bullets), walls(walls)
-		{
-		}
+	const float remainingTime = std::fmax(lastEndTime - currentTime, minimalHorizon);
 
-		int startBulletIndex;
-		int endBulletIndex;
+	if (maxSpeed <= 0)
+	{
+		return remainingTime;
+	}
 
-		const std::vector<BulletHitData>& bulletsVsWall;
+	// the rounds within a step are approximate, longer steps drift further from frame-sized ones
+	constexpr float cellFractionPerStep = 0.25f;
 
-		std::vector<Bullet>& bullets;
+	return std::fmin(remainingTime, std::fmax(minimalHorizon, cellFractionPerStep * wallGrid->GetCellSize() / maxSpeed));
+}
 
-		std::vector<Wall>& walls;
-	};
+void BulletManager::SimulateHorizon(const float time)
+{
+	const float startTime = currentTime;
 
-	ApplyBulletStage(const Setup& setup) : setup(setup)
+	const float sliceHorizon = GetSliceHorizon();
+
+	// most frames fit into one slice and run just like before
+	const int slicesCount = std::max(1, static_cast<int>(std::ceil((time - startTime) / sliceHorizon)));
+
+	for (int sliceIndex = 1; sliceIndex < slicesCount; ++sliceIndex)
 	{
+		SimulateUntil(startTime + ((time - startTime) * sliceIndex) / slicesCount);
+	}
 
+	SimulateUntil(time);
+}
+
+float BulletManager::GetSliceHorizon() const
+{
+	if (bullets.empty() || walls.empty())
+	{
+		return std::numeric_limits<float>::max();
 	}
 
-	void DoWork()
+	// the fastest bullet sets the slice, so that no sweep covers more cells than planned; the ones that ended don't fly any more
+	float maxSpeed = 0;
+
+	for (const Bullet& bullet : bullets)
 	{
-		for (int bulletIndex = setup.startBulletIndex; bulletIndex < setup.endBulletIndex; ++bulletIndex)
+		if (bullet.definition.startTime + bullet.definition.lifetime > currentTime)
 		{
-			const BulletHitData& bulletData = setup.bulletsVsWall[bulletIndex];
-
-			if (bulletData.wallIndex < 0)
-			{
-				continue;
-			}
+			maxSpeed = std::fmax(maxSpeed, bullet.definition.velocity.GetMagnitude());
+		}
+	}
 
-			Wall& wall = setup.walls[bulletData.wallIndex];
+	if (maxSpeed <= 0)
+	{
+		return std::numeric_limits<float>::max();
+	}
 
-			wall.timeDestroyed = bulletData.time;
+	Vector2 gridMin;
+	Vector2 gridMax;
 
-			Bullet& bullet = setup.bullets[bulletIndex];
+	wallGrid->GetBounds(gridMin, gridMax);
 
-			bullet.definition.startingPosition = EvaluateBulletLocation(bullet.definition, bulletData.time);
+	const float cellSize = wallGrid->GetCellSize();
 
-			const float timePassedSinceBulletStart = bulletData.time - bullet.definition.startTime;
+	const float cellsCount = std::fmax(1.0f, ((gridMax.X - gridMin.X) / cellSize) * ((gridMax.Y - gridMin.Y) / cellSize));
 
-			bullet.definition.lifetime -= timePassedSinceBulletStart;
+	const float wallsPerCell = std::fmax(walls.size() / cellsCount, 1e-3f);
 
-			bullet.definition.startTime = bulletData.time;
+	// a sweep crossing n cells along one axis covers about (1 + n)^2 cells of walls
+	constexpr float candidateWallsPerBullet = 16;
 
-			const Vector2 normal = wall.definition.change.GetNormal().Normalized();
+	constexpr float minimalCellsPerSlice = 0.25f;
 
-			const Vector2 reflectedVelocity = bullet.definition.velocity - normal * (2 * Vector2::DotProduct(bullet.definition.velocity, normal));
+	const float cellsPerSlice = std::fmax(minimalCellsPerSlice, std::sqrt(candidateWallsPerBullet / wallsPerCell) - 1);
 
-			bullet.definition.velocity = reflectedVelocity;
-		}
-	}
+	// the same floor Solve uses, so that a tiny grid doesn't turn a frame into thousands of slices
+	constexpr float minimalHorizon = 0.001f;
 
-	Setup setup;
-};
+	return std::fmax(minimalHorizon, cellsPerSlice * cellSize / maxSpeed);
+}
 
-template <class TContainer>
-std::pair<int, int> GetInterval(const TContainer& container, int totalParts, int partIndex)
+void BulletManager::SimulateUntil(const float time)
 {
-	const int containerSize = static_cast<int>(container.size());
+	ThreadPool* const pool = GetThreadPool();
 
-	return std::make_pair((containerSize * partIndex) / totalParts, (containerSize * (partIndex + 1)) / totalParts);
-}
+	//std::vector<std::thread> workerThreads(threadsToUse);
 
-void BulletManager::Update(const float deltaTime)
-{
-	const float time = currentTime + deltaTime;
+	std::vector<WallDestructionData>& wallVsBullets = simulationBuffers->wallVsBullets;
 
-	ThreadPool& pool = *threadPool;
+	std::vector<BulletHitData>& bulletsVsWall = simulationBuffers->bulletsVsWall;
 
-	//std::vector<std::thread> workerThreads(threadsToUse);
+	if (collisionCellSize > 0)
+	{
+		SimulateCollisionCellsUntil(time);
+		return;
+	}
 
-	std::unique_lock<std::mutex> bulletsLock(bulletAdditionMutex);
+	if (worldRegionsCount > 0)
+	{
+		BeginWorldRegionsStep(time);
+	}
 
 	while (true)
 	{
-		std::vector<WallDestructionData> wallVsBullets(walls.size());
+		wallVsBullets.assign(walls.size(), WallDestructionData());
 
-		std::vector<BulletHitData> bulletsVsWall(bullets.size());
+		bulletsVsWall.assign(bullets.size(), BulletHitData());
 
 		bool bWereAnyCollisionHitsFound = false;
 
-		const int filterStagesCount = threadsToUse;
+		const int filterStagesCount = worldRegions ? worldRegionsCount : threadsToUse;
 
 		auto filterStages = RunStage<FilterStage>([this, filterStagesCount, time](int filterStageIndex) {
+			if (worldRegions)
+			{
+				const WorldRegions::Region& region = worldRegions->GetRegion(filterStageIndex);
+
+				return FilterStage(FilterStage::Setup(0, static_cast<int>(region.walls.size()), currentTime, time, region.walls, bullets, region.wallGrid, bIsTestingWallBoxes, &region.bulletIndices, &region.wallIndices));
+			}
+
 			const auto interval = GetInterval(walls, filterStagesCount, filterStageIndex);
 
 			const int startingWallIndex = interval.first;
 
 			const int endWallIndex = interval.second;
 
-			return FilterStage(FilterStage::Setup(startingWallIndex, endWallIndex, currentTime, time, walls, bullets)); }
+			return FilterStage(FilterStage::Setup(startingWallIndex, endWallIndex, currentTime, time, walls, bullets, *wallGrid, bIsTestingWallBoxes)); }
 			, filterStagesCount, pool);
 
 		for (const auto& parallelStage : filterStages)
@@ -270,20 +2360,20 @@ void BulletManager::Update(const float deltaTime)
 			const FilterStage& stage = parallelStage;
 
 			bWereAnyCollisionHitsFound |= stage.bWereAnyCollisionHitsFound;
+
+			broadPhaseStats.Add(stage.broadPhaseStats);
+
 			for (int calculatedWallIndex = 0; calculatedWallIndex < stage.calculatedWalls.size(); ++calculatedWallIndex)
 			{
-				const int actualWallIndex = calculatedWallIndex + stage.setup.startWallIndex;
+				const int actualWallIndex = stage.setup.wallIndices != nullptr ? (*stage.setup.wallIndices)[calculatedWallIndex] : calculatedWallIndex + stage.setup.startWallIndex;
 
 				const WallDestructionData& calculatedData = stage.calculatedWalls[calculatedWallIndex];
 
 				WallDestructionData& data = wallVsBullets[actualWallIndex];
 
-				if (calculatedData.time < data.time)
+				if (calculatedData.bulletIndex >= 0 && IsEarlierHit(calculatedData.time, calculatedData.bulletIndex, data.time, data.bulletIndex))
 				{
-					if (calculatedData.bulletIndex > data.bulletIndex)
-					{
-						data = calculatedData;
-					}
+					data = calculatedData;
 				}
 			}
 		}
@@ -304,22 +2394,274 @@ void BulletManager::Update(const float deltaTime)
 
 			BulletHitData& bulletData = bulletsVsWall[data.bulletIndex];
 
-			if (data.time < bulletData.time)
+			if (IsEarlierHit(data.time, wallIndex, bulletData.time, bulletData.wallIndex))
 			{
 				bulletData.time = data.time;
 				bulletData.wallIndex = wallIndex;
 			}
 		}
 
+		for (int bulletIndex = 0; bulletIndex < static_cast<int>(bulletsVsWall.size()); ++bulletIndex)
+		{
+			const BulletHitData& bulletData = bulletsVsWall[bulletIndex];
+
+			if (bulletData.wallIndex < 0)
+			{
+				continue;
+			}
+
+			lastDestroyedWalls.push_back(walls[bulletData.wallIndex].definition);
+
+			if (worldRegions)
+			{
+				worldRegions->MarkWallDestroyed(bulletData.wallIndex, bulletData.time);
+			}
+
+			if (destructionLog != nullptr)
+			{
+				destructionLog->push_back({ bulletData.wallIndex, bulletData.time, bullets[bulletIndex].id });
+			}
+
+			if (!rewindSteps.empty())
+			{
+				rewindJournal.push_back({ bullets[bulletIndex], bulletData.wallIndex, bulletData.time });
+
+				++rewindSteps.back().entriesCount;
+			}
+
+			if (bIsTrackingStateDelta)
+			{
+				pendingDestroyedWalls.push_back(walls[bulletData.wallIndex].definition);
+
+				pendingReflectedBulletIds.push_back(bullets[bulletIndex].id);
+			}
+		}
+
 		const int applyBulletsStagesCount = threadsToUse;
 
 		auto bulletStage = RunStage<ApplyBulletStage>([this, applyBulletsStagesCount, &bulletsVsWall](int stageIndex)->ApplyBulletStage {
 
 			const auto interval = GetInterval(bullets, applyBulletsStagesCount, stageIndex);
 
-			ApplyBulletStage Stage(ApplyBulletStage::Setup(interval.first, interval.second, bulletsVsWall, bullets, walls));
+			ApplyBulletStage Stage(ApplyBulletStage::Setup(interval.first, interval.second, bulletsVsWall, bullets, walls, bIsTrackingStateHash, bIsRecordingTrajectories ? &bulletTrajectories : nullptr));
 			return Stage;
 			}, applyBulletsStagesCount, pool);
+
+		for (const ApplyBulletStage& stage : bulletStage)
+		{
+			stateHash ^= stage.stateHashChange;
+		}
+
+		if (eventTrace != nullptr)
+		{
+			for (int bulletIndex = 0; bulletIndex < static_cast<int>(bulletsVsWall.size()); ++bulletIndex)
+			{
+				const BulletHitData& bulletData = bulletsVsWall[bulletIndex];
+
+				if (bulletData.wallIndex < 0)
+				{
+					continue;
+				}
+
+				const Bullet& bullet = bullets[bulletIndex];
+
+				eventTrace->RecordWallDestruction(bulletData.wallIndex, bulletData.time);
+
+				eventTrace->RecordReflection(bullet.id, bulletData.time, bullet.definition.startingPosition, bullet.definition.velocity);
+			}
+		}
+	}
+
+	currentTime = time;
+}
+
+void BulletManager::SimulateCollisionCellsUntil(const float time)
+{
+	ThreadPool* const pool = GetThreadPool();
+
+	SimulationBuffers& islands = *simulationBuffers;
+
+	// reflections keep the speed, so this holds for the whole step
+	float maxSpeed = 0;
+
+	for (const Bullet& bullet : bullets)
+	{
+		maxSpeed = std::fmax(maxSpeed, bullet.definition.velocity.GetMagnitude());
+	}
+
+	// the entries are put back to -1 after every window
+	islands.wallFirstBullets.resize(walls.size(), -1);
+
+	std::vector<int>& parents = islands.islandParents;
+
+	const auto findRoot = [&parents](int bulletIndex)
+	{
+		while (parents[bulletIndex] != bulletIndex)
+		{
+			parents[bulletIndex] = parents[parents[bulletIndex]];
+			bulletIndex = parents[bulletIndex];
+		}
+
+		return bulletIndex;
+	};
+
+	while (currentTime < time)
+	{
+		// the lookahead within which no bullet gets further than one cell from where it starts the window
+		float windowEndTime = maxSpeed > 0 ? std::fmin(time, currentTime + collisionCellSize / maxSpeed) : time;
+
+		if (!(windowEndTime > currentTime))
+		{
+			windowEndTime = time;
+		}
+
+		const float windowStartTime = currentTime;
+
+		const int reachStagesCount = threadsToUse;
+
+		const auto reachStages = RunStage<CollisionReachStage>([this, reachStagesCount, windowStartTime, windowEndTime](int stageIndex)
+		{
+			const auto interval = GetInterval(bullets, reachStagesCount, stageIndex);
+
+			return CollisionReachStage(interval.first, interval.second, windowStartTime, windowEndTime, walls, bullets, *wallGrid);
+		}, reachStagesCount, pool);
+
+		// bullets that can reach the same standing wall join one island, whose root is its lowest bullet index
+		parents.assign(bullets.size(), -1);
+
+		for (const CollisionReachStage& stage : reachStages)
+		{
+			for (size_t reachBullet = 0; reachBullet < stage.reachBulletIndices.size(); ++reachBullet)
+			{
+				const int bulletIndex = stage.reachBulletIndices[reachBullet];
+
+				parents[bulletIndex] = bulletIndex;
+
+				for (int reachWall = stage.reachStarts[reachBullet]; reachWall < stage.reachStarts[reachBullet + 1]; ++reachWall)
+				{
+					int& firstBullet = islands.wallFirstBullets[stage.reachWalls[reachWall]];
+
+					if (firstBullet < 0)
+					{
+						firstBullet = bulletIndex;
+
+						islands.touchedWalls.push_back(stage.reachWalls[reachWall]);
+
+						continue;
+					}
+
+					const int firstRoot = findRoot(firstBullet);
+					const int bulletRoot = findRoot(bulletIndex);
+
+					parents[std::max(firstRoot, bulletRoot)] = std::min(firstRoot, bulletRoot);
+				}
+			}
+		}
+
+		for (const int wallIndex : islands.touchedWalls)
+		{
+			islands.wallFirstBullets[wallIndex] = -1;
+		}
+
+		islands.touchedWalls.clear();
+
+		// going up the bullet indices meets every root before the rest of its island
+		islands.bulletIslands.assign(bullets.size(), -1);
+
+		islands.islandStarts.assign(1, 0);
+
+		for (int bulletIndex = 0; bulletIndex < static_cast<int>(bullets.size()); ++bulletIndex)
+		{
+			if (parents[bulletIndex] < 0)
+			{
+				continue;
+			}
+
+			const int root = findRoot(bulletIndex);
+
+			if (root == bulletIndex)
+			{
+				islands.bulletIslands[bulletIndex] = static_cast<int>(islands.islandStarts.size()) - 1;
+
+				islands.islandStarts.push_back(0);
+			}
+
+			islands.bulletIslands[bulletIndex] = islands.bulletIslands[root];
+
+			++islands.islandStarts[islands.bulletIslands[bulletIndex] + 1];
+		}
+
+		const int islandsCount = static_cast<int>(islands.islandStarts.size()) - 1;
+
+		for (int island = 0; island < islandsCount; ++island)
+		{
+			islands.islandStarts[island + 1] += islands.islandStarts[island];
+		}
+
+		islands.islandBullets.resize(islands.islandStarts.back());
+
+		islands.islandFillPositions.assign(islands.islandStarts.begin(), islands.islandStarts.end() - 1);
+
+		for (int bulletIndex = 0; bulletIndex < static_cast<int>(bullets.size()); ++bulletIndex)
+		{
+			if (islands.bulletIslands[bulletIndex] >= 0)
+			{
+				islands.islandBullets[islands.islandFillPositions[islands.bulletIslands[bulletIndex]]++] = bulletIndex;
+			}
+		}
+
+		const int islandStagesCount = std::max(1, std::min(threadsToUse, islandsCount));
+
+		const auto islandStages = RunStage<CollisionIslandStage>([this, &islands, islandsCount, islandStagesCount, windowStartTime, windowEndTime](int stageIndex)
+		{
+			const int startIsland = (islandsCount * stageIndex) / islandStagesCount;
+			const int endIsland = (islandsCount * (stageIndex + 1)) / islandStagesCount;
+
+			return CollisionIslandStage(CollisionIslandStage::Setup(startIsland, endIsland, windowStartTime, windowEndTime, walls, bullets, *wallGrid, islands, bIsTrackingStateHash, bIsRecordingTrajectories ? &bulletTrajectories : nullptr));
+		}, islandStagesCount, pool);
+
+		// the stages hold consecutive islands, so the hits come out in the same order whatever the stage count
+		for (const CollisionIslandStage& stage : islandStages)
+		{
+			stateHash ^= stage.stateHashChange;
+
+			broadPhaseStats.Add(stage.broadPhaseStats);
+
+			for (const CollisionIslandHit& hit : stage.hits)
+			{
+				const WallDefinition& wall = walls[hit.wallIndex].definition;
+
+				lastDestroyedWalls.push_back(wall);
+
+				if (destructionLog != nullptr)
+				{
+					destructionLog->push_back({ hit.wallIndex, hit.time, hit.bullet.id });
+				}
+
+				if (!rewindSteps.empty())
+				{
+					rewindJournal.push_back({ hit.bullet, hit.wallIndex, hit.time });
+
+					++rewindSteps.back().entriesCount;
+				}
+
+				if (bIsTrackingStateDelta)
+				{
+					pendingDestroyedWalls.push_back(wall);
+
+					pendingReflectedBulletIds.push_back(hit.bullet.id);
+				}
+
+				if (eventTrace != nullptr)
+				{
+					eventTrace->RecordWallDestruction(hit.wallIndex, hit.time);
+
+					eventTrace->RecordReflection(hit.bullet.id, hit.time, hit.reflected.startingPosition, hit.reflected.velocity);
+				}
+			}
+		}
+
+		currentTime = windowEndTime;
 	}
 
 	currentTime = time;
@@ -345,7 +2687,10 @@ bool BulletManager::TryGetTimeDestroyed(WallDefinition wall, BulletDefinition bu
 	}
 	else
 	{
-		const float numerator = wall.change.X * bullet.startingPosition.Y - wall.change.Y * bullet.startingPosition.X + wall.freeTerm;
+		// taken relative to the bullet: the same as wall.freeTerm minus the bullet's term, without the products of large coordinates cancelling
+		const Vector2 fromBulletToWall = wall.start - bullet.startingPosition;
+
+		const float numerator = fromBulletToWall.X * wall.change.Y - fromBulletToWall.Y * wall.change.X;
 
 		collisionTime = numerator / denominator;
 
@@ -424,78 +2769,57 @@ bool BulletManager::TryGetCollinearBulletCollisionTime(WallDefinition wall, Bull
 	return true;
 }
 
-bool BulletManager::CanCollide(const Wall& wall, const Bullet& bullet, float startingTime, float targetTime)
+bool BulletManager::TryGetCollisionPoint(WallDefinition wall, BulletDefinition bullet, Vector2& outCollisionPoint)
 {
-	if (wall.timeDestroyed >= 0)
-	{
-		return false;
-	}
-
-	if (targetTime < bullet.definition.startTime)
-	{
-		return false;
-	}
-
-	if (bullet.definition.startTime + bullet.definition.lifetime < startingTime)
-	{
-		return false;
-	}
-
-	const Vector2 bulletStartingLocation = EvaluateBulletLocation(bullet.definition, startingTime);
-	
-	const Vector2 fromWallToBullet = wall.definition.start - bulletStartingLocation;
-
-	const float bulletMovementTime = targetTime - startingTime;
-
-	const Vector2 maxMovedPosition = EvaluateBulletLocation(bullet.definition, targetTime);
-
-	const float bulletTravelDistanceSquare = (maxMovedPosition - bulletStartingLocation).GetSquareMagnitude();
+	float collisionTime;
 
-	if (fromWallToBullet.GetSquareMagnitude() < bulletTravelDistanceSquare)
+	if (TryGetTimeDestroyed(wall, bullet, collisionTime))
 	{
+		outCollisionPoint = EvaluateBulletLocation(bullet, collisionTime);
 		return true;
 	}
 
-	const auto wallChange = wall.definition.change;
-
-	const auto wallChangeNormalized = wallChange.Normalized();
-
-	const Vector2 boundingSquareSide = wallChangeNormalized * bulletTravelDistanceSquare;
-
-
-	const float equationA = Vector2::DotProduct(wallChange, wallChange);
-
-	const float equationB = 2 * Vector2::DotProduct(wallChange, fromWallToBullet);
+	return false;
+}
 
-	const float equationC = Vector2::DotProduct(fromWallToBullet, fromWallToBullet) - bulletTravelDistanceSquare;
+bool BulletManager::IsBulletVisible(const BulletDefinition& bullet, float time)
+{
+	return bullet.startTime < time && time < (bullet.startTime + bullet.lifetime);
+}
 
-	const float discriminant = equationB * equationB - 4 * equationA * equationC;
+bool BulletManager::TryGetBulletSweepBounds(const BulletDefinition& bullet, float startTime, float endTime, Vector2& outMin, Vector2& outMax)
+{
+	const float bulletEndTime = bullet.startTime + bullet.lifetime;
 
-	if (discriminant < 0)
+	if (endTime < bullet.startTime || bulletEndTime < startTime)
 	{
 		return false;
 	}
 
-	const float discriminantRoot = std::sqrtf(discriminant);
+	const Vector2 sweepStart = EvaluateBulletLocation(bullet, startTime);
+	const Vector2 sweepEnd = EvaluateBulletLocation(bullet, std::fmin(endTime, bulletEndTime));
 
-	const float t1 = (-equationB - discriminantRoot) / (2 * equationA);
-	const float t2 = (-equationB + discriminantRoot) / (2 * equationA);
+	constexpr float sweepPadding = 0.01f;
 
-	return t1 <= 1 && t2 >= 0;
-}
+	outMin = Vector2{ std::fmin(sweepStart.X, sweepEnd.X) - sweepPadding, std::fmin(sweepStart.Y, sweepEnd.Y) - sweepPadding };
+	outMax = Vector2{ std::fmax(sweepStart.X, sweepEnd.X) + sweepPadding, std::fmax(sweepStart.Y, sweepEnd.Y) + sweepPadding };
 
+	return true;
+}
 
-bool BulletManager::TryGetCollisionPoint(WallDefinition wall, BulletDefinition bullet, Vector2& outCollisionPoint)
+void BulletManager::ReflectBullet(BulletDefinition& bullet, const WallDefinition& wall, float time)
 {
-	float collisionTime;
+	bullet.startingPosition = EvaluateBulletLocation(bullet, time);
 
-	if (TryGetTimeDestroyed(wall, bullet, collisionTime))
-	{
-		outCollisionPoint = EvaluateBulletLocation(bullet, collisionTime);
-		return true;
-	}
+	const float timePassedSinceBulletStart = time - bullet.startTime;
 
-	return false;
+	bullet.lifetime -= timePassedSinceBulletStart;
+
+	bullet.startTime = time;
+
+	const Vector2 normal = wall.change.GetNormal().Normalized();
+
+	bullet.velocity = bullet.velocity - normal * (2 * Vector2::DotProduct(bullet.velocity, normal));
 }
 
 Vector2 BulletManager::EvaluateBulletLocation(BulletDefinition bullet, float time)
@@ -6,6 +6,12 @@
 
 #include <mutex>
 
+#include <memory>
+
+#include <string>
+
+#include <deque>
+
 class BulletManager
 {
 public:
@@ -44,14 +50,183 @@ public:
 
 	BulletManager(const std::vector<WallDefinition>& inWallDefinitions, const std::vector<BulletDefinition>& inBulletDefinitions);
 
+	explicit BulletManager(const struct BulletManagerSnapshot& snapshot);
+
+	// builds the walls straight from packed scenario data, e.g. a mapped binary scenario file
+	explicit BulletManager(const struct ScenarioView& scenario);
+
+	// continues from a checkpoint, with the time and the bullet ids it was taken with
+	explicit BulletManager(const struct CheckpointView& checkpoint);
+
 	~BulletManager();
 
 	void Update(float time);
 
+	struct WallDestruction
+	{
+		int wallIndex;
+
+		float time;
+
+		// bullets given at construction have their index as id
+		unsigned int bulletId;
+	};
+
+	// runs the simulation, independently of frames, until every bullet has expired;
+	// the walls destroyed on the way are appended to the log ordered by time
+	void Solve(std::vector<WallDestruction>& outDestructionLog);
+
 	void AddBullet(const Vector2& position, const Vector2& velocity, float time, float lifetime);
 
+	// removes the bullets located outside the box at the current time and appends them as they are now, e.g. to hand them
+	// to a manager simulating the neighbouring part of the world; bullets whose lifetime has ended are removed without being appended.
+	// The rewind journal is dropped
+	void HandOffBulletsOutside(const Vector2& boxMin, const Vector2& boxMax, std::vector<BulletDefinition>& outBullets);
+
+	// destroys a wall without a bullet, e.g. one another manager simulating a copy of it saw destroyed; false if it already was.
+	// The rewind journal is dropped
+	bool DestroyWall(int wallIndex, float time);
+
+	// Update appends the walls it destroys to the log as well, like Solve does; the log is not owned, nullptr stops it
+	void SetWallDestructionLog(std::vector<WallDestruction>* inDestructionLog);
+
+	// fills the caller's state with everything visible at the current time, reusing its buffers
 	void GenerateState(struct GraphicsState& outGraphicsState) const;
 
+	// only the walls and bullets inside the view box; the walls are looked up in the wall grid, so the cost follows what is visible
+	void GenerateState(struct GraphicsState& outGraphicsState, const Vector2& viewMin, const Vector2& viewMax) const;
+
+	// reports only what changed since the previous call, the first call reports everything;
+	// Update only collects the changes once this has been called
+	void GenerateStateDelta(struct GraphicsStateDelta& outDelta);
+
+	// a snapshot last taken from this manager is brought up to date in place: while the walls revision holds, walls only
+	// get destroyed, so only their destroyed times are compared and the buffers are reused
+	void TakeSnapshot(struct BulletManagerSnapshot& outSnapshot) const;
+
+	// drops the bullets whose lifetime has ended, as Update does while a schedule is set, so that a replay can follow such a run
+	void DropExpiredBullets();
+
+	// writes the walls and bullets as they are now to a checkpoint file, to be read back with OpenCheckpoint.
+	// On POSIX a forked child writes the file from its copy-on-write view of the memory while this process goes on,
+	// and the file only appears under the path once it is complete; elsewhere it is written before returning.
+	// Fails while the previous checkpoint is still being written. The schedule and the tile store are not part of it
+	bool BeginCheckpoint(const std::string& path);
+
+	// reaps a finished checkpoint child without waiting for it
+	bool IsCheckpointInProgress();
+
+	// maps the wall index stored at indexPath if it was built for the current walls,
+	// otherwise builds it and stores it there for the next start; returns true if the stored index was used
+	bool LoadOrBuildWallIndex(const std::string& indexPath);
+
+	// bullets are pulled from the schedule once their start time is within the look-ahead of the next Update,
+	// and bullets whose lifetime has ended are dropped, so memory follows the live set rather than the session length
+	void SetBulletSchedule(std::unique_ptr<class BulletScheduleReader> inBulletSchedule, float inScheduleLookAhead);
+
+	size_t GetBulletsCount() const { return bullets.size(); }
+
+	// replaces the walls with a tiled world on disk: only the tiles that bullets can reach within the look-ahead
+	// of the next Update are kept in memory, the others are evicted with their destroyed walls written back.
+	// Paging keeps the rewind journal, but a rewind can't go back past the step in which it destroyed a wall that was evicted since.
+	// Setting a store drops the journal
+	void SetWallTileStore(std::unique_ptr<class WallTileStore> inWallTileStore, float inTileLookAhead);
+
+	size_t GetWallsCount() const { return walls.size(); }
+
+	// runs the stages on a pool owned by someone else, split into stagesCount parts; with no pool they run on the thread calling Update.
+	// Managers updated from jobs of a pool must not be given that same pool, their waits for stages would block its threads
+	void SetThreadPool(class ThreadPool* inThreadPool, int inStagesCount);
+
+	// splits the world into that many regions, each tested by one stage against the bullets that are in it or can reach its walls,
+	// instead of giving every stage a range of wall indices and all the bullets; 0 goes back to that. The results are the same
+	void SetWorldRegions(int inRegionsCount);
+
+	// splits every step into windows no longer than the fastest bullet needs to cross a cell of that size, which bounds how far
+	// any bullet gets within one. Bullets that can reach the same standing wall in a window join one island; the islands share
+	// no walls, so they run on separate stages, each taking its hits one at a time in the order of their times, with a wall
+	// missing only from the time it was destroyed. The result is exact and the same whatever the cell size and the stage count.
+	// It differs slightly from the global rounds, which apply all the first hits of a round at once. 0 goes back to the rounds,
+	// which also take over from the regions
+	void SetCollisionCells(float inCollisionCellSize);
+
+	// keeps what is needed to undo the collisions and expiries of the last window seconds; 0 drops the journal
+	void SetRewindWindow(float inRewindWindow);
+
+	// undoes every collision and expiry after the time and continues from it, bullets added since are kept;
+	// the Updates that follow simulate the time again. Fails for times outside the journal
+	bool RewindTo(float time);
+
+	// the earliest time RewindTo can go back to
+	float GetEarliestRewindTime() const;
+
+	// a part of a bullet's path between two reflections
+	struct BulletLeg
+	{
+		float startTime;
+
+		Vector2 startingPosition;
+
+		Vector2 velocity;
+	};
+
+	// keeps the legs of every bullet from the moment it is turned on, so that past locations can be looked up;
+	// the legs of expired bullets are kept as well
+	void SetTrajectoryRecording(bool bInIsRecordingTrajectories);
+
+	// the location of the bullet at any time between its start and the current time, found by a binary search over its legs;
+	// false if the bullet isn't recorded or doesn't fly at that time
+	bool GetBulletLocationAt(unsigned int bulletId, float time, Vector2& outLocation) const;
+
+	// nullptr if the bullet isn't recorded; valid until the next Update, AddBullet or RewindTo
+	const std::vector<BulletLeg>* GetBulletTrajectory(unsigned int bulletId) const;
+
+	// the recorder is not owned, it has to outlive the manager or be reset to nullptr
+	void SetFlightRecorder(class FlightRecorder* inFlightRecorder);
+
+	// streams spawns, reflections, wall destructions, expiries and rewinds to the trace, starting with the current walls and bullets;
+	// the writer is not owned, it has to outlive the manager or be reset to nullptr
+	void SetEventTrace(class EventTraceWriter* inEventTrace);
+
+	// every Update ends by publishing the walls and bullets, like GenerateState, for other processes to read;
+	// the publisher is not owned, it has to outlive the manager or be reset to nullptr
+	void SetStatePublisher(class SharedStatePublisher* inStatePublisher);
+
+	// every Update starts by adding the bullets other processes wrote into the ring since the previous one, as one batch;
+	// the ring is not owned, it has to outlive the manager or be reset to nullptr
+	void SetCommandRing(class BulletCommandRing* inCommandRing);
+
+	float GetCurrentTime() const { return currentTime; }
+
+	// the wall and bullet pairs the wall grid gave to the collision tests, the ones the bounding boxes of the walls and of the
+	// bullet sweeps ruled out, and the ones that turned out to hit before the end of the step
+	struct BroadPhaseStats
+	{
+		unsigned long long testedPairsCount = 0;
+
+		unsigned long long rejectedPairsCount = 0;
+
+		unsigned long long hitPairsCount = 0;
+
+		void Add(const BroadPhaseStats& other)
+		{
+			testedPairsCount += other.testedPairsCount;
+			rejectedPairsCount += other.rejectedPairsCount;
+			hitPairsCount += other.hitPairsCount;
+		}
+	};
+
+	// summed over every step since the manager was made
+	const BroadPhaseStats& GetBroadPhaseStats() const { return broadPhaseStats; }
+
+	// whether the rounds compare the bounding boxes of the walls from the grid with the bullet sweeps before the collision tests;
+	// on by default, turned off only to measure what the comparison saves
+	void SetWallBoxTest(bool bInIsTestingWallBoxes);
+
+	// a hash of the walls, the bullets and the time; the first call hashes everything, after it every change updates the hash.
+	// The simulation orders hits by time, bullet and wall, so equal inputs give equal hashes whatever the thread count
+	unsigned long long GetStateHash();
+
 	struct Wall
 	{
 		WallDefinition definition;
@@ -62,24 +237,131 @@ public:
 	struct Bullet
 	{
 		BulletDefinition definition;
+
+		// stays the same through reflections
+		unsigned int id = 0;
 	};
 
+	// takes over already prepared storage, e.g. filled by a streaming loader
+	BulletManager(std::vector<Wall>&& inWalls, std::vector<Bullet>&& inBullets);
+
 	struct FilterStage;
 
 	struct ApplyBulletStage;
 
+	struct CollisionReachStage;
+
+	struct CollisionIslandStage;
+
+	struct GenerateStateStage;
+
+	struct BulletDeltaStage;
+
 	static bool TryGetTimeDestroyed(WallDefinition wall, BulletDefinition bullet, float& outTime);
 
 	static bool TryGetCollisionPoint(WallDefinition wall, BulletDefinition bullet, Vector2& outCollisionPoint);
 
 	static Vector2 EvaluateBulletLocation(BulletDefinition bullet, float time);
 
+	// moves the bullet to the point where it hits the wall at the time and turns it away from it
+	static void ReflectBullet(BulletDefinition& bullet, const WallDefinition& wall, float time);
+
 private:
-	std::mutex bulletAdditionMutex;
+	void InitializeThreadPool();
 
-	static bool TryGetCollinearBulletCollisionTime(WallDefinition wall, BulletDefinition bullet, float& outTime);
+	class ThreadPool* GetThreadPool() const;
+
+	void InitializeBulletIds();
+
+	// runs the collision rounds up to the time; the caller holds the lock and has prepared the wall grid
+	void SimulateUntil(float time);
+
+	// runs SimulateUntil over equal slices of the time no longer than GetSliceHorizon, so that a long Update
+	// doesn't test every bullet against all the walls its whole path sweeps at once
+	void SimulateHorizon(float time);
+
+	// the longest slice over which the fastest flying bullet sweeps about as many candidate walls as the grid
+	// is meant to give it, from the number of walls per cell; at least a quarter of a cell of flight
+	float GetSliceHorizon() const;
+
+	// SimulateUntil with collision cells
+	void SimulateCollisionCellsUntil(float time);
+
+	// hands the bullets out to the regions for the step up to the time, splitting the world again if the walls were replaced
+	void BeginWorldRegionsStep(float time);
+
+	// the step Solve takes: the time the fastest bullet needs to cross a part of a grid cell
+	float GetSolveHorizon() const;
+
+	// replaces the walls and/or the bullets of the state with the ones inside the view box, the other one is left untouched
+	void FillVisibleState(struct GraphicsState& outGraphicsState, bool bFillWalls, bool bFillBullets, const Vector2& viewMin, const Vector2& viewMax) const;
+
+	// the same, into outputs asked for with getOutputs(wallsCount, bulletsCount, outWalls, outBullets) once the counts are known;
+	// false if no outputs were given. Only used within BulletManager.cpp
+	template <class GetOutputs>
+	bool FillVisibleStateInto(bool bFillWalls, bool bFillBullets, const Vector2& viewMin, const Vector2& viewMax, const GetOutputs& getOutputs) const;
+
+	void PublishState();
+
+	void FillDestroyedWalls(struct GraphicsState& outGraphicsState, const Vector2& viewMin, const Vector2& viewMax) const;
+
+	int GetStateStagesCount(size_t elementsCount) const;
+
+	static bool IsBulletVisible(const BulletDefinition& bullet, float time);
+
+	void EnsureWallGrid();
+
+	void PullScheduledBullets(float time);
+
+	void DrainCommandRing();
+
+	// adds pulledBullets with new ids
+	void AddPulledBullets();
+
+	void RemoveExpiredBullets();
+
+	void PageWallTiles(float horizonTime);
 
-	static bool CanCollide(const Wall& wall, const Bullet& bullet, float startingTime, float targetTime);
+	void WriteBackWallTiles();
+
+	void RebuildStateHash();
+
+	// starts the journal entries of the step beginning at the current time and drops the steps that left the window
+	void BeginRewindStep();
+
+	void ClearRewindJournal();
+
+	// after paging, points the journal at the new index of every wall, -1 for the evicted ones
+	void RemapRewindJournal(const std::vector<int>& newWallIndices);
+
+	struct RewindEntry
+	{
+		// the bullet before the event
+		Bullet bullet;
+
+		// the wall the bullet destroyed, walls are destroyed only once so undoing leaves it standing;
+		// -1 when the bullet expired and was removed
+		int wallIndex;
+
+		// of the hit, or the end of the bullet's lifetime
+		float time;
+	};
+
+	// starts the trajectory of a bullet that was just added
+	void RecordTrajectoryStart(const Bullet& bullet);
+
+	// puts the bullet back the way it was before the event; expired bullets are already in restoredBullets
+	void UndoRewindEntry(const RewindEntry& entry);
+
+	// waits for the checkpoint child, or only checks on it; true once there is none
+	bool ReapCheckpointProcess(bool bWait);
+
+	// bounds of the path of the bullet between the two times; false if the bullet doesn't fly during that time
+	static bool TryGetBulletSweepBounds(const BulletDefinition& bullet, float startTime, float endTime, Vector2& outMin, Vector2& outMax);
+
+	mutable std::mutex bulletAdditionMutex;
+
+	static bool TryGetCollinearBulletCollisionTime(WallDefinition wall, BulletDefinition bullet, float& outTime);
 
 	float currentTime = 0;
 
@@ -87,7 +369,154 @@ private:
 
 	std::vector<Wall> walls;
 
+	// in the order of their ids
 	std::vector<Bullet> bullets;
 
-	std::unique_ptr<class ThreadPool> threadPool;
+	// walls destroyed by the most recent Update, reported to the renderer so it can patch its cached wall layer
+	std::vector<WallDefinition> lastDestroyedWalls;
+
+	// changes whenever the set of walls is replaced rather than just destroyed
+	unsigned int wallsRevision = 0;
+
+	unsigned int nextBulletId = 0;
+
+	// changes collected for GenerateStateDelta
+	bool bIsTrackingStateDelta = false;
+
+	float lastDeltaTime = 0;
+
+	// bullets with this id or above were added after the previous delta
+	unsigned int lastDeltaBulletId = 0;
+
+	unsigned int lastDeltaWallsRevision = 0;
+
+	std::vector<WallDefinition> pendingDestroyedWalls;
+
+	std::vector<unsigned int> pendingReflectedBulletIds;
+
+	std::vector<unsigned int> pendingExpiredBulletIds;
+
+	// XOR of the hashes of every wall and bullet, kept up to date once GetStateHash has been called
+	bool bIsTrackingStateHash = false;
+
+	unsigned long long stateHash = 0;
+
+	unsigned int stateHashWallsRevision = 0;
+
+	// the pool the stages run on, nullptr runs them on the calling thread
+	mutable class ThreadPool* threadPool = nullptr;
+
+	mutable std::unique_ptr<class ThreadPool> ownedThreadPool;
+
+	bool bUsesOwnThreadPool = true;
+
+	// per round buffers, kept to avoid reallocating them every round
+	std::unique_ptr<struct SimulationBuffers> simulationBuffers;
+
+	// kept between frames so that generating the state of a view doesn't allocate
+	mutable std::vector<int> visibleWallIndices;
+
+	// set while Solve runs or by SetWallDestructionLog
+	std::vector<WallDestruction>* destructionLog = nullptr;
+
+	std::unique_ptr<class WallGrid> wallGrid;
+
+	// 0 when the stages split the walls by index
+	int worldRegionsCount = 0;
+
+	std::unique_ptr<class WorldRegions> worldRegions;
+
+	unsigned int worldRegionsWallsRevision = 0;
+
+	// 0 when the collisions run in global rounds
+	float collisionCellSize = 0;
+
+	BroadPhaseStats broadPhaseStats;
+
+	bool bIsTestingWallBoxes = true;
+
+	std::unique_ptr<class BulletScheduleReader> bulletSchedule;
+
+	float scheduleLookAhead = 0;
+
+	struct ResidentWallTile
+	{
+		int tileIndex;
+		int firstWall;
+		int wallsCount;
+	};
+
+	std::unique_ptr<class WallTileStore> wallTileStore;
+
+	std::vector<ResidentWallTile> residentWallTiles;
+
+	float tileLookAhead = 0;
+
+	class FlightRecorder* flightRecorder = nullptr;
+
+	class EventTraceWriter* eventTrace = nullptr;
+
+	class SharedStatePublisher* statePublisher = nullptr;
+
+	class BulletCommandRing* commandRing = nullptr;
+
+	// kept between steps so that pulling bullets doesn't allocate
+	std::vector<BulletDefinition> pulledBullets;
+
+	float rewindWindow = 0;
+
+	// the events of the steps within the window, oldest first
+	std::deque<RewindEntry> rewindJournal;
+
+	struct RewindStep
+	{
+		float startTime;
+
+		size_t entriesCount;
+	};
+
+	std::deque<RewindStep> rewindSteps;
+
+	// the expired bullets a rewind puts back, in the order of their ids; merged into the bullets once it is done
+	std::vector<Bullet> restoredBullets;
+
+	struct BulletTrajectory
+	{
+		float endTime = 0;
+
+		std::vector<BulletLeg> legs;
+	};
+
+	bool bIsRecordingTrajectories = false;
+
+	// indexed by bullet id, empty for bullets added before the recording started
+	std::vector<BulletTrajectory> bulletTrajectories;
+
+	// the child writing the current checkpoint, 0 if none
+	int checkpointProcessId = 0;
+};
+
+// a compact copy of the simulation state: walls keep only their endpoints and destruction time
+struct BulletManagerSnapshot
+{
+	struct Wall
+	{
+		Vector2 start;
+		Vector2 end;
+		float timeDestroyed;
+	};
+
+	float currentTime = 0;
+
+	// the id the next added bullet gets
+	unsigned int nextBulletId = 0;
+
+	std::vector<Wall> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	// what the walls were taken from, so that the next TakeSnapshot only has to bring their destroyed times up to date
+	const BulletManager* wallsSource = nullptr;
+
+	unsigned int wallsRevision = 0;
 };
@@ -0,0 +1,113 @@
+#include "BulletSchedule.h"
+
+#include "BinaryIO.h"
+
+#include <algorithm>
+
+static constexpr unsigned int bulletScheduleMagic = 0x48435342; // "BSCH"
+
+static constexpr unsigned int bulletScheduleVersion = 1;
+
+static constexpr size_t bulletScheduleBlockSize = 4096;
+
+struct BulletScheduleHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long bulletsCount;
+};
+
+bool BulletScheduleReader::Open(const std::string& path)
+{
+	stream.close();
+	stream.clear();
+	stream.open(path, std::ios::binary);
+
+	block.clear();
+	nextRecord = 0;
+	recordsLeft = 0;
+
+	BulletScheduleHeader header;
+
+	if (!ReadBinary(stream, header) || header.magic != bulletScheduleMagic || header.version != bulletScheduleVersion)
+	{
+		return false;
+	}
+
+	recordsLeft = header.bulletsCount;
+
+	return true;
+}
+
+bool BulletScheduleReader::ReadBlock()
+{
+	const size_t recordsToRead = static_cast<size_t>(std::min<unsigned long long>(recordsLeft, bulletScheduleBlockSize));
+
+	block.resize(recordsToRead);
+	nextRecord = 0;
+
+	if (recordsToRead == 0)
+	{
+		return false;
+	}
+
+	stream.read(reinterpret_cast<char*>(block.data()), sizeof(BulletManager::BulletDefinition) * recordsToRead);
+
+	if (!stream)
+	{
+		// a truncated schedule ends where the data ends
+		block.clear();
+		recordsLeft = 0;
+		return false;
+	}
+
+	recordsLeft -= recordsToRead;
+
+	return true;
+}
+
+void BulletScheduleReader::ReadUntil(float time, std::vector<BulletManager::BulletDefinition>& outBullets)
+{
+	while (true)
+	{
+		if (nextRecord == block.size() && !ReadBlock())
+		{
+			return;
+		}
+
+		const BulletManager::BulletDefinition& bullet = block[nextRecord];
+
+		if (bullet.startTime >= time)
+		{
+			return;
+		}
+
+		outBullets.push_back(bullet);
+
+		++nextRecord;
+	}
+}
+
+bool WriteBulletSchedule(const std::string& path, std::vector<BulletManager::BulletDefinition> bullets)
+{
+	std::stable_sort(bullets.begin(), bullets.end(), [](const BulletManager::BulletDefinition& first, const BulletManager::BulletDefinition& second)
+	{
+		return first.startTime < second.startTime;
+	});
+
+	std::ofstream stream(path, std::ios::binary);
+
+	if (!stream)
+	{
+		return false;
+	}
+
+	WriteBinary(stream, BulletScheduleHeader{ bulletScheduleMagic, bulletScheduleVersion, bullets.size() });
+
+	for (const BulletManager::BulletDefinition& bullet : bullets)
+	{
+		WriteBinary(stream, bullet);
+	}
+
+	return static_cast<bool>(stream);
+}
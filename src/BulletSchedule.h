@@ -0,0 +1,36 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <fstream>
+
+#include <string>
+
+#include <vector>
+
+// Bullet schedule file: a header followed by BulletDefinition records sorted by startTime.
+// The reader keeps a single block of records in memory, so a schedule of any length can be replayed.
+class BulletScheduleReader
+{
+public:
+	bool Open(const std::string& path);
+
+	// appends the bullets that start before the given time, in schedule order
+	void ReadUntil(float time, std::vector<BulletManager::BulletDefinition>& outBullets);
+
+	bool IsFinished() const { return recordsLeft == 0 && nextRecord == block.size(); }
+
+private:
+	bool ReadBlock();
+
+	std::ifstream stream;
+
+	unsigned long long recordsLeft = 0;
+
+	std::vector<BulletManager::BulletDefinition> block;
+
+	size_t nextRecord = 0;
+};
+
+// sorts the bullets by start time and writes them as a schedule
+bool WriteBulletSchedule(const std::string& path, std::vector<BulletManager::BulletDefinition> bullets);
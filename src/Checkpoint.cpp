@@ -0,0 +1,142 @@
+#include "Checkpoint.h"
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static constexpr unsigned int checkpointMagic = 0x504B4342; // "BCKP"
+
+static constexpr unsigned int checkpointVersion = 1;
+
+static_assert(sizeof(BulletManagerSnapshot::Wall) == 5 * sizeof(float), "Checkpoint walls are expected to be five floats");
+
+static_assert(sizeof(BulletManager::Bullet) == 7 * sizeof(float), "Checkpoint bullets are stored as is and are expected to be seven four byte values");
+
+static_assert(sizeof(CheckpointHeader) % alignof(float) == 0, "Checkpoint records must stay aligned after the header");
+
+static bool WriteAll(int fileDescriptor, const void* data, size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+
+	while (size > 0)
+	{
+		// the Windows CRT takes the size as unsigned int
+		constexpr size_t maxWriteSize = 1 << 30;
+
+#ifdef _WIN32
+		const int written = _write(fileDescriptor, bytes, static_cast<unsigned int>(size < maxWriteSize ? size : maxWriteSize));
+#else
+		const ssize_t written = write(fileDescriptor, bytes, size < maxWriteSize ? size : maxWriteSize);
+#endif
+
+		if (written <= 0)
+		{
+			return false;
+		}
+
+		bytes += written;
+		size -= static_cast<size_t>(written);
+	}
+
+	return true;
+}
+
+static bool WriteCheckpointRecords(int fileDescriptor, float currentTime, unsigned int nextBulletId, const BulletManager::Wall* walls, size_t wallsCount, const BulletManager::Bullet* bullets, size_t bulletsCount)
+{
+	const CheckpointHeader header{ checkpointMagic, checkpointVersion, currentTime, nextBulletId, wallsCount, bulletsCount };
+
+	if (!WriteAll(fileDescriptor, &header, sizeof(header)))
+	{
+		return false;
+	}
+
+	// walls drop their derived terms, so they go through a buffer
+	constexpr size_t bufferedWallsCount = 4096;
+
+	BulletManagerSnapshot::Wall wallRecords[bufferedWallsCount];
+
+	for (size_t firstWall = 0; firstWall < wallsCount; firstWall += bufferedWallsCount)
+	{
+		const size_t recordsCount = wallsCount - firstWall < bufferedWallsCount ? wallsCount - firstWall : bufferedWallsCount;
+
+		for (size_t recordIndex = 0; recordIndex < recordsCount; ++recordIndex)
+		{
+			const BulletManager::Wall& wall = walls[firstWall + recordIndex];
+
+			wallRecords[recordIndex] = { wall.definition.start, wall.definition.end, wall.timeDestroyed };
+		}
+
+		if (!WriteAll(fileDescriptor, wallRecords, recordsCount * sizeof(BulletManagerSnapshot::Wall)))
+		{
+			return false;
+		}
+	}
+
+	return WriteAll(fileDescriptor, bullets, bulletsCount * sizeof(BulletManager::Bullet));
+}
+
+bool WriteCheckpointFile(const char* path, float currentTime, unsigned int nextBulletId, const BulletManager::Wall* walls, size_t wallsCount, const BulletManager::Bullet* bullets, size_t bulletsCount)
+{
+#ifdef _WIN32
+	const int fileDescriptor = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	const int fileDescriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	const bool bWasWritten = WriteCheckpointRecords(fileDescriptor, currentTime, nextBulletId, walls, wallsCount, bullets, bulletsCount);
+
+#ifdef _WIN32
+	return _close(fileDescriptor) == 0 && bWasWritten;
+#else
+	return close(fileDescriptor) == 0 && bWasWritten;
+#endif
+}
+
+bool OpenCheckpoint(const std::string& path, MappedFile& file, CheckpointView& outView)
+{
+	if (!file.Open(path) || file.GetSize() < sizeof(CheckpointHeader))
+	{
+		return false;
+	}
+
+	const CheckpointHeader& header = *reinterpret_cast<const CheckpointHeader*>(file.GetData());
+
+	if (header.magic != checkpointMagic || header.version != checkpointVersion)
+	{
+		return false;
+	}
+
+	const size_t expectedSize = sizeof(CheckpointHeader) + header.wallsCount * sizeof(BulletManagerSnapshot::Wall) + header.bulletsCount * sizeof(BulletManager::Bullet);
+
+	if (file.GetSize() < expectedSize)
+	{
+		return false;
+	}
+
+	const char* wallsData = file.GetData() + sizeof(CheckpointHeader);
+
+	const char* bulletsData = wallsData + header.wallsCount * sizeof(BulletManagerSnapshot::Wall);
+
+	outView.currentTime = header.currentTime;
+	outView.nextBulletId = header.nextBulletId;
+
+	outView.walls = reinterpret_cast<const BulletManagerSnapshot::Wall*>(wallsData);
+	outView.wallsCount = static_cast<size_t>(header.wallsCount);
+
+	outView.bullets = reinterpret_cast<const BulletManager::Bullet*>(bulletsData);
+	outView.bulletsCount = static_cast<size_t>(header.bulletsCount);
+
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <string>
+
+class MappedFile;
+
+// Binary checkpoint layout: CheckpointHeader, then wallsCount BulletManagerSnapshot::Wall records,
+// then bulletsCount BulletManager::Bullet records. Native byte order, so that a mapped file can be read in place.
+struct CheckpointHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	float currentTime;
+	unsigned int nextBulletId;
+	unsigned long long wallsCount;
+	unsigned long long bulletsCount;
+};
+
+// Points into memory owned by someone else, usually a MappedFile
+struct CheckpointView
+{
+	float currentTime = 0;
+
+	unsigned int nextBulletId = 0;
+
+	const BulletManagerSnapshot::Wall* walls = nullptr;
+	size_t wallsCount = 0;
+
+	const BulletManager::Bullet* bullets = nullptr;
+	size_t bulletsCount = 0;
+};
+
+// writes through plain system calls into a fixed buffer on the stack, without allocating,
+// so that it is safe to call in a child forked from a process with other threads
+bool WriteCheckpointFile(const char* path, float currentTime, unsigned int nextBulletId, const BulletManager::Wall* walls, size_t wallsCount, const BulletManager::Bullet* bullets, size_t bulletsCount);
+
+// the view stays valid for as long as the file stays open
+bool OpenCheckpoint(const std::string& path, MappedFile& file, CheckpointView& outView);
@@ -67,4 +67,6 @@ enum class InputResult
 	None,
 	Exit,
 	LaunchBullet,
+	TogglePause,
+	Rewind,
 };
@@ -0,0 +1,533 @@
+#include "EventTrace.h"
+
+#include "BinaryIO.h"
+#include "Graphics.h"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <cstring>
+
+#include <iostream>
+
+#include <iterator>
+
+static constexpr unsigned int eventTraceMagic = 0x43525442; // "BTRC"
+
+static constexpr unsigned int eventTraceVersion = 1;
+
+static unsigned int GetFloatBits(float value)
+{
+	unsigned int bits;
+
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	return bits;
+}
+
+static float GetFloatFromBits(unsigned int bits)
+{
+	float value;
+
+	std::memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+void EventTraceCodec::WriteVarint(std::vector<unsigned char>& bytes, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		bytes.push_back(static_cast<unsigned char>(value | 0x80));
+
+		value >>= 7;
+	}
+
+	bytes.push_back(static_cast<unsigned char>(value));
+}
+
+bool EventTraceCodec::ReadVarint(const unsigned char*& data, const unsigned char* end, unsigned long long& outValue)
+{
+	outValue = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (data == end)
+		{
+			return false;
+		}
+
+		const unsigned char byte = *data++;
+
+		outValue |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void EventTraceCodec::WriteId(std::vector<unsigned char>& bytes, EventType type, unsigned int id)
+{
+	// zigzag, so that small steps back stay small too
+	const int difference = static_cast<int>(id - lastIds[type]);
+
+	WriteVarint(bytes, (static_cast<unsigned int>(difference) << 1) ^ static_cast<unsigned int>(difference >> 31));
+
+	lastIds[type] = id;
+}
+
+bool EventTraceCodec::ReadId(const unsigned char*& data, const unsigned char* end, EventType type, unsigned int& outId)
+{
+	unsigned long long encoded;
+
+	if (!ReadVarint(data, end, encoded))
+	{
+		return false;
+	}
+
+	const unsigned int zigzag = static_cast<unsigned int>(encoded);
+
+	const unsigned int difference = (zigzag >> 1) ^ (0u - (zigzag & 1));
+
+	outId = lastIds[type] + difference;
+
+	lastIds[type] = outId;
+
+	return true;
+}
+
+void EventTraceCodec::WriteFloat(std::vector<unsigned char>& bytes, FloatField field, float value)
+{
+	const unsigned int bits = GetFloatBits(value);
+
+	WriteVarint(bytes, bits ^ lastFloatBits[field]);
+
+	lastFloatBits[field] = bits;
+}
+
+bool EventTraceCodec::ReadFloat(const unsigned char*& data, const unsigned char* end, FloatField field, float& outValue)
+{
+	unsigned long long encoded;
+
+	if (!ReadVarint(data, end, encoded))
+	{
+		return false;
+	}
+
+	lastFloatBits[field] ^= static_cast<unsigned int>(encoded);
+
+	outValue = GetFloatFromBits(lastFloatBits[field]);
+
+	return true;
+}
+
+EventTraceWriter::~EventTraceWriter()
+{
+	Close();
+}
+
+bool EventTraceWriter::Open(const std::string& path)
+{
+	Close();
+
+	stream.open(path, std::ios::binary);
+
+	if (!stream)
+	{
+		return false;
+	}
+
+	WriteBinary(stream, eventTraceMagic);
+	WriteBinary(stream, eventTraceVersion);
+
+	codec = EventTraceCodec();
+
+	activeBlock.clear();
+	activeBlock.reserve(blockSize * 2);
+
+	bIsPendingBlockFull = false;
+	bIsClosing = false;
+	bHasWriteFailed = false;
+
+	writerThread = std::thread(&EventTraceWriter::WriteBlocks, this);
+
+	return static_cast<bool>(stream);
+}
+
+void EventTraceWriter::Close()
+{
+	if (!writerThread.joinable())
+	{
+		return;
+	}
+
+	SubmitBlock();
+
+	{
+		std::unique_lock<std::mutex> blockLock(blockMutex);
+
+		bIsClosing = true;
+	}
+
+	blockCondition.notify_all();
+
+	writerThread.join();
+
+	stream.close();
+
+	if (bHasWriteFailed)
+	{
+		std::cout << "Failed to write the event trace" << std::endl;
+	}
+}
+
+void EventTraceWriter::RecordWalls(float time, const std::vector<BulletManager::Wall>& walls)
+{
+	activeBlock.push_back(EventTraceCodec::Walls);
+
+	codec.WriteFloat(activeBlock, EventTraceCodec::Time, time);
+
+	EventTraceCodec::WriteVarint(activeBlock, walls.size());
+
+	for (const BulletManager::Wall& wall : walls)
+	{
+		codec.WriteFloat(activeBlock, EventTraceCodec::WallStartX, wall.definition.start.X);
+		codec.WriteFloat(activeBlock, EventTraceCodec::WallStartY, wall.definition.start.Y);
+		codec.WriteFloat(activeBlock, EventTraceCodec::WallEndX, wall.definition.end.X);
+		codec.WriteFloat(activeBlock, EventTraceCodec::WallEndY, wall.definition.end.Y);
+		codec.WriteFloat(activeBlock, EventTraceCodec::WallTimeDestroyed, wall.timeDestroyed);
+
+		SubmitBlockIfFull();
+	}
+}
+
+void EventTraceWriter::RecordSpawn(unsigned int bulletId, const BulletManager::BulletDefinition& bullet)
+{
+	activeBlock.push_back(EventTraceCodec::Spawn);
+
+	codec.WriteId(activeBlock, EventTraceCodec::Spawn, bulletId);
+	codec.WriteFloat(activeBlock, EventTraceCodec::Time, bullet.startTime);
+	codec.WriteFloat(activeBlock, EventTraceCodec::PositionX, bullet.startingPosition.X);
+	codec.WriteFloat(activeBlock, EventTraceCodec::PositionY, bullet.startingPosition.Y);
+	codec.WriteFloat(activeBlock, EventTraceCodec::VelocityX, bullet.velocity.X);
+	codec.WriteFloat(activeBlock, EventTraceCodec::VelocityY, bullet.velocity.Y);
+	codec.WriteFloat(activeBlock, EventTraceCodec::Lifetime, bullet.lifetime);
+
+	SubmitBlockIfFull();
+}
+
+void EventTraceWriter::RecordReflection(unsigned int bulletId, float time, const Vector2& position, const Vector2& velocity)
+{
+	activeBlock.push_back(EventTraceCodec::Reflection);
+
+	codec.WriteId(activeBlock, EventTraceCodec::Reflection, bulletId);
+	codec.WriteFloat(activeBlock, EventTraceCodec::Time, time);
+	codec.WriteFloat(activeBlock, EventTraceCodec::PositionX, position.X);
+	codec.WriteFloat(activeBlock, EventTraceCodec::PositionY, position.Y);
+	codec.WriteFloat(activeBlock, EventTraceCodec::VelocityX, velocity.X);
+	codec.WriteFloat(activeBlock, EventTraceCodec::VelocityY, velocity.Y);
+
+	SubmitBlockIfFull();
+}
+
+void EventTraceWriter::RecordWallDestruction(int wallIndex, float time)
+{
+	activeBlock.push_back(EventTraceCodec::WallDestruction);
+
+	codec.WriteId(activeBlock, EventTraceCodec::WallDestruction, static_cast<unsigned int>(wallIndex));
+	codec.WriteFloat(activeBlock, EventTraceCodec::Time, time);
+
+	SubmitBlockIfFull();
+}
+
+void EventTraceWriter::RecordExpiry(unsigned int bulletId, float time)
+{
+	activeBlock.push_back(EventTraceCodec::Expiry);
+
+	codec.WriteId(activeBlock, EventTraceCodec::Expiry, bulletId);
+	codec.WriteFloat(activeBlock, EventTraceCodec::Time, time);
+
+	SubmitBlockIfFull();
+}
+
+void EventTraceWriter::RecordRewind(float time)
+{
+	activeBlock.push_back(EventTraceCodec::Rewind);
+
+	codec.WriteFloat(activeBlock, EventTraceCodec::Time, time);
+
+	SubmitBlockIfFull();
+}
+
+void EventTraceWriter::SubmitBlockIfFull()
+{
+	if (activeBlock.size() >= blockSize)
+	{
+		SubmitBlock();
+	}
+}
+
+void EventTraceWriter::SubmitBlock()
+{
+	if (activeBlock.empty())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> blockLock(blockMutex);
+
+	// only waits when the disk can't keep up with the events
+	blockCondition.wait(blockLock, [this]() { return !bIsPendingBlockFull; });
+
+	activeBlock.swap(pendingBlock);
+
+	activeBlock.clear();
+
+	bIsPendingBlockFull = true;
+
+	blockLock.unlock();
+
+	blockCondition.notify_all();
+}
+
+void EventTraceWriter::WriteBlocks()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> blockLock(blockMutex);
+
+		blockCondition.wait(blockLock, [this]() { return bIsPendingBlockFull || bIsClosing; });
+
+		if (!bIsPendingBlockFull)
+		{
+			return;
+		}
+
+		blockLock.unlock();
+
+		stream.write(reinterpret_cast<const char*>(pendingBlock.data()), pendingBlock.size());
+
+		bHasWriteFailed |= !stream;
+
+		blockLock.lock();
+
+		bIsPendingBlockFull = false;
+
+		blockLock.unlock();
+
+		blockCondition.notify_all();
+	}
+}
+
+bool EventTracePlayer::Open(const std::string& path)
+{
+	std::ifstream stream(path, std::ios::binary);
+
+	unsigned int magic;
+	unsigned int version;
+
+	if (!ReadBinary(stream, magic) || !ReadBinary(stream, version) || magic != eventTraceMagic || version != eventTraceVersion)
+	{
+		return false;
+	}
+
+	const std::vector<unsigned char> events((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+	bullets.clear();
+	wallSets.clear();
+	endTime = 0;
+
+	return ReadEvents(events.data(), events.data() + events.size());
+}
+
+bool EventTracePlayer::ReadEvents(const unsigned char* data, const unsigned char* end)
+{
+	EventTraceCodec codec;
+
+	while (data != end)
+	{
+		const unsigned char type = *data++;
+
+		unsigned int id = 0;
+
+		float time = 0;
+
+		bool bWasRead = true;
+
+		switch (type)
+		{
+		case EventTraceCodec::Walls:
+		{
+			unsigned long long wallsCount;
+
+			bWasRead = codec.ReadFloat(data, end, EventTraceCodec::Time, time) && EventTraceCodec::ReadVarint(data, end, wallsCount);
+
+			wallSets.push_back({ time, {} });
+
+			for (unsigned long long wallIndex = 0; bWasRead && wallIndex < wallsCount; ++wallIndex)
+			{
+				BulletManagerSnapshot::Wall wall;
+
+				bWasRead = codec.ReadFloat(data, end, EventTraceCodec::WallStartX, wall.start.X)
+					&& codec.ReadFloat(data, end, EventTraceCodec::WallStartY, wall.start.Y)
+					&& codec.ReadFloat(data, end, EventTraceCodec::WallEndX, wall.end.X)
+					&& codec.ReadFloat(data, end, EventTraceCodec::WallEndY, wall.end.Y)
+					&& codec.ReadFloat(data, end, EventTraceCodec::WallTimeDestroyed, wall.timeDestroyed);
+
+				wallSets.back().walls.push_back(wall);
+			}
+			break;
+		}
+		case EventTraceCodec::Spawn:
+		{
+			BulletManager::BulletDefinition bullet;
+
+			bWasRead = codec.ReadId(data, end, EventTraceCodec::Spawn, id)
+				&& codec.ReadFloat(data, end, EventTraceCodec::Time, bullet.startTime)
+				&& codec.ReadFloat(data, end, EventTraceCodec::PositionX, bullet.startingPosition.X)
+				&& codec.ReadFloat(data, end, EventTraceCodec::PositionY, bullet.startingPosition.Y)
+				&& codec.ReadFloat(data, end, EventTraceCodec::VelocityX, bullet.velocity.X)
+				&& codec.ReadFloat(data, end, EventTraceCodec::VelocityY, bullet.velocity.Y)
+				&& codec.ReadFloat(data, end, EventTraceCodec::Lifetime, bullet.lifetime);
+
+			if (bWasRead)
+			{
+				if (bullets.size() <= id)
+				{
+					bullets.resize(id + 1);
+				}
+
+				bullets[id].endTime = bullet.startTime + bullet.lifetime;
+
+				bullets[id].legs.assign(1, { bullet.startTime, bullet.startingPosition, bullet.velocity });
+
+				time = bullet.startTime;
+			}
+			break;
+		}
+		case EventTraceCodec::Reflection:
+		{
+			BulletManager::BulletLeg leg;
+
+			bWasRead = codec.ReadId(data, end, EventTraceCodec::Reflection, id)
+				&& codec.ReadFloat(data, end, EventTraceCodec::Time, leg.startTime)
+				&& codec.ReadFloat(data, end, EventTraceCodec::PositionX, leg.startingPosition.X)
+				&& codec.ReadFloat(data, end, EventTraceCodec::PositionY, leg.startingPosition.Y)
+				&& codec.ReadFloat(data, end, EventTraceCodec::VelocityX, leg.velocity.X)
+				&& codec.ReadFloat(data, end, EventTraceCodec::VelocityY, leg.velocity.Y)
+				&& id < bullets.size();
+
+			if (bWasRead)
+			{
+				bullets[id].legs.push_back(leg);
+
+				time = leg.startTime;
+			}
+			break;
+		}
+		case EventTraceCodec::WallDestruction:
+			bWasRead = codec.ReadId(data, end, EventTraceCodec::WallDestruction, id)
+				&& codec.ReadFloat(data, end, EventTraceCodec::Time, time)
+				&& !wallSets.empty() && id < wallSets.back().walls.size();
+
+			if (bWasRead)
+			{
+				wallSets.back().walls[id].timeDestroyed = time;
+			}
+			break;
+		case EventTraceCodec::Expiry:
+			// the bullets are already known to end with their lifetime
+			bWasRead = codec.ReadId(data, end, EventTraceCodec::Expiry, id) && codec.ReadFloat(data, end, EventTraceCodec::Time, time);
+			break;
+		case EventTraceCodec::Rewind:
+			bWasRead = codec.ReadFloat(data, end, EventTraceCodec::Time, time);
+
+			if (bWasRead)
+			{
+				RewindTo(time);
+			}
+			break;
+		default:
+			bWasRead = false;
+			break;
+		}
+
+		if (!bWasRead)
+		{
+			return false;
+		}
+
+		endTime = std::fmax(endTime, time);
+	}
+
+	return true;
+}
+
+void EventTracePlayer::RewindTo(float time)
+{
+	// the manager keeps the bullets added after the time, so only their reflections go
+	for (TracedBullet& bullet : bullets)
+	{
+		while (bullet.legs.size() > 1 && bullet.legs.back().startTime > time)
+		{
+			bullet.legs.pop_back();
+		}
+	}
+
+	if (!wallSets.empty())
+	{
+		for (BulletManagerSnapshot::Wall& wall : wallSets.back().walls)
+		{
+			if (wall.timeDestroyed > time)
+			{
+				wall.timeDestroyed = -1;
+			}
+		}
+	}
+}
+
+void EventTracePlayer::GenerateState(float time, GraphicsState& outGraphicsState) const
+{
+	outGraphicsState.walls.clear();
+	outGraphicsState.bullets.clear();
+	outGraphicsState.destroyedWalls.clear();
+
+	// the last set of walls that was in place at the time
+	const auto wallSet = std::upper_bound(wallSets.begin(), wallSets.end(), time, [](float time, const WallSet& wallSet)
+	{
+		return time < wallSet.time;
+	});
+
+	if (wallSet != wallSets.begin())
+	{
+		for (const BulletManagerSnapshot::Wall& wall : (wallSet - 1)->walls)
+		{
+			if (wall.timeDestroyed < 0 || wall.timeDestroyed > time)
+			{
+				outGraphicsState.walls.push_back({ wall.start, wall.end });
+			}
+		}
+
+		outGraphicsState.wallsRevision = static_cast<unsigned int>(wallSet - wallSets.begin());
+	}
+
+	for (const TracedBullet& bullet : bullets)
+	{
+		if (bullet.legs.empty() || !(bullet.legs.front().startTime < time && time < bullet.endTime))
+		{
+			continue;
+		}
+
+		const auto leg = std::upper_bound(bullet.legs.begin(), bullet.legs.end(), time, [](float time, const BulletManager::BulletLeg& leg)
+		{
+			return time < leg.startTime;
+		}) - 1;
+
+		outGraphicsState.bullets.push_back({ leg->startingPosition + leg->velocity * (time - leg->startTime), leg->velocity });
+	}
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <condition_variable>
+
+#include <fstream>
+
+#include <mutex>
+
+#include <string>
+
+#include <thread>
+
+#include <vector>
+
+struct GraphicsState;
+
+// Event trace file: a header followed by a stream of events, each a type byte and its fields.
+// Ids and wall indices are stored as varints of the difference to the previous event of the same kind,
+// floats as varints of their bits XORed with the same field of the previous event, so repeated values take a byte.
+struct EventTraceCodec
+{
+	enum EventType : unsigned char
+	{
+		Walls,
+		Spawn,
+		Reflection,
+		WallDestruction,
+		Expiry,
+		Rewind,
+	};
+
+	enum FloatField
+	{
+		Time,
+		PositionX,
+		PositionY,
+		VelocityX,
+		VelocityY,
+		Lifetime,
+		WallStartX,
+		WallStartY,
+		WallEndX,
+		WallEndY,
+		WallTimeDestroyed,
+		FloatFieldsCount,
+	};
+
+	void WriteId(std::vector<unsigned char>& bytes, EventType type, unsigned int id);
+
+	void WriteFloat(std::vector<unsigned char>& bytes, FloatField field, float value);
+
+	static void WriteVarint(std::vector<unsigned char>& bytes, unsigned long long value);
+
+	bool ReadId(const unsigned char*& data, const unsigned char* end, EventType type, unsigned int& outId);
+
+	bool ReadFloat(const unsigned char*& data, const unsigned char* end, FloatField field, float& outValue);
+
+	static bool ReadVarint(const unsigned char*& data, const unsigned char* end, unsigned long long& outValue);
+
+	unsigned int lastIds[Rewind + 1] = {};
+
+	unsigned int lastFloatBits[FloatFieldsCount] = {};
+};
+
+// Streams the events of a manager to a trace file. Events are encoded into a block in memory on the thread that records them;
+// full blocks are handed to a writer thread, which writes one block while the next one is being filled
+class EventTraceWriter
+{
+public:
+	~EventTraceWriter();
+
+	bool Open(const std::string& path);
+
+	// writes what is left and waits for the writer thread
+	void Close();
+
+	// the walls replace the previous ones, e.g. when tiles were paged
+	void RecordWalls(float time, const std::vector<BulletManager::Wall>& walls);
+
+	void RecordSpawn(unsigned int bulletId, const BulletManager::BulletDefinition& bullet);
+
+	void RecordReflection(unsigned int bulletId, float time, const Vector2& position, const Vector2& velocity);
+
+	void RecordWallDestruction(int wallIndex, float time);
+
+	void RecordExpiry(unsigned int bulletId, float time);
+
+	// the events after the time were undone
+	void RecordRewind(float time);
+
+	// a block is handed over once it grows past this
+	size_t blockSize = 1 << 16;
+
+private:
+	void SubmitBlockIfFull();
+
+	void SubmitBlock();
+
+	void WriteBlocks();
+
+	std::ofstream stream;
+
+	EventTraceCodec codec;
+
+	// filled by the recording thread
+	std::vector<unsigned char> activeBlock;
+
+	// owned by the writer thread while bIsPendingBlockFull is set
+	std::vector<unsigned char> pendingBlock;
+
+	std::mutex blockMutex;
+
+	std::condition_variable blockCondition;
+
+	bool bIsPendingBlockFull = false;
+
+	bool bIsClosing = false;
+
+	bool bHasWriteFailed = false;
+
+	std::thread writerThread;
+};
+
+// Reads a whole trace and indexes it by bullet, so that the state at any time is rebuilt without simulating
+class EventTracePlayer
+{
+public:
+	bool Open(const std::string& path);
+
+	float GetEndTime() const { return endTime; }
+
+	// the walls standing and the bullets flying at the time, like BulletManager::GenerateState
+	void GenerateState(float time, GraphicsState& outGraphicsState) const;
+
+private:
+	struct TracedBullet
+	{
+		float endTime = 0;
+
+		std::vector<BulletManager::BulletLeg> legs;
+	};
+
+	struct WallSet
+	{
+		float time;
+
+		std::vector<BulletManagerSnapshot::Wall> walls;
+	};
+
+	bool ReadEvents(const unsigned char* data, const unsigned char* end);
+
+	void RewindTo(float time);
+
+	// indexed by bullet id
+	std::vector<TracedBullet> bullets;
+
+	std::vector<WallSet> wallSets;
+
+	float endTime = 0;
+};
@@ -0,0 +1,352 @@
+#include "FlightRecorder.h"
+
+#include "BinaryIO.h"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <fstream>
+
+#include <iostream>
+
+static constexpr unsigned int flightRecorderDumpMagic = 0x44524642; // "BFRD"
+
+static constexpr unsigned int flightRecorderDumpVersion = 3;
+
+FlightRecorder::FlightRecorder(int inFramesToKeep, float inSlowFrameThresholdMs, const std::string& inDumpPathPrefix) :
+	framesToKeep(inFramesToKeep > 0 ? inFramesToKeep : 1), slowFrameThresholdMs(inSlowFrameThresholdMs), dumpPathPrefix(inDumpPathPrefix), framesSinceLastDump(framesToKeep)
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+	{
+		std::unique_lock<std::mutex> dumpLock(dumpMutex);
+
+		bIsClosing = true;
+	}
+
+	dumpCondition.notify_all();
+
+	if (writerThread.joinable())
+	{
+		writerThread.join();
+	}
+}
+
+void FlightRecorder::BeginFrame(const BulletManager& bulletManager)
+{
+	std::shared_ptr<BulletManagerSnapshot> snapshot;
+
+	{
+		std::unique_lock<std::mutex> recordLock(recordMutex);
+
+		// the recent snapshot can't become the base when the frames after it rewind to before it
+		const bool bIsRebaseDue = bHasRecentSnapshot && framesSinceRecentSnapshot >= framesToKeep;
+
+		if (bShouldRestartRecording || (bIsRebaseDue && earliestRewindTime < recentSnapshot->currentTime))
+		{
+			bShouldRestartRecording = false;
+
+			bHasBaseSnapshot = false;
+			bHasRecentSnapshot = false;
+		}
+
+		if (!bHasBaseSnapshot || framesSinceRecentSnapshot >= framesToKeep)
+		{
+			// the base is dropped once there is a recent snapshot to replace it, so its buffer is refreshed for the new one
+			snapshot = !bHasBaseSnapshot || bHasRecentSnapshot ? baseSnapshot : recentSnapshot;
+
+			// unless the writer thread is still on it
+			if (!snapshot || snapshot.use_count() > 2)
+			{
+				snapshot = std::make_shared<BulletManagerSnapshot>();
+			}
+		}
+	}
+
+	// the manager records under its own lock, so it isn't called while holding the record lock
+	if (snapshot)
+	{
+		bulletManager.TakeSnapshot(*snapshot);
+	}
+
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	FrameRecord frame;
+
+	if (snapshot)
+	{
+		if (!bHasBaseSnapshot)
+		{
+			baseSnapshot = snapshot;
+
+			bHasBaseSnapshot = true;
+		}
+		else
+		{
+			if (bHasRecentSnapshot)
+			{
+				// the frames before the recent snapshot are no longer needed, the recent snapshot becomes the base
+				const size_t framesToDrop = frames.size() - framesSinceRecentSnapshot;
+
+				frames.erase(frames.begin(), frames.begin() + framesToDrop);
+
+				baseSnapshot = recentSnapshot;
+			}
+
+			recentSnapshot = snapshot;
+
+			bHasRecentSnapshot = true;
+		}
+
+		framesSinceRecentSnapshot = 0;
+
+		earliestRewindTime = std::numeric_limits<float>::max();
+
+		// bullets added from other threads after the snapshot but before this lock belong to the new frame
+		if (!frames.empty())
+		{
+			std::vector<FrameEvent>& previousEvents = frames.rbegin()->events;
+
+			const auto laterEvents = std::stable_partition(previousEvents.begin(), previousEvents.end(), [&snapshot](const FrameEvent& event)
+			{
+				return event.type != FrameEvent::BulletAddition || event.bulletId < snapshot->nextBulletId;
+			});
+
+			frame.events.assign(laterEvents, previousEvents.end());
+
+			previousEvents.erase(laterEvents, previousEvents.end());
+		}
+
+		// starting over, the frames before the new base are of the recording that was given up
+		if (baseSnapshot == snapshot)
+		{
+			frames.clear();
+		}
+	}
+
+	frames.push_back(std::move(frame));
+
+	++framesSinceRecentSnapshot;
+
+	bIsFrameOpen = true;
+}
+
+void FlightRecorder::RecordUpdate(float deltaTime)
+{
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	if (!bIsFrameOpen)
+	{
+		return;
+	}
+
+	frames.rbegin()->events.push_back({ FrameEvent::Update, deltaTime, 0, BulletManager::BulletDefinition() });
+}
+
+void FlightRecorder::RecordBulletAddition(float simulationTime, unsigned int bulletId, const BulletManager::BulletDefinition& definition)
+{
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	if (!bIsFrameOpen)
+	{
+		return;
+	}
+
+	frames.rbegin()->events.push_back({ FrameEvent::BulletAddition, simulationTime, bulletId, definition });
+}
+
+void FlightRecorder::RecordExpiredBulletsRemoval(float simulationTime)
+{
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	if (!bIsFrameOpen)
+	{
+		return;
+	}
+
+	frames.rbegin()->events.push_back({ FrameEvent::ExpiredBulletsRemoval, simulationTime, 0, BulletManager::BulletDefinition() });
+}
+
+void FlightRecorder::RecordRewind(float time)
+{
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	if (!bIsFrameOpen)
+	{
+		return;
+	}
+
+	frames.rbegin()->events.push_back({ FrameEvent::Rewind, time, 0, BulletManager::BulletDefinition() });
+
+	earliestRewindTime = std::fmin(earliestRewindTime, time);
+
+	bShouldRestartRecording = bShouldRestartRecording || time < baseSnapshot->currentTime;
+}
+
+bool FlightRecorder::EndFrame(float frameDurationMs)
+{
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	if (!bIsFrameOpen)
+	{
+		return false;
+	}
+
+	bIsFrameOpen = false;
+
+	frames.rbegin()->frameDurationMs = frameDurationMs;
+
+	++framesSinceLastDump;
+
+	// don't flood the disk when several frames in a row are slow
+	if (frameDurationMs <= slowFrameThresholdMs || framesSinceLastDump < framesToKeep)
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> dumpLock(dumpMutex);
+
+	if (bIsDumpPending)
+	{
+		std::cout << "Frame took " << frameDurationMs << " ms, the previous dump is still being written" << std::endl;
+		return false;
+	}
+
+	framesSinceLastDump = 0;
+
+	// the base snapshot is shared rather than copied, the frames are small
+	pendingDumpSnapshot = baseSnapshot;
+
+	pendingDumpFrames.assign(frames.begin(), frames.end());
+
+	pendingDumpPath = dumpPathPrefix + std::to_string(dumpsWritten++) + ".bfr";
+
+	std::cout << "Frame took " << frameDurationMs << " ms, dumping " << pendingDumpFrames.size() << " frames to " << pendingDumpPath << std::endl;
+
+	bIsDumpPending = true;
+
+	if (!writerThread.joinable())
+	{
+		writerThread = std::thread(&FlightRecorder::WriteDumps, this);
+	}
+
+	dumpLock.unlock();
+
+	dumpCondition.notify_all();
+
+	return true;
+}
+
+void FlightRecorder::WriteDumps()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> dumpLock(dumpMutex);
+
+		dumpCondition.wait(dumpLock, [this]() { return bIsDumpPending || bIsClosing; });
+
+		if (!bIsDumpPending)
+		{
+			return;
+		}
+
+		dumpLock.unlock();
+
+		if (!WriteDump(pendingDumpPath, *pendingDumpSnapshot, pendingDumpFrames))
+		{
+			std::cout << "Failed to write slow frame dump " << pendingDumpPath << std::endl;
+		}
+
+		dumpLock.lock();
+
+		pendingDumpSnapshot.reset();
+
+		pendingDumpFrames.clear();
+
+		bIsDumpPending = false;
+	}
+}
+
+void FlightRecorder::GetDump(Dump& outDump) const
+{
+	std::unique_lock<std::mutex> recordLock(recordMutex);
+
+	if (bHasBaseSnapshot)
+	{
+		outDump.snapshot = *baseSnapshot;
+	}
+
+	outDump.frames.assign(frames.begin(), frames.end());
+}
+
+bool FlightRecorder::WriteDump(const std::string& path, const Dump& dump)
+{
+	return WriteDump(path, dump.snapshot, dump.frames);
+}
+
+bool FlightRecorder::WriteDump(const std::string& path, const BulletManagerSnapshot& snapshot, const std::vector<FrameRecord>& frames)
+{
+	std::ofstream stream(path, std::ios::binary);
+
+	if (!stream)
+	{
+		return false;
+	}
+
+	WriteBinary(stream, flightRecorderDumpMagic);
+	WriteBinary(stream, flightRecorderDumpVersion);
+
+	WriteBinary(stream, snapshot.currentTime);
+	WriteBinaryArray(stream, snapshot.walls);
+	WriteBinaryArray(stream, snapshot.bullets);
+
+	WriteBinary(stream, static_cast<unsigned long long>(frames.size()));
+
+	for (const FrameRecord& frame : frames)
+	{
+		WriteBinary(stream, frame.frameDurationMs);
+		WriteBinaryArray(stream, frame.events);
+	}
+
+	return static_cast<bool>(stream);
+}
+
+bool FlightRecorder::ReadDump(const std::string& path, Dump& outDump)
+{
+	std::ifstream stream(path, std::ios::binary);
+
+	unsigned int magic;
+	unsigned int version;
+
+	if (!ReadBinary(stream, magic) || !ReadBinary(stream, version) || magic != flightRecorderDumpMagic || version != flightRecorderDumpVersion)
+	{
+		return false;
+	}
+
+	if (!ReadBinary(stream, outDump.snapshot.currentTime) || !ReadBinaryArray(stream, outDump.snapshot.walls) || !ReadBinaryArray(stream, outDump.snapshot.bullets))
+	{
+		return false;
+	}
+
+	unsigned long long framesCount;
+
+	if (!ReadBinary(stream, framesCount))
+	{
+		return false;
+	}
+
+	outDump.frames.resize(static_cast<size_t>(framesCount));
+
+	for (FrameRecord& frame : outDump.frames)
+	{
+		if (!ReadBinary(stream, frame.frameDurationMs) || !ReadBinaryArray(stream, frame.events))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <condition_variable>
+
+#include <deque>
+
+#include <limits>
+
+#include <memory>
+
+#include <mutex>
+
+#include <string>
+
+#include <thread>
+
+#include <vector>
+
+// Keeps the inputs of the most recent frames so that a slow frame can be replayed offline.
+// A snapshot of the manager is taken every framesToKeep frames; the previous snapshot is kept
+// as the base of the recording, so a dump holds between framesToKeep and 2 * framesToKeep frames, fewer after a rewind past the base.
+// BeginFrame, EndFrame and Update run on the frame thread, bullets may be added from any thread.
+// Dumps are written by a thread of their own, one at a time.
+class FlightRecorder
+{
+public:
+	// what happened during a frame, in the order the manager did it
+	struct FrameEvent
+	{
+		enum Type : int
+		{
+			BulletAddition,
+			ExpiredBulletsRemoval,
+			Update,
+			Rewind
+		};
+
+		Type type;
+
+		// the delta time of an update, the target time of a rewind, the simulation time of the manager for the others
+		float time;
+
+		// set for an addition
+		unsigned int bulletId;
+
+		BulletManager::BulletDefinition definition;
+	};
+
+	struct FrameRecord
+	{
+		std::vector<FrameEvent> events;
+
+		float frameDurationMs = 0;
+	};
+
+	struct Dump
+	{
+		BulletManagerSnapshot snapshot;
+
+		std::vector<FrameRecord> frames;
+	};
+
+	FlightRecorder(int inFramesToKeep, float inSlowFrameThresholdMs, const std::string& inDumpPathPrefix);
+
+	// waits for the dump being written
+	~FlightRecorder();
+
+	void BeginFrame(const BulletManager& bulletManager);
+
+	void RecordUpdate(float deltaTime);
+
+	void RecordBulletAddition(float simulationTime, unsigned int bulletId, const BulletManager::BulletDefinition& definition);
+
+	void RecordExpiredBulletsRemoval(float simulationTime);
+
+	// a rewind to before the base snapshot can't be replayed, the recording starts over at the next frame;
+	// one to before the recent snapshot only once that snapshot would become the base
+	void RecordRewind(float time);
+
+	// returns true if the frame was slow and a dump was handed to the writer thread
+	bool EndFrame(float frameDurationMs);
+
+	void GetDump(Dump& outDump) const;
+
+	static bool WriteDump(const std::string& path, const Dump& dump);
+
+	static bool ReadDump(const std::string& path, Dump& outDump);
+
+private:
+	static bool WriteDump(const std::string& path, const BulletManagerSnapshot& snapshot, const std::vector<FrameRecord>& frames);
+
+	void WriteDumps();
+
+	const int framesToKeep;
+
+	const float slowFrameThresholdMs;
+
+	const std::string dumpPathPrefix;
+
+	mutable std::mutex recordMutex;
+
+	// shared with the writer thread while a dump of them is written, a snapshot still being written isn't refreshed in place
+	std::shared_ptr<BulletManagerSnapshot> baseSnapshot;
+
+	std::shared_ptr<BulletManagerSnapshot> recentSnapshot;
+
+	bool bHasBaseSnapshot = false;
+
+	bool bHasRecentSnapshot = false;
+
+	int framesSinceRecentSnapshot = 0;
+
+	bool bIsFrameOpen = false;
+
+	bool bShouldRestartRecording = false;
+
+	// of the rewinds since the recent snapshot
+	float earliestRewindTime = std::numeric_limits<float>::max();
+
+	std::deque<FrameRecord> frames;
+
+	int dumpsWritten = 0;
+
+	int framesSinceLastDump = 0;
+
+	// owned by the writer thread while bIsDumpPending is set
+	std::shared_ptr<const BulletManagerSnapshot> pendingDumpSnapshot;
+
+	std::vector<FrameRecord> pendingDumpFrames;
+
+	std::string pendingDumpPath;
+
+	std::mutex dumpMutex;
+
+	std::condition_variable dumpCondition;
+
+	bool bIsDumpPending = false;
+
+	bool bIsClosing = false;
+
+	std::thread writerThread;
+};
@@ -2,8 +2,20 @@
 
 #include "SDL.h"
 
+#include "SoftwareRasterizer.h"
+
 #include <iostream>
 
+#include <algorithm>
+
+#include <cmath>
+
+#include <limits>
+
+#include <thread>
+
+static_assert(sizeof(Vector2) == sizeof(SDL_FPoint), "Vector2 buffers are passed to SDL as SDL_FPoint arrays");
+
 
 GraphicsSystem::GraphicsSystem()
 {
@@ -26,9 +38,47 @@ GraphicsSystem::GraphicsSystem()
 	}
 }
 
+GraphicsSystem::GraphicsSystem(int offscreenWidth, int offscreenHeight)
+{
+	offscreenSurface = SDL_CreateRGBSurfaceWithFormat(0, offscreenWidth, offscreenHeight, 32, SDL_PIXELFORMAT_ARGB8888);
+	if (offscreenSurface == nullptr)
+	{
+		std::cout << "SDL_CreateRGBSurfaceWithFormat Error: " << SDL_GetError() << std::endl;
+		return;
+	}
+
+	ren = SDL_CreateSoftwareRenderer(offscreenSurface);
+	if (ren == nullptr)
+	{
+		std::cout << "SDL_CreateSoftwareRenderer Error: " << SDL_GetError() << std::endl;
+		return;
+	}
+
+	bWereGraphicsInitialized = true;
+}
+
 GraphicsSystem::~GraphicsSystem()
 {
-	if (bWereGraphicsInitialized)
+	if (wallLayer != nullptr)
+	{
+		SDL_DestroyTexture(wallLayer);
+	}
+
+	if (softwareFrame != nullptr)
+	{
+		SDL_DestroyTexture(softwareFrame);
+	}
+
+	if (offscreenSurface != nullptr)
+	{
+		if (ren != nullptr)
+		{
+			SDL_DestroyRenderer(ren);
+		}
+
+		SDL_FreeSurface(offscreenSurface);
+	}
+	else if (bWereGraphicsInitialized)
 	{
 		if (win != nullptr)
 		{
@@ -66,6 +116,16 @@ static InputResult GetInputInternal(const SDL_Event& Event, Vector2& start, Vect
 		{
 			return InputResult::Exit;
 		}
+
+		if (Event.key.keysym.scancode == SDL_Scancode::SDL_SCANCODE_SPACE)
+		{
+			return InputResult::TogglePause;
+		}
+
+		if (Event.key.keysym.scancode == SDL_Scancode::SDL_SCANCODE_BACKSPACE)
+		{
+			return InputResult::Rewind;
+		}
 	}
 
 	if (bIsLeftMouseButton)
@@ -98,8 +158,19 @@ InputResult GraphicsSystem::GetInput(Vector2& start, Vector2& end)
 
 	while (SDL_PollEvent(&Event) != 0)
 	{
+		if (HandleNavigation(Event))
+		{
+			continue;
+		}
+
 		InputResult result = GetInputInternal(Event, start, end);
 
+		if (result == InputResult::LaunchBullet)
+		{
+			start = ScreenToWorld(start);
+			end = ScreenToWorld(end);
+		}
+
 		if (result != InputResult::None)
 		{
 			return result;
@@ -109,32 +180,486 @@ InputResult GraphicsSystem::GetInput(Vector2& start, Vector2& end)
 	return InputResult::None;
 }
 
+bool GraphicsSystem::HandleNavigation(const SDL_Event& event)
+{
+	constexpr float zoomStep = 1.25f;
+	constexpr float minViewScale = 0.01f;
+	constexpr float maxViewScale = 100;
+
+	// in pixels
+	constexpr float panStep = 64;
+
+	if (event.type == SDL_EventType::SDL_MOUSEWHEEL && event.wheel.y != 0)
+	{
+		int mouseX;
+		int mouseY;
+
+		SDL_GetMouseState(&mouseX, &mouseY);
+
+		const Vector2 cursor{ static_cast<float>(mouseX), static_cast<float>(mouseY) };
+
+		// keep the world location under the cursor in place
+		const Vector2 cursorLocation = ScreenToWorld(cursor);
+
+		viewScale = std::fmin(maxViewScale, std::fmax(minViewScale, viewScale * std::pow(zoomStep, static_cast<float>(event.wheel.y))));
+
+		viewOrigin = cursorLocation - cursor / viewScale;
+
+		bIsWallLayerStale = true;
+
+		return true;
+	}
+
+	if (event.type == SDL_EventType::SDL_MOUSEMOTION && (event.motion.state & SDL_BUTTON_RMASK) != 0)
+	{
+		viewOrigin = viewOrigin - Vector2{ static_cast<float>(event.motion.xrel), static_cast<float>(event.motion.yrel) } / viewScale;
+
+		bIsWallLayerStale = true;
+
+		return true;
+	}
+
+	if (event.type == SDL_EventType::SDL_KEYDOWN)
+	{
+		Vector2 pan = Vector2::Zero;
+
+		switch (event.key.keysym.scancode)
+		{
+		case SDL_Scancode::SDL_SCANCODE_LEFT:
+			pan = Vector2{ -panStep, 0 };
+			break;
+		case SDL_Scancode::SDL_SCANCODE_RIGHT:
+			pan = Vector2{ panStep, 0 };
+			break;
+		case SDL_Scancode::SDL_SCANCODE_UP:
+			pan = Vector2{ 0, -panStep };
+			break;
+		case SDL_Scancode::SDL_SCANCODE_DOWN:
+			pan = Vector2{ 0, panStep };
+			break;
+		default:
+			return false;
+		}
+
+		viewOrigin = viewOrigin + pan / viewScale;
+
+		bIsWallLayerStale = true;
+
+		return true;
+	}
+
+	return false;
+}
+
+void GraphicsSystem::GetViewBox(Vector2& outViewMin, Vector2& outViewMax) const
+{
+	int width = 0;
+	int height = 0;
+
+	SDL_GetRendererOutputSize(ren, &width, &height);
+
+	// bullets are drawn as 12 pixel squares around their location
+	constexpr float bulletMargin = 6;
+
+	outViewMin = ScreenToWorld(Vector2{ -bulletMargin, -bulletMargin });
+	outViewMax = ScreenToWorld(Vector2{ width + bulletMargin, height + bulletMargin });
+}
+
 void GraphicsSystem::Render(const GraphicsState& GraphicsState)
 {
+	static_assert(sizeof(RenderRect) == sizeof(SDL_FRect), "Bullet rects are passed to SDL as an SDL_FRect array");
+
+	if (GraphicsState.bullets.size() > softwareRasterizerBulletsThreshold)
+	{
+		RenderSoftware(GraphicsState);
+		return;
+	}
+
+	if (wallLayer == nullptr || GraphicsState.wallsRevision != wallLayerRevision || bIsWallLayerStale)
+	{
+		RebuildWallLayer(GraphicsState);
+	}
+	else
+	{
+		EraseDestroyedWalls(GraphicsState);
+	}
+
 	SDL_SetRenderDrawColor(ren, 0,0,0,255);
 
 	//First clear the renderer
 	SDL_RenderClear(ren);
 
-	SDL_SetRenderDrawColor(ren, 200, 0, 0, 255);
-
-	for (const GraphicsState::Wall& wall : GraphicsState.walls)
+	if (wallLayer != nullptr)
 	{
-		SDL_RenderDrawLine(ren, wall.start.X, wall.start.Y, wall.end.X, wall.end.Y);
+		SDL_RenderCopy(ren, wallLayer, nullptr, nullptr);
+	}
+	else
+	{
+		// no render target support, draw the walls every frame
+		DrawWalls(GraphicsState.walls);
 	}
 
 	SDL_SetRenderDrawColor(ren, 0, 255, 0, 255);
 
-	for (const GraphicsState::Bullet& bullet : GraphicsState.bullets)
+	if (GraphicsState.bullets.size() > pointSpriteBulletsThreshold)
 	{
-		const SDL_Rect bulletRect{bullet.location.X - 6, bullet.location.Y - 6, 12, 12};
+		bulletPoints.clear();
 
-		SDL_RenderDrawRect(ren, &bulletRect);
+		for (const GraphicsState::Bullet& bullet : GraphicsState.bullets)
+		{
+			bulletPoints.push_back(WorldToScreen(bullet.location));
+		}
+
+		SDL_RenderDrawPointsF(ren, reinterpret_cast<const SDL_FPoint*>(bulletPoints.data()), static_cast<int>(bulletPoints.size()));
+	}
+	else
+	{
+		bulletRects.clear();
+
+		for (const GraphicsState::Bullet& bullet : GraphicsState.bullets)
+		{
+			const Vector2 location = WorldToScreen(bullet.location);
+
+			bulletRects.push_back({ location.X - 6, location.Y - 6, 12, 12 });
+		}
+
+		SDL_RenderDrawRectsF(ren, reinterpret_cast<const SDL_FRect*>(bulletRects.data()), static_cast<int>(bulletRects.size()));
 	}
 
 	SDL_RenderPresent(ren);
 }
 
+void GraphicsSystem::RenderSoftware(const GraphicsState& graphicsState)
+{
+	int width;
+	int height;
+
+	if (SDL_GetRendererOutputSize(ren, &width, &height) != 0)
+	{
+		return;
+	}
+
+	if (!softwareRasterizer)
+	{
+		const int threadsCount = static_cast<int>(std::thread::hardware_concurrency());
+
+		softwareRasterizer = std::make_unique<SoftwareRasterizer>(threadsCount > 0 ? threadsCount : 4);
+	}
+
+	if (softwareFrame == nullptr || width != softwareFrameWidth || height != softwareFrameHeight)
+	{
+		if (softwareFrame != nullptr)
+		{
+			SDL_DestroyTexture(softwareFrame);
+		}
+
+		softwareFrame = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+
+		if (softwareFrame == nullptr)
+		{
+			std::cout << "SDL_CreateTexture Error: " << SDL_GetError() << std::endl;
+			return;
+		}
+
+		softwareFrameWidth = width;
+		softwareFrameHeight = height;
+	}
+
+	softwareRasterizer->Render(graphicsState, width, height, viewOrigin, viewScale);
+
+	SDL_UpdateTexture(softwareFrame, nullptr, softwareRasterizer->GetPixels(), softwareRasterizer->GetPitch());
+
+	SDL_RenderCopy(ren, softwareFrame, nullptr, nullptr);
+
+	SDL_RenderPresent(ren);
+
+	// destroyed walls were not patched into the layer meanwhile
+	bIsWallLayerStale = true;
+}
+
+void GraphicsSystem::DrawWalls(const std::vector<GraphicsState::Wall>& walls)
+{
+	SDL_SetRenderDrawColor(ren, 200, 0, 0, 255);
+
+	// SDL can only batch connected lines, so walls that continue each other are merged into one polyline
+	wallPolyline.clear();
+
+	for (const GraphicsState::Wall& wall : walls)
+	{
+		const Vector2 start = WorldToScreen(wall.start);
+
+		if (wallPolyline.empty() || wallPolyline.rbegin()->X != start.X || wallPolyline.rbegin()->Y != start.Y)
+		{
+			FlushWallPolyline();
+
+			wallPolyline.push_back(start);
+		}
+
+		wallPolyline.push_back(WorldToScreen(wall.end));
+	}
+
+	FlushWallPolyline();
+}
+
+void GraphicsSystem::RebuildWallLayer(const GraphicsState& graphicsState)
+{
+	if (wallLayer == nullptr)
+	{
+		if (!SDL_RenderTargetSupported(ren))
+		{
+			return;
+		}
+
+		int width;
+		int height;
+
+		if (SDL_GetRendererOutputSize(ren, &width, &height) != 0)
+		{
+			return;
+		}
+
+		wallLayer = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+
+		if (wallLayer == nullptr)
+		{
+			std::cout << "SDL_CreateTexture Error: " << SDL_GetError() << std::endl;
+			return;
+		}
+	}
+
+	SDL_SetRenderTarget(ren, wallLayer);
+
+	SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+
+	SDL_RenderClear(ren);
+
+	DrawWalls(graphicsState.walls);
+
+	SDL_SetRenderTarget(ren, nullptr);
+
+	wallLayerRevision = graphicsState.wallsRevision;
+
+	bIsWallLayerStale = false;
+
+	BucketLayerWalls(graphicsState.walls);
+}
+
+void GraphicsSystem::BucketLayerWalls(const std::vector<GraphicsState::Wall>& walls)
+{
+	layerWalls = walls;
+
+	layerWallsErased.assign(walls.size(), 0);
+	layerWallsVisitStamps.assign(walls.size(), 0);
+	layerVisitStamp = 0;
+
+	Vector2 boundsMin{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	Vector2 boundsMax{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+	for (const GraphicsState::Wall& wall : walls)
+	{
+		boundsMin = Vector2{ std::fmin(boundsMin.X, std::fmin(wall.start.X, wall.end.X)), std::fmin(boundsMin.Y, std::fmin(wall.start.Y, wall.end.Y)) };
+		boundsMax = Vector2{ std::fmax(boundsMax.X, std::fmax(wall.start.X, wall.end.X)), std::fmax(boundsMax.Y, std::fmax(wall.start.Y, wall.end.Y)) };
+	}
+
+	if (walls.empty())
+	{
+		boundsMin = Vector2::Zero;
+		boundsMax = Vector2::Zero;
+	}
+
+	// square cells, about one wall per cell
+	constexpr int maxCellsPerSide = 1024;
+
+	const int cellsPerSide = std::max(1, std::min(maxCellsPerSide, static_cast<int>(std::ceil(std::sqrt(static_cast<float>(walls.size()))))));
+
+	constexpr float minimalCellSize = 1e-3f;
+
+	layerCellSize = std::fmax(minimalCellSize, std::fmax(boundsMax.X - boundsMin.X, boundsMax.Y - boundsMin.Y) / cellsPerSide);
+
+	layerCellsX = std::max(1, std::min(cellsPerSide, static_cast<int>(std::ceil((boundsMax.X - boundsMin.X) / layerCellSize))));
+	layerCellsY = std::max(1, std::min(cellsPerSide, static_cast<int>(std::ceil((boundsMax.Y - boundsMin.Y) / layerCellSize))));
+
+	layerGridOrigin = boundsMin;
+
+	layerCellStarts.assign(layerCellsX * layerCellsY + 1, 0);
+
+	// counted first and then filled, every wall going into the cells its bounding box overlaps
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (int wallIndex = 0; wallIndex < static_cast<int>(walls.size()); ++wallIndex)
+		{
+			const GraphicsState::Wall& wall = walls[wallIndex];
+
+			const int minCellX = GetLayerCellCoordinate(std::fmin(wall.start.X, wall.end.X) - layerGridOrigin.X, layerCellsX);
+			const int maxCellX = GetLayerCellCoordinate(std::fmax(wall.start.X, wall.end.X) - layerGridOrigin.X, layerCellsX);
+			const int minCellY = GetLayerCellCoordinate(std::fmin(wall.start.Y, wall.end.Y) - layerGridOrigin.Y, layerCellsY);
+			const int maxCellY = GetLayerCellCoordinate(std::fmax(wall.start.Y, wall.end.Y) - layerGridOrigin.Y, layerCellsY);
+
+			for (int cellY = minCellY; cellY <= maxCellY; ++cellY)
+			{
+				for (int cellX = minCellX; cellX <= maxCellX; ++cellX)
+				{
+					const int cellIndex = cellY * layerCellsX + cellX;
+
+					if (pass == 0)
+					{
+						++layerCellStarts[cellIndex + 1];
+					}
+					else
+					{
+						// the starts are moved on while filling and put back afterwards
+						layerCellWalls[layerCellStarts[cellIndex]++] = wallIndex;
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (int cellIndex = 0; cellIndex < layerCellsX * layerCellsY; ++cellIndex)
+			{
+				layerCellStarts[cellIndex + 1] += layerCellStarts[cellIndex];
+			}
+
+			layerCellWalls.resize(layerCellStarts.back());
+		}
+	}
+
+	for (int cellIndex = layerCellsX * layerCellsY; cellIndex > 0; --cellIndex)
+	{
+		layerCellStarts[cellIndex] = layerCellStarts[cellIndex - 1];
+	}
+
+	layerCellStarts[0] = 0;
+}
+
+int GraphicsSystem::GetLayerCellCoordinate(float offset, int cellsCount) const
+{
+	const int coordinate = static_cast<int>(std::floor(offset / layerCellSize));
+
+	return coordinate < 0 ? 0 : (coordinate >= cellsCount ? cellsCount - 1 : coordinate);
+}
+
+template <class TVisitor>
+void GraphicsSystem::ForEachLayerWallInBox(const Vector2& boxMin, const Vector2& boxMax, TVisitor visitor)
+{
+	if (layerWalls.empty())
+	{
+		return;
+	}
+
+	if (++layerVisitStamp == 0)
+	{
+		std::fill(layerWallsVisitStamps.begin(), layerWallsVisitStamps.end(), 0);
+
+		layerVisitStamp = 1;
+	}
+
+	const int minCellX = GetLayerCellCoordinate(boxMin.X - layerGridOrigin.X, layerCellsX);
+	const int maxCellX = GetLayerCellCoordinate(boxMax.X - layerGridOrigin.X, layerCellsX);
+	const int minCellY = GetLayerCellCoordinate(boxMin.Y - layerGridOrigin.Y, layerCellsY);
+	const int maxCellY = GetLayerCellCoordinate(boxMax.Y - layerGridOrigin.Y, layerCellsY);
+
+	for (int cellY = minCellY; cellY <= maxCellY; ++cellY)
+	{
+		for (int cellX = minCellX; cellX <= maxCellX; ++cellX)
+		{
+			const int cellIndex = cellY * layerCellsX + cellX;
+
+			for (int entryIndex = layerCellStarts[cellIndex]; entryIndex < layerCellStarts[cellIndex + 1]; ++entryIndex)
+			{
+				const int wallIndex = layerCellWalls[entryIndex];
+
+				if (layerWallsVisitStamps[wallIndex] == layerVisitStamp || layerWallsErased[wallIndex] != 0)
+				{
+					continue;
+				}
+
+				layerWallsVisitStamps[wallIndex] = layerVisitStamp;
+
+				const GraphicsState::Wall& wall = layerWalls[wallIndex];
+
+				if (std::fmax(wall.start.X, wall.end.X) < boxMin.X || std::fmin(wall.start.X, wall.end.X) > boxMax.X || std::fmax(wall.start.Y, wall.end.Y) < boxMin.Y || std::fmin(wall.start.Y, wall.end.Y) > boxMax.Y)
+				{
+					continue;
+				}
+
+				visitor(wallIndex);
+			}
+		}
+	}
+}
+
+void GraphicsSystem::EraseDestroyedWalls(const GraphicsState& graphicsState)
+{
+	if (graphicsState.destroyedWalls.empty())
+	{
+		return;
+	}
+
+	SDL_SetRenderTarget(ren, wallLayer);
+
+	for (const GraphicsState::Wall& destroyedWall : graphicsState.destroyedWalls)
+	{
+		// clear the bounding box of the destroyed wall and redraw the surviving walls that pass through it
+		const float damagePadding = 1 / viewScale;
+
+		const float minX = std::fmin(destroyedWall.start.X, destroyedWall.end.X) - damagePadding;
+		const float minY = std::fmin(destroyedWall.start.Y, destroyedWall.end.Y) - damagePadding;
+		const float maxX = std::fmax(destroyedWall.start.X, destroyedWall.end.X) + damagePadding;
+		const float maxY = std::fmax(destroyedWall.start.Y, destroyedWall.end.Y) + damagePadding;
+
+		const Vector2 screenMin = WorldToScreen(Vector2{ minX, minY });
+		const Vector2 screenMax = WorldToScreen(Vector2{ maxX, maxY });
+
+		const SDL_Rect damagedRect{ static_cast<int>(std::floor(screenMin.X)), static_cast<int>(std::floor(screenMin.Y)), static_cast<int>(std::ceil(screenMax.X - screenMin.X)) + 1, static_cast<int>(std::ceil(screenMax.Y - screenMin.Y)) + 1 };
+
+		// taken off the layer first, so that neither this patch nor a later one draws it back
+		bool bWasErased = false;
+
+		ForEachLayerWallInBox(Vector2{ minX, minY }, Vector2{ maxX, maxY }, [this, &destroyedWall, &bWasErased](int wallIndex)
+		{
+			const GraphicsState::Wall& wall = layerWalls[wallIndex];
+
+			if (!bWasErased && wall.start.X == destroyedWall.start.X && wall.start.Y == destroyedWall.start.Y && wall.end.X == destroyedWall.end.X && wall.end.Y == destroyedWall.end.Y)
+			{
+				layerWallsErased[wallIndex] = 1;
+
+				bWasErased = true;
+			}
+		});
+
+		damagedWalls.clear();
+
+		ForEachLayerWallInBox(Vector2{ minX, minY }, Vector2{ maxX, maxY }, [this](int wallIndex)
+		{
+			damagedWalls.push_back(layerWalls[wallIndex]);
+		});
+
+		SDL_RenderSetClipRect(ren, &damagedRect);
+
+		SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
+
+		SDL_RenderFillRect(ren, &damagedRect);
+
+		DrawWalls(damagedWalls);
+	}
+
+	SDL_RenderSetClipRect(ren, nullptr);
+
+	SDL_SetRenderTarget(ren, nullptr);
+}
+
+void GraphicsSystem::FlushWallPolyline()
+{
+	if (wallPolyline.size() >= 2)
+	{
+		SDL_RenderDrawLinesF(ren, reinterpret_cast<const SDL_FPoint*>(wallPolyline.data()), static_cast<int>(wallPolyline.size()));
+	}
+
+	wallPolyline.clear();
+}
+
 void GraphicsSystem::Sleep(int millisecondsToSleep)
 {
 	SDL_Delay(millisecondsToSleep);
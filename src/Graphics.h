@@ -4,6 +4,8 @@
 
 #include <vector>
 
+#include <memory>
+
 struct GraphicsState
 {
 	struct Wall
@@ -20,6 +22,38 @@ struct GraphicsState
 
 	std::vector<Wall> walls;
 	std::vector<Bullet> bullets;
+
+	// walls destroyed since the previous state; they are no longer in walls
+	std::vector<Wall> destroyedWalls;
+
+	// the cached wall layer is only patched while this stays the same
+	unsigned int wallsRevision = 0;
+};
+
+// what changed since the previous delta; a bullet keeps flying in a straight line until it's reported again
+struct GraphicsStateDelta
+{
+	struct Bullet
+	{
+		unsigned int id;
+		Vector2 location;
+		Vector2 velocity;
+	};
+
+	// the time the locations are given for
+	float time = 0;
+
+	std::vector<Bullet> spawnedBullets;
+	std::vector<Bullet> reflectedBullets;
+
+	// may also list bullets that were never reported as spawned
+	std::vector<unsigned int> expiredBulletIds;
+
+	std::vector<GraphicsState::Wall> destroyedWalls;
+
+	// set when all walls were replaced, e.g. on the first delta or when tiles were paged; walls then lists every live wall
+	bool bWereWallsReplaced = false;
+	std::vector<GraphicsState::Wall> walls;
 };
 
 class GraphicsSystem
@@ -27,16 +61,101 @@ class GraphicsSystem
 public:
 	GraphicsSystem();
 
+	// renders into an offscreen surface with the software renderer, no window is created
+	GraphicsSystem(int offscreenWidth, int offscreenHeight);
+
 	~GraphicsSystem();
 
+	// the mouse wheel zooms around the cursor, the arrow keys and dragging with the right button pan the view;
+	// space pauses and backspace rewinds. The returned positions are in world coordinates
 	InputResult GetInput(Vector2& start, Vector2& end);
 
+	// the part of the world currently on screen, with a margin for the size of the bullets
+	void GetViewBox(Vector2& outViewMin, Vector2& outViewMax) const;
+
 	void Render(const GraphicsState& GraphicsState);
 
 	void Sleep(int millisecondsToSleep);
 
 	bool bWereGraphicsInitialized = false;
+
+	// above this many bullets every bullet is drawn as a single point
+	size_t pointSpriteBulletsThreshold = 20000;
+
+	// above this many bullets the frame is rasterised on the CPU and uploaded as a single texture
+	size_t softwareRasterizerBulletsThreshold = 300000;
 private:
+	void RenderSoftware(const GraphicsState& graphicsState);
+
+	bool HandleNavigation(const union SDL_Event& event);
+
+	Vector2 WorldToScreen(const Vector2& location) const { return (location - viewOrigin) * viewScale; }
+
+	Vector2 ScreenToWorld(const Vector2& location) const { return viewOrigin + location / viewScale; }
+
+	void DrawWalls(const std::vector<GraphicsState::Wall>& walls);
+
+	void FlushWallPolyline();
+
+	void RebuildWallLayer(const GraphicsState& graphicsState);
+
+	void EraseDestroyedWalls(const GraphicsState& graphicsState);
+
+	void BucketLayerWalls(const std::vector<GraphicsState::Wall>& walls);
+
+	int GetLayerCellCoordinate(float offset, int cellsCount) const;
+
+	// calls visitor(layerWallIndex) once for every wall of the layer not erased yet whose bounding box overlaps the box
+	template <class TVisitor>
+	void ForEachLayerWallInBox(const Vector2& boxMin, const Vector2& boxMax, TVisitor visitor);
+
 	struct SDL_Window* win = nullptr;
 	struct SDL_Renderer* ren = nullptr;
+	struct SDL_Surface* offscreenSurface = nullptr;
+
+	// the world location shown in the top left corner and the pixels per world unit
+	Vector2 viewOrigin = Vector2::Zero;
+	float viewScale = 1;
+
+	// the walls drawn once into a render target, patched when walls get destroyed
+	struct SDL_Texture* wallLayer = nullptr;
+	unsigned int wallLayerRevision = 0;
+	// set when the view changes or frames were drawn without the layer
+	bool bIsWallLayerStale = false;
+
+	std::unique_ptr<class SoftwareRasterizer> softwareRasterizer;
+	struct SDL_Texture* softwareFrame = nullptr;
+	int softwareFrameWidth = 0;
+	int softwareFrameHeight = 0;
+
+	// same layout as SDL_FRect
+	struct RenderRect
+	{
+		float x;
+		float y;
+		float w;
+		float h;
+	};
+
+	// draw buffers are kept between frames to avoid reallocating them
+	std::vector<Vector2> wallPolyline;
+	std::vector<Vector2> bulletPoints;
+	std::vector<RenderRect> bulletRects;
+	std::vector<GraphicsState::Wall> damagedWalls;
+
+	// the walls drawn into the layer, bucketed once per rebuild by their bounding boxes into a uniform grid,
+	// so that patching a destroyed wall only looks at the walls around it
+	std::vector<GraphicsState::Wall> layerWalls;
+	// set for the walls erased from the layer since the rebuild
+	std::vector<unsigned char> layerWallsErased;
+	// the query that last visited the wall, so that a wall in several cells is visited once
+	std::vector<unsigned int> layerWallsVisitStamps;
+	unsigned int layerVisitStamp = 0;
+	// the walls of every cell back to back
+	std::vector<int> layerCellStarts;
+	std::vector<int> layerCellWalls;
+	Vector2 layerGridOrigin = Vector2::Zero;
+	float layerCellSize = 1;
+	int layerCellsX = 0;
+	int layerCellsY = 0;
 };
@@ -0,0 +1,2171 @@
+#include <iostream>
+
+#include <chrono>
+
+#include <string>
+
+#include <algorithm>
+
+#include "BulletManager.h"
+#include "FlightRecorder.h"
+#include "MappedFile.h"
+#include "Scenario.h"
+#include "StreamingJsonLoader.h"
+#include "BulletSchedule.h"
+#include "WallTileStore.h"
+#include "WorldBatch.h"
+#include "Checkpoint.h"
+#include "EventTrace.h"
+#include "Graphics.h"
+#include "SharedState.h"
+#include "BulletCommandRing.h"
+#include "ShardedSimulation.h"
+#include "ParallelUtils.h"
+#include "WallGrid.h"
+
+#include <thread>
+
+#include <fstream>
+
+#include <random>
+
+#include <cstdio>
+
+#include <cstring>
+
+#include <tuple>
+
+#include <limits>
+
+static int PrintUsage()
+{
+	std::cout << "Usage:" << std::endl;
+	std::cout << "\tBulletsHeadless replay <dump.bfr>" << std::endl;
+	std::cout << "\tBulletsHeadless convert <walls.json> <bullets.json> <scenario.bscn>" << std::endl;
+	std::cout << "\tBulletsHeadless bench-load <walls.json> <bullets.json> <scenario.bscn>" << std::endl;
+	std::cout << "\tBulletsHeadless make-schedule <bullets.json> <schedule.bsch>" << std::endl;
+	std::cout << "\tBulletsHeadless run-schedule <walls.json> <schedule.bsch> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless make-tiles <walls.json> <tiles.btil> <tile size>" << std::endl;
+	std::cout << "\tBulletsHeadless run-tiles <tiles.btil> <bullets.json> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless solve <walls.json> <bullets.json> [destruction log.csv]" << std::endl;
+	std::cout << "\tBulletsHeadless bench-worlds <walls.json> <bullets.json> <worlds count> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless bench-hash <walls.json> <bullets.json> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless bench-regions <walls.json> <bullets.json> <seconds> <regions count>" << std::endl;
+	std::cout << "\tBulletsHeadless bench-cells <walls.json> <bullets.json> <seconds> <cell size>" << std::endl;
+	std::cout << "\tBulletsHeadless bench-dt <walls.json> <bullets.json> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless bench-broad-phase <walls.json> <bullets.json> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless checkpoint <walls.json> <bullets.json> <seconds> <checkpoint.bckp>" << std::endl;
+	std::cout << "\tBulletsHeadless rollback <walls.json> <bullets.json> <seconds> <rollback seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless trajectories <walls.json> <bullets.json> <seconds> <trajectories.csv>" << std::endl;
+	std::cout << "\tBulletsHeadless trace <walls.json> <bullets.json> <seconds> <trace.btrc>" << std::endl;
+	std::cout << "\tBulletsHeadless play-trace <trace.btrc> <frames count>" << std::endl;
+	std::cout << "\tBulletsHeadless publish <walls.json> <bullets.json> <seconds> <shared memory name>" << std::endl;
+	std::cout << "\tBulletsHeadless watch <shared memory name> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless run-ring <walls.json> <seconds> <shared memory name> <ring capacity>" << std::endl;
+	std::cout << "\tBulletsHeadless shard-run <walls.json> <bullets.json> <seconds> <shards count> <sync interval>" << std::endl;
+	std::cout << "\tBulletsHeadless produce <shared memory name> <bullets per second, 0 for as fast as possible> <seconds>" << std::endl;
+	std::cout << "\tBulletsHeadless self-test" << std::endl;
+
+	return 1;
+}
+
+// reads the walls and bullets most commands start from, saying which of the two files failed
+static bool LoadScene(const std::string& wallsPath, const std::string& bulletsPath, std::vector<BulletManager::WallDefinition>& outWalls, std::vector<BulletManager::BulletDefinition>& outBullets)
+{
+	if (!LoadWallsFromJson(wallsPath, outWalls))
+	{
+		std::cout << "Failed to read walls from " << wallsPath << std::endl;
+		return false;
+	}
+
+	if (!LoadBulletsFromJson(bulletsPath, outBullets))
+	{
+		std::cout << "Failed to read bullets from " << bulletsPath << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static int Replay(const std::string& dumpPath)
+{
+	FlightRecorder::Dump dump;
+
+	if (!FlightRecorder::ReadDump(dumpPath, dump))
+	{
+		std::cout << "Failed to read dump " << dumpPath << std::endl;
+		return 1;
+	}
+
+	std::cout << "Replaying " << dump.frames.size() << " frames starting at " << dump.snapshot.currentTime << " with " << dump.snapshot.walls.size() << " walls and " << dump.snapshot.bullets.size() << " bullets" << std::endl;
+
+	BulletManager bulletManager(dump.snapshot);
+
+	// the recorded rewinds went back no further than the snapshot, so the journal has to reach back to it
+	bulletManager.SetRewindWindow(std::numeric_limits<float>::max());
+
+	std::chrono::high_resolution_clock clock;
+
+	for (size_t frameIndex = 0; frameIndex < dump.frames.size(); ++frameIndex)
+	{
+		const FlightRecorder::FrameRecord& frame = dump.frames[frameIndex];
+
+		std::chrono::microseconds updateDuration(0);
+
+		// in the order the recorded manager made them, so that the bullets end up in the same order
+		for (const FlightRecorder::FrameEvent& event : frame.events)
+		{
+			switch (event.type)
+			{
+			case FlightRecorder::FrameEvent::BulletAddition:
+				bulletManager.AddBullet(event.definition.startingPosition, event.definition.velocity, event.definition.startTime, event.definition.lifetime);
+				break;
+
+			case FlightRecorder::FrameEvent::ExpiredBulletsRemoval:
+				bulletManager.DropExpiredBullets();
+				break;
+
+			case FlightRecorder::FrameEvent::Update:
+			{
+				const auto timeBeforeUpdate = clock.now();
+
+				bulletManager.Update(event.time);
+
+				updateDuration += std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - timeBeforeUpdate);
+				break;
+			}
+
+			case FlightRecorder::FrameEvent::Rewind:
+				if (!bulletManager.RewindTo(event.time))
+				{
+					std::cout << "Frame " << frameIndex << " rewinds to " << event.time << ", before the start of the dump" << std::endl;
+					return 1;
+				}
+				break;
+			}
+		}
+
+		const auto updateMicroseconds = updateDuration.count();
+
+		std::cout << "Frame " << frameIndex << " recorded " << frame.frameDurationMs << " ms, replayed update " << (updateMicroseconds / 1000.0) << " ms" << std::endl;
+	}
+
+	return 0;
+}
+
+static int Convert(const std::string& wallsPath, const std::string& bulletsPath, const std::string& scenarioPath)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadWallsFromJson(wallsPath, walls))
+	{
+		std::cout << "Failed to read walls from " << wallsPath << std::endl;
+		return 1;
+	}
+
+	if (!LoadBulletsFromJson(bulletsPath, bullets))
+	{
+		std::cout << "Failed to read bullets from " << bulletsPath << ", writing the scenario without bullets" << std::endl;
+	}
+
+	if (!WriteBinaryScenario(scenarioPath, walls, bullets))
+	{
+		std::cout << "Failed to write " << scenarioPath << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote " << walls.size() << " walls and " << bullets.size() << " bullets to " << scenarioPath << std::endl;
+
+	return 0;
+}
+
+static int BenchmarkLoading(const std::string& wallsPath, const std::string& bulletsPath, const std::string& scenarioPath)
+{
+	constexpr int iterations = 5;
+
+	std::chrono::high_resolution_clock clock;
+
+	std::chrono::high_resolution_clock::duration jsonDuration(0);
+
+	std::chrono::high_resolution_clock::duration streamingDuration(0);
+
+	std::chrono::high_resolution_clock::duration binaryDuration(0);
+
+	const int chunksCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		const auto timeBeforeJson = clock.now();
+		{
+			std::vector<BulletManager::WallDefinition> walls;
+
+			std::vector<BulletManager::BulletDefinition> bullets;
+
+			LoadWallsFromJson(wallsPath, walls);
+
+			LoadBulletsFromJson(bulletsPath, bullets);
+
+			BulletManager bulletManager(walls, bullets);
+		}
+		const auto timeAfterJson = clock.now();
+
+		{
+			std::vector<BulletManager::Wall> walls;
+
+			std::vector<BulletManager::Bullet> bullets;
+
+			StreamWallsFromJson(wallsPath, walls, chunksCount);
+
+			StreamBulletsFromJson(bulletsPath, bullets, chunksCount);
+
+			BulletManager bulletManager(std::move(walls), std::move(bullets));
+		}
+		const auto timeAfterStreaming = clock.now();
+
+		{
+			MappedFile scenarioFile;
+
+			ScenarioView scenario;
+
+			if (!OpenBinaryScenario(scenarioPath, scenarioFile, scenario))
+			{
+				std::cout << "Failed to open " << scenarioPath << std::endl;
+				return 1;
+			}
+
+			BulletManager bulletManager(scenario);
+		}
+		const auto timeAfterBinary = clock.now();
+
+		jsonDuration += timeAfterJson - timeBeforeJson;
+
+		streamingDuration += timeAfterStreaming - timeAfterJson;
+
+		binaryDuration += timeAfterBinary - timeAfterStreaming;
+	}
+
+	const auto jsonMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(jsonDuration).count() / iterations;
+
+	const auto streamingMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(streamingDuration).count() / iterations;
+
+	const auto binaryMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(binaryDuration).count() / iterations;
+
+	std::cout << "json: " << (jsonMicroseconds / 1000.0) << " ms, streaming json: " << (streamingMicroseconds / 1000.0) << " ms, binary: " << (binaryMicroseconds / 1000.0) << " ms (average of " << iterations << " loads, including manager construction)" << std::endl;
+
+	return 0;
+}
+
+static int MakeSchedule(const std::string& bulletsPath, const std::string& schedulePath)
+{
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadBulletsFromJson(bulletsPath, bullets))
+	{
+		std::cout << "Failed to read bullets from " << bulletsPath << std::endl;
+		return 1;
+	}
+
+	if (!WriteBulletSchedule(schedulePath, bullets))
+	{
+		std::cout << "Failed to write " << schedulePath << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote " << bullets.size() << " bullets to " << schedulePath << std::endl;
+
+	return 0;
+}
+
+static int RunSchedule(const std::string& wallsPath, const std::string& schedulePath, float duration)
+{
+	const int chunksCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	std::vector<BulletManager::Wall> walls;
+
+	if (!StreamWallsFromJson(wallsPath, walls, chunksCount))
+	{
+		std::cout << "Failed to read walls from " << wallsPath << std::endl;
+		return 1;
+	}
+
+	std::unique_ptr<BulletScheduleReader> bulletSchedule = std::make_unique<BulletScheduleReader>();
+
+	if (!bulletSchedule->Open(schedulePath))
+	{
+		std::cout << "Failed to open " << schedulePath << std::endl;
+		return 1;
+	}
+
+	BulletManager bulletManager(std::move(walls), {});
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	bulletManager.SetBulletSchedule(std::move(bulletSchedule), deltaTime);
+
+	size_t peakBulletsCount = 0;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto timeBeforeRun = clock.now();
+
+	while (bulletManager.GetCurrentTime() < duration)
+	{
+		bulletManager.Update(deltaTime);
+
+		peakBulletsCount = std::max(peakBulletsCount, bulletManager.GetBulletsCount());
+	}
+
+	const auto runMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+
+	std::cout << "Simulated " << duration << " s in " << runMilliseconds << " ms, at most " << peakBulletsCount << " bullets were kept in memory" << std::endl;
+
+	return 0;
+}
+
+static int MakeTiles(const std::string& wallsPath, const std::string& tilesPath, float tileSize)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	if (!LoadWallsFromJson(wallsPath, walls))
+	{
+		std::cout << "Failed to read walls from " << wallsPath << std::endl;
+		return 1;
+	}
+
+	if (!WallTileStore::Write(tilesPath, walls, tileSize))
+	{
+		std::cout << "Failed to write " << tilesPath << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote " << walls.size() << " walls to " << tilesPath << std::endl;
+
+	return 0;
+}
+
+static int RunTiles(const std::string& tilesPath, const std::string& bulletsPath, float duration)
+{
+	std::unique_ptr<WallTileStore> wallTileStore = std::make_unique<WallTileStore>();
+
+	if (!wallTileStore->Open(tilesPath))
+	{
+		std::cout << "Failed to open " << tilesPath << std::endl;
+		return 1;
+	}
+
+	std::vector<BulletManager::Bullet> bullets;
+
+	StreamBulletsFromJson(bulletsPath, bullets, static_cast<int>(std::thread::hardware_concurrency()));
+
+	BulletManager bulletManager({}, std::move(bullets));
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	bulletManager.SetWallTileStore(std::move(wallTileStore), deltaTime);
+
+	size_t peakWallsCount = 0;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto timeBeforeRun = clock.now();
+
+	while (bulletManager.GetCurrentTime() < duration)
+	{
+		bulletManager.Update(deltaTime);
+
+		peakWallsCount = std::max(peakWallsCount, bulletManager.GetWallsCount());
+	}
+
+	const auto runMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+
+	std::cout << "Simulated " << duration << " s in " << runMilliseconds << " ms, at most " << peakWallsCount << " walls were resident" << std::endl;
+
+	return 0;
+}
+
+static int Solve(const std::string& wallsPath, const std::string& bulletsPath, const std::string& logPath)
+{
+	const int chunksCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	std::vector<BulletManager::Wall> walls;
+
+	std::vector<BulletManager::Bullet> bullets;
+
+	if (!StreamWallsFromJson(wallsPath, walls, chunksCount) || !StreamBulletsFromJson(bulletsPath, bullets, chunksCount))
+	{
+		std::cout << "Failed to read " << wallsPath << " or " << bulletsPath << std::endl;
+		return 1;
+	}
+
+	BulletManager bulletManager(std::move(walls), std::move(bullets));
+
+	std::vector<BulletManager::WallDestruction> destructionLog;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto timeBeforeSolve = clock.now();
+
+	bulletManager.Solve(destructionLog);
+
+	const auto solveMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeSolve).count();
+
+	std::cout << "Solved until " << bulletManager.GetCurrentTime() << " s in " << solveMilliseconds << " ms, " << destructionLog.size() << " walls were destroyed" << std::endl;
+
+	if (logPath.empty())
+	{
+		return 0;
+	}
+
+	std::ofstream logStream(logPath);
+
+	logStream << "wall,time,bullet" << std::endl;
+
+	for (const BulletManager::WallDestruction& destruction : destructionLog)
+	{
+		logStream << destruction.wallIndex << "," << destruction.time << "," << destruction.bulletId << "\n";
+	}
+
+	if (!logStream)
+	{
+		std::cout << "Failed to write " << logPath << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int BenchmarkWorlds(const std::string& wallsPath, const std::string& bulletsPath, int worldsCount, float duration)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	const int threadsCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	std::chrono::high_resolution_clock::duration ownPoolsDuration(0);
+	{
+		std::vector<std::unique_ptr<BulletManager>> worlds;
+
+		for (int worldIndex = 0; worldIndex < worldsCount; ++worldIndex)
+		{
+			worlds.push_back(std::make_unique<BulletManager>(walls, bullets));
+		}
+
+		const auto timeBeforeRun = clock.now();
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			for (const std::unique_ptr<BulletManager>& world : worlds)
+			{
+				world->Update(deltaTime);
+			}
+		}
+
+		ownPoolsDuration = clock.now() - timeBeforeRun;
+	}
+
+	std::chrono::high_resolution_clock::duration sharedPoolDuration(0);
+	{
+		ThreadPool threadPool(threadsCount);
+
+		WorldBatch worldBatch(threadPool, threadsCount);
+
+		std::vector<std::unique_ptr<BulletManager>> worlds;
+
+		for (int worldIndex = 0; worldIndex < worldsCount; ++worldIndex)
+		{
+			worlds.push_back(std::make_unique<BulletManager>(walls, bullets));
+
+			worldBatch.AddWorld(**worlds.rbegin());
+		}
+
+		const auto timeBeforeRun = clock.now();
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			worldBatch.Update(deltaTime);
+		}
+
+		sharedPoolDuration = clock.now() - timeBeforeRun;
+	}
+
+	const auto ownPoolsMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(ownPoolsDuration).count();
+
+	const auto sharedPoolMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(sharedPoolDuration).count();
+
+	std::cout << worldsCount << " worlds for " << duration << " s: a pool per world " << ownPoolsMilliseconds << " ms (" << worldsCount * threadsCount << " threads), shared pool " << sharedPoolMilliseconds << " ms (" << threadsCount << " threads)" << std::endl;
+
+	return 0;
+}
+
+// runs the scenario without and with the state hash on all threads, then with the hash on one thread,
+// and checks that the hashes of every frame are the same for both thread counts
+static int BenchmarkStateHash(const std::string& wallsPath, const std::string& bulletsPath, float duration)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto run = [&](bool bHashState, bool bUseOneThread, std::vector<unsigned long long>& outFrameHashes)
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		if (bUseOneThread)
+		{
+			bulletManager.SetThreadPool(nullptr, 1);
+		}
+
+		if (bHashState)
+		{
+			outFrameHashes.push_back(bulletManager.GetStateHash());
+		}
+
+		const auto timeBeforeRun = clock.now();
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			bulletManager.Update(deltaTime);
+
+			if (bHashState)
+			{
+				outFrameHashes.push_back(bulletManager.GetStateHash());
+			}
+		}
+
+		return std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+	};
+
+	std::vector<unsigned long long> threadedHashes;
+
+	std::vector<unsigned long long> singleThreadHashes;
+
+	const auto withoutHashMilliseconds = run(false, false, threadedHashes);
+
+	const auto withHashMilliseconds = run(true, false, threadedHashes);
+
+	const auto singleThreadMilliseconds = run(true, true, singleThreadHashes);
+
+	std::cout << "All threads " << withoutHashMilliseconds << " ms, with the state hash " << withHashMilliseconds << " ms, one thread with the state hash " << singleThreadMilliseconds << " ms" << std::endl;
+
+	const auto mismatch = std::mismatch(threadedHashes.begin(), threadedHashes.end(), singleThreadHashes.begin());
+
+	if (mismatch.first != threadedHashes.end())
+	{
+		std::cout << "The hashes differ from frame " << mismatch.first - threadedHashes.begin() << std::endl;
+		return 1;
+	}
+
+	std::cout << "The hashes of all " << threadedHashes.size() << " frames match, last " << std::hex << threadedHashes.back() << std::dec << std::endl;
+
+	return 0;
+}
+
+// runs the scenario with the stages splitting the walls by index and then split into regions,
+// and checks that the hashes of every frame are the same
+static int BenchmarkRegions(const std::string& wallsPath, const std::string& bulletsPath, float duration, int regionsCount)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto run = [&](int worldRegionsCount, std::vector<unsigned long long>& outFrameHashes)
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		bulletManager.SetWorldRegions(worldRegionsCount);
+
+		outFrameHashes.push_back(bulletManager.GetStateHash());
+
+		const auto timeBeforeRun = clock.now();
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			bulletManager.Update(deltaTime);
+
+			outFrameHashes.push_back(bulletManager.GetStateHash());
+		}
+
+		return std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+	};
+
+	std::vector<unsigned long long> wallRangesHashes;
+
+	std::vector<unsigned long long> regionsHashes;
+
+	const auto wallRangesMilliseconds = run(0, wallRangesHashes);
+
+	const auto regionsMilliseconds = run(regionsCount, regionsHashes);
+
+	std::cout << "Wall ranges " << wallRangesMilliseconds << " ms, " << regionsCount << " regions " << regionsMilliseconds << " ms" << std::endl;
+
+	const auto mismatch = std::mismatch(wallRangesHashes.begin(), wallRangesHashes.end(), regionsHashes.begin());
+
+	if (mismatch.first != wallRangesHashes.end())
+	{
+		std::cout << "The hashes differ from frame " << mismatch.first - wallRangesHashes.begin() << std::endl;
+		return 1;
+	}
+
+	std::cout << "The hashes of all " << wallRangesHashes.size() << " frames match, last " << std::hex << wallRangesHashes.back() << std::dec << std::endl;
+
+	return 0;
+}
+
+// the collision cells order the hits of each island the way the global rounds order all of them, so the hashes have to match
+static int BenchmarkCollisionCells(const std::string& wallsPath, const std::string& bulletsPath, float duration, float cellSize)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto run = [&](float collisionCellSize, size_t& outDestroyedWallsCount, unsigned long long& outStateHash)
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		bulletManager.SetCollisionCells(collisionCellSize);
+
+		std::vector<BulletManager::WallDestruction> destructionLog;
+
+		bulletManager.SetWallDestructionLog(&destructionLog);
+
+		// starts tracking the hash, so that the runs pay for keeping it up to date alike
+		bulletManager.GetStateHash();
+
+		const auto timeBeforeRun = clock.now();
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			bulletManager.Update(deltaTime);
+		}
+
+		const auto runMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+
+		outDestroyedWallsCount = destructionLog.size();
+
+		outStateHash = bulletManager.GetStateHash();
+
+		return runMilliseconds;
+	};
+
+	size_t roundsDestroyedWallsCount = 0;
+
+	size_t cellsDestroyedWallsCount = 0;
+
+	unsigned long long roundsStateHash = 0;
+
+	unsigned long long cellsStateHash = 0;
+
+	const auto roundsMilliseconds = run(0, roundsDestroyedWallsCount, roundsStateHash);
+
+	const auto cellsMilliseconds = run(cellSize, cellsDestroyedWallsCount, cellsStateHash);
+
+	std::cout << "Global rounds " << roundsMilliseconds << " ms, " << roundsDestroyedWallsCount << " walls destroyed, hash " << std::hex << roundsStateHash << std::dec << std::endl;
+	std::cout << "Cells of " << cellSize << " " << cellsMilliseconds << " ms, " << cellsDestroyedWallsCount << " walls destroyed, hash " << std::hex << cellsStateHash << std::dec << std::endl;
+
+	if (cellsStateHash != roundsStateHash)
+	{
+		std::cout << "The hashes differ" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// runs the same time in frames of several lengths; Update slices the long ones, so the time per simulated second should stay about the same
+static int BenchmarkDeltaTimes(const std::string& wallsPath, const std::string& bulletsPath, float duration)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	std::chrono::high_resolution_clock clock;
+
+	for (const float deltaTime : { 1.0f / 60, 0.25f, 1.0f })
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		std::vector<BulletManager::WallDestruction> destructionLog;
+
+		bulletManager.SetWallDestructionLog(&destructionLog);
+
+		const int framesCount = std::max(1, static_cast<int>(std::lround(duration / deltaTime)));
+
+		const auto timeBeforeRun = clock.now();
+
+		for (int frameIndex = 0; frameIndex < framesCount; ++frameIndex)
+		{
+			bulletManager.Update(deltaTime);
+		}
+
+		const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+
+		std::cout << framesCount << " frames of " << deltaTime << " s: " << milliseconds << " ms, " << destructionLog.size() << " walls destroyed" << std::endl;
+	}
+
+	return 0;
+}
+
+// runs the scene with and without comparing the wall boxes with the bullet sweeps, the collision tests see the same walls otherwise
+static int BenchmarkBroadPhase(const std::string& wallsPath, const std::string& bulletsPath, float duration)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	for (const bool bTestWallBoxes : { false, true })
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		bulletManager.SetWallBoxTest(bTestWallBoxes);
+
+		const auto timeBeforeRun = clock.now();
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			bulletManager.Update(deltaTime);
+		}
+
+		const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+
+		const BulletManager::BroadPhaseStats& stats = bulletManager.GetBroadPhaseStats();
+
+		const double testedPairsCount = static_cast<double>(std::max(1ull, stats.testedPairsCount));
+
+		std::cout << (bTestWallBoxes ? "Wall boxes: " : "Cells only: ") << milliseconds << " ms, " << stats.testedPairsCount << " pairs from the wall grid, "
+			<< stats.rejectedPairsCount << " rejected by the bounding boxes (" << 100.0 * stats.rejectedPairsCount / testedPairsCount << "%), "
+			<< stats.hitPairsCount << " hits (" << 100.0 * stats.hitPairsCount / testedPairsCount << "%)" << std::endl;
+	}
+
+	return 0;
+}
+
+// checkpoints the simulation every simulated second while it runs, then restores the last checkpoint
+// and checks it against the state hash taken when it was started
+static int RunWithCheckpoints(const std::string& wallsPath, const std::string& bulletsPath, float duration, const std::string& checkpointPath)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	BulletManager bulletManager(walls, bullets);
+
+	int checkpointsCount = 0;
+
+	unsigned long long checkpointHash = 0;
+
+	std::chrono::high_resolution_clock::duration longestCheckpointStall(0);
+
+	float nextCheckpointTime = 0;
+
+	for (float time = 0; time < duration; time += deltaTime)
+	{
+		bulletManager.Update(deltaTime);
+
+		if (bulletManager.GetCurrentTime() < nextCheckpointTime || bulletManager.IsCheckpointInProgress())
+		{
+			continue;
+		}
+
+		const unsigned long long stateHash = bulletManager.GetStateHash();
+
+		const auto timeBeforeCheckpoint = clock.now();
+
+		if (!bulletManager.BeginCheckpoint(checkpointPath))
+		{
+			return 1;
+		}
+
+		longestCheckpointStall = std::max(longestCheckpointStall, clock.now() - timeBeforeCheckpoint);
+
+		checkpointHash = stateHash;
+
+		++checkpointsCount;
+
+		nextCheckpointTime = bulletManager.GetCurrentTime() + 1;
+	}
+
+	while (bulletManager.IsCheckpointInProgress())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	const auto timeBeforeRestore = clock.now();
+
+	MappedFile checkpointFile;
+
+	CheckpointView checkpoint;
+
+	if (!OpenCheckpoint(checkpointPath, checkpointFile, checkpoint))
+	{
+		std::cout << "Failed to open the checkpoint " << checkpointPath << std::endl;
+		return 1;
+	}
+
+	BulletManager restoredManager(checkpoint);
+
+	const auto restoreMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - timeBeforeRestore).count();
+
+	const auto stallMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(longestCheckpointStall).count();
+
+	std::cout << checkpointsCount << " checkpoints, longest stall " << stallMicroseconds << " us, restored " << checkpoint.wallsCount << " walls and " << checkpoint.bulletsCount << " bullets in " << restoreMicroseconds << " us" << std::endl;
+
+	if (restoredManager.GetStateHash() != checkpointHash)
+	{
+		std::cout << "The restored state differs from the checkpointed one" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// every simulated second rolls back and simulates the same frames again, which has to end in the same state
+static int RunWithRollbacks(const std::string& wallsPath, const std::string& bulletsPath, float duration, float rollbackDuration)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	const int rollbackFramesCount = std::max(1, static_cast<int>(rollbackDuration / deltaTime));
+
+	std::chrono::high_resolution_clock clock;
+
+	BulletManager bulletManager(walls, bullets);
+
+	bulletManager.SetRewindWindow(rollbackDuration + 1);
+
+	std::vector<float> frameStartTimes;
+
+	int rollbacksCount = 0;
+
+	std::chrono::high_resolution_clock::duration rewindsDuration(0);
+
+	std::chrono::high_resolution_clock::duration resimulationsDuration(0);
+
+	for (int frameIndex = 0; frameIndex * deltaTime < duration; ++frameIndex)
+	{
+		frameStartTimes.push_back(bulletManager.GetCurrentTime());
+
+		bulletManager.Update(deltaTime);
+
+		if ((frameIndex + 1) % 60 != 0 || static_cast<int>(frameStartTimes.size()) < rollbackFramesCount)
+		{
+			continue;
+		}
+
+		const unsigned long long stateHash = bulletManager.GetStateHash();
+
+		const auto timeBeforeRewind = clock.now();
+
+		if (!bulletManager.RewindTo(frameStartTimes[frameStartTimes.size() - rollbackFramesCount]))
+		{
+			std::cout << "Failed to rewind at " << bulletManager.GetCurrentTime() << std::endl;
+			return 1;
+		}
+
+		const auto timeAfterRewind = clock.now();
+
+		for (int resimulatedFrame = 0; resimulatedFrame < rollbackFramesCount; ++resimulatedFrame)
+		{
+			bulletManager.Update(deltaTime);
+		}
+
+		rewindsDuration += timeAfterRewind - timeBeforeRewind;
+
+		resimulationsDuration += clock.now() - timeAfterRewind;
+
+		++rollbacksCount;
+
+		if (bulletManager.GetStateHash() != stateHash)
+		{
+			std::cout << "The state after the rollback at " << bulletManager.GetCurrentTime() << " differs" << std::endl;
+			return 1;
+		}
+	}
+
+	const auto rewindsMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(rewindsDuration).count();
+
+	const auto resimulationsMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(resimulationsDuration).count();
+
+	std::cout << rollbacksCount << " rollbacks of " << rollbackFramesCount << " frames: rewinding " << rewindsMicroseconds << " us, simulating again " << resimulationsMilliseconds << " ms in total" << std::endl;
+
+	return 0;
+}
+
+// simulates with the trajectories recorded, times looking up past locations and exports the legs
+static int ExportTrajectories(const std::string& wallsPath, const std::string& bulletsPath, float duration, const std::string& csvPath)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	BulletManager bulletManager(walls, bullets);
+
+	bulletManager.SetTrajectoryRecording(true);
+
+	for (float time = 0; time < duration; time += deltaTime)
+	{
+		bulletManager.Update(deltaTime);
+	}
+
+	constexpr int queriedTimesCount = 100;
+
+	size_t foundLocationsCount = 0;
+
+	const auto timeBeforeQueries = clock.now();
+
+	for (int timeIndex = 0; timeIndex < queriedTimesCount; ++timeIndex)
+	{
+		const float time = bulletManager.GetCurrentTime() * timeIndex / queriedTimesCount;
+
+		for (unsigned int bulletId = 0; bulletId < bullets.size(); ++bulletId)
+		{
+			Vector2 location;
+
+			foundLocationsCount += bulletManager.GetBulletLocationAt(bulletId, time, location) ? 1 : 0;
+		}
+	}
+
+	const auto queriesMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - timeBeforeQueries).count();
+
+	std::cout << queriedTimesCount << " past frames of " << bullets.size() << " bullets looked up in " << queriesMicroseconds << " us, " << foundLocationsCount << " bullets were flying" << std::endl;
+
+	std::ofstream csvStream(csvPath);
+
+	csvStream << "bullet,time,x,y,vx,vy" << std::endl;
+
+	for (unsigned int bulletId = 0; bulletId < bullets.size(); ++bulletId)
+	{
+		const std::vector<BulletManager::BulletLeg>* legs = bulletManager.GetBulletTrajectory(bulletId);
+
+		if (legs == nullptr)
+		{
+			continue;
+		}
+
+		for (const BulletManager::BulletLeg& leg : *legs)
+		{
+			csvStream << bulletId << "," << leg.startTime << "," << leg.startingPosition.X << "," << leg.startingPosition.Y << "," << leg.velocity.X << "," << leg.velocity.Y << "\n";
+		}
+	}
+
+	if (!csvStream)
+	{
+		std::cout << "Failed to write " << csvPath << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// simulates the scenario without and then with the event trace, to show what tracing costs the simulation
+static int RecordTrace(const std::string& wallsPath, const std::string& bulletsPath, float duration, const std::string& tracePath)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto run = [&](EventTraceWriter* eventTrace)
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		const auto timeBeforeRun = clock.now();
+
+		bulletManager.SetEventTrace(eventTrace);
+
+		for (float time = 0; time < duration; time += deltaTime)
+		{
+			bulletManager.Update(deltaTime);
+		}
+
+		return std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeBeforeRun).count();
+	};
+
+	const auto withoutTraceMilliseconds = run(nullptr);
+
+	EventTraceWriter eventTrace;
+
+	if (!eventTrace.Open(tracePath))
+	{
+		std::cout << "Failed to open " << tracePath << std::endl;
+		return 1;
+	}
+
+	const auto withTraceMilliseconds = run(&eventTrace);
+
+	eventTrace.Close();
+
+	std::cout << "Simulated " << duration << " s in " << withoutTraceMilliseconds << " ms, with the trace in " << withTraceMilliseconds << " ms" << std::endl;
+
+	return 0;
+}
+
+// rebuilds evenly spaced frames of a trace
+static int PlayTrace(const std::string& tracePath, int framesCount)
+{
+	std::chrono::high_resolution_clock clock;
+
+	const auto timeBeforeOpen = clock.now();
+
+	EventTracePlayer player;
+
+	if (!player.Open(tracePath))
+	{
+		std::cout << "Failed to read the trace " << tracePath << std::endl;
+		return 1;
+	}
+
+	const auto timeAfterOpen = clock.now();
+
+	GraphicsState graphicsState;
+
+	size_t bulletsCount = 0;
+
+	for (int frameIndex = 1; frameIndex <= framesCount; ++frameIndex)
+	{
+		player.GenerateState(player.GetEndTime() * frameIndex / framesCount, graphicsState);
+
+		bulletsCount += graphicsState.bullets.size();
+	}
+
+	const auto openMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(timeAfterOpen - timeBeforeOpen).count();
+
+	const auto framesMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - timeAfterOpen).count();
+
+	std::cout << "Read " << player.GetEndTime() << " s of events in " << openMilliseconds << " ms, rebuilt " << framesCount << " frames with " << bulletsCount << " bullets in " << framesMilliseconds << " ms" << std::endl;
+
+	std::cout << "The last frame has " << graphicsState.walls.size() << " walls and " << graphicsState.bullets.size() << " bullets" << std::endl;
+
+	return 0;
+}
+
+// simulates in real time and publishes every frame to shared memory
+static int Publish(const std::string& wallsPath, const std::string& bulletsPath, float duration, const std::string& sharedMemoryName)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	SharedStatePublisher publisher;
+
+	// room for every bullet of the scenario and as many again added while running
+	if (!publisher.Create(sharedMemoryName, walls.size(), 2 * bullets.size()))
+	{
+		std::cout << "Failed to create the shared memory " << sharedMemoryName << std::endl;
+		return 1;
+	}
+
+	BulletManager bulletManager(walls, bullets);
+
+	bulletManager.SetStatePublisher(&publisher);
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	constexpr std::chrono::microseconds frameDuration(1000000 / 60);
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto runStartTime = clock.now();
+
+	int framesCount = 0;
+
+	for (float time = 0; time < duration; time += deltaTime)
+	{
+		bulletManager.Update(deltaTime);
+
+		++framesCount;
+
+		std::this_thread::sleep_until(runStartTime + framesCount * frameDuration);
+	}
+
+	bulletManager.SetStatePublisher(nullptr);
+
+	std::cout << "Published " << framesCount << " frames, " << publisher.GetDroppedFramesCount() << " didn't fit" << std::endl;
+
+	return 0;
+}
+
+// reads the published frames as fast as it can, in place, and counts the ones the publisher overwrote while they were read
+static int Watch(const std::string& sharedMemoryName, float duration)
+{
+	SharedStateReader reader;
+
+	if (!reader.Open(sharedMemoryName))
+	{
+		std::cout << "Failed to open the shared memory " << sharedMemoryName << std::endl;
+		return 1;
+	}
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto watchEndTime = clock.now() + std::chrono::microseconds(static_cast<long long>(duration * 1000000));
+
+	unsigned long long lastGeneration = reader.GetGeneration();
+
+	int readsCount = 0;
+	int overwrittenReadsCount = 0;
+	int framesSeenCount = 0;
+
+	SharedStateView view;
+
+	while (clock.now() < watchEndTime)
+	{
+		if (!reader.BeginRead(view))
+		{
+			continue;
+		}
+
+		// touches every bullet, like a tool summarising the frame would
+		Vector2 bulletsCentre = Vector2::Zero;
+
+		for (size_t bulletIndex = 0; bulletIndex < view.bulletsCount; ++bulletIndex)
+		{
+			bulletsCentre = bulletsCentre + view.bullets[bulletIndex].location;
+		}
+
+		++readsCount;
+
+		if (!reader.IsStillValid(view))
+		{
+			++overwrittenReadsCount;
+			continue;
+		}
+
+		const unsigned long long generation = reader.GetGeneration();
+
+		if (generation != lastGeneration)
+		{
+			lastGeneration = generation;
+
+			++framesSeenCount;
+		}
+	}
+
+	std::cout << readsCount << " reads of " << framesSeenCount << " frames, " << overwrittenReadsCount << " were overwritten while read; the last frame at " << view.time << " s has " << view.wallsCount << " walls and " << view.bulletsCount << " bullets" << std::endl;
+
+	return 0;
+}
+
+// simulates in real time the bullets that produce commands write into the ring
+static int RunRing(const std::string& wallsPath, float duration, const std::string& sharedMemoryName, int ringCapacity)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	if (!LoadWallsFromJson(wallsPath, walls))
+	{
+		std::cout << "Failed to read " << wallsPath << std::endl;
+		return 1;
+	}
+
+	BulletCommandRing commandRing;
+
+	if (!commandRing.Create(sharedMemoryName, ringCapacity))
+	{
+		std::cout << "Failed to create the shared memory " << sharedMemoryName << std::endl;
+		return 1;
+	}
+
+	BulletManager bulletManager(walls, {});
+
+	bulletManager.SetCommandRing(&commandRing);
+
+	constexpr float deltaTime = 1.0f / 60;
+
+	constexpr std::chrono::microseconds frameDuration(1000000 / 60);
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto runStartTime = clock.now();
+
+	int framesCount = 0;
+
+	size_t maxBulletsCount = 0;
+
+	std::chrono::duration<double> longestUpdateDuration(0);
+
+	for (float time = 0; time < duration; time += deltaTime)
+	{
+		const auto updateStartTime = clock.now();
+
+		bulletManager.Update(deltaTime);
+
+		longestUpdateDuration = std::max<std::chrono::duration<double>>(longestUpdateDuration, clock.now() - updateStartTime);
+
+		maxBulletsCount = std::max(maxBulletsCount, bulletManager.GetBulletsCount());
+
+		++framesCount;
+
+		std::this_thread::sleep_until(runStartTime + framesCount * frameDuration);
+	}
+
+	bulletManager.SetCommandRing(nullptr);
+
+	std::cout << "Simulated " << framesCount << " frames, at most " << maxBulletsCount << " bullets at once, the longest update took " << longestUpdateDuration.count() * 1000 << " ms" << std::endl;
+
+	return 0;
+}
+
+// runs the scenario in shard processes, then in this process alone, and compares how many walls were destroyed
+static int RunShards(const std::string& wallsPath, const std::string& bulletsPath, float duration, int shardsCount, float syncInterval)
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	if (!LoadScene(wallsPath, bulletsPath, walls, bullets))
+	{
+		return 1;
+	}
+
+	ShardedSimulation::Settings settings;
+
+	settings.shardsCount = shardsCount;
+	settings.syncInterval = syncInterval;
+
+	settings.mailboxCapacity = std::max<size_t>(1, bullets.size());
+	settings.bulletsCapacity = std::max<size_t>(1, bullets.size());
+
+	ShardedSimulation shardedSimulation(walls, bullets, settings);
+
+	if (!shardedSimulation.Start())
+	{
+		std::cout << "Failed to start the shards" << std::endl;
+		return 1;
+	}
+
+	std::chrono::high_resolution_clock clock;
+
+	GraphicsState graphicsState;
+
+	size_t shardedDestroyedWallsCount = 0;
+
+	const auto shardsStartTime = clock.now();
+
+	while (shardedSimulation.GetCurrentTime() < duration)
+	{
+		if (!shardedSimulation.Step(graphicsState))
+		{
+			std::cout << "A shard died at " << shardedSimulation.GetCurrentTime() << " s" << std::endl;
+			return 1;
+		}
+
+		shardedDestroyedWallsCount += graphicsState.destroyedWalls.size();
+	}
+
+	const auto shardsMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - shardsStartTime).count();
+
+	const size_t shardedBulletsCount = graphicsState.bullets.size();
+
+	for (int shardIndex = 0; shardIndex < shardsCount; ++shardIndex)
+	{
+		const ShardedSimulation::ShardStats& stats = shardedSimulation.GetShardStats(shardIndex);
+
+		std::cout << "Shard " << shardIndex << ": " << stats.bulletsCount << " bullets, sent " << stats.sentBulletsCount << " and received " << stats.receivedBulletsCount
+			<< ", destroyed " << stats.destroyedWallsCount << " walls and " << stats.remoteDestroyedWallsCount << " more reported by other shards, "
+			<< stats.droppedMessagesCount + stats.droppedBulletsCount << " dropped, simulated for " << stats.simulationSeconds * 1000 << " ms" << std::endl;
+	}
+
+	shardedSimulation.Stop();
+
+	std::vector<BulletManager::WallDestruction> destructionLog;
+
+	BulletManager bulletManager(walls, bullets);
+
+	bulletManager.SetWallDestructionLog(&destructionLog);
+
+	const auto singleStartTime = clock.now();
+
+	// as many frames as the shards ran, summing the frame times would drift
+	const long framesCount = std::lround(shardedSimulation.GetCurrentTime() / settings.frameTime);
+
+	for (long frameIndex = 0; frameIndex < framesCount; ++frameIndex)
+	{
+		bulletManager.Update(settings.frameTime);
+	}
+
+	bulletManager.GenerateState(graphicsState);
+
+	const auto singleMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - singleStartTime).count();
+
+	std::cout << shardsCount << " shards " << shardsMilliseconds << " ms, " << shardedDestroyedWallsCount << " walls destroyed, " << shardedBulletsCount << " bullets visible; "
+		<< "one process " << singleMilliseconds << " ms, " << destructionLog.size() << " walls destroyed, " << graphicsState.bullets.size() << " bullets visible" << std::endl;
+
+	return 0;
+}
+
+// a stand-in for a load bot or a server front-end: writes bullets starting at the consumer's time into its ring
+static int Produce(const std::string& sharedMemoryName, float bulletsPerSecond, float duration)
+{
+	BulletCommandRing commandRing;
+
+	if (!commandRing.Open(sharedMemoryName))
+	{
+		std::cout << "Failed to open the shared memory " << sharedMemoryName << std::endl;
+		return 1;
+	}
+
+	std::mt19937 randomEngine(0);
+
+	std::uniform_real_distribution<float> positionDistribution(0, 1000);
+	std::uniform_real_distribution<float> velocityDistribution(-50, 50);
+	std::uniform_real_distribution<float> lifetimeDistribution(1, 5);
+
+	std::chrono::high_resolution_clock clock;
+
+	const auto produceStartTime = clock.now();
+
+	const auto produceEndTime = produceStartTime + std::chrono::microseconds(static_cast<long long>(duration * 1000000));
+
+	long long pushedCount = 0;
+	long long fullRingCount = 0;
+
+	for (auto now = produceStartTime; now < produceEndTime; now = clock.now())
+	{
+		if (bulletsPerSecond > 0 && pushedCount >= std::chrono::duration<double>(now - produceStartTime).count() * bulletsPerSecond)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		const BulletManager::BulletDefinition bullet({ positionDistribution(randomEngine), positionDistribution(randomEngine) }, { velocityDistribution(randomEngine), velocityDistribution(randomEngine) }, commandRing.GetConsumerTime(), lifetimeDistribution(randomEngine));
+
+		if (commandRing.TryPush(bullet))
+		{
+			++pushedCount;
+		}
+		else
+		{
+			++fullRingCount;
+
+			std::this_thread::yield();
+		}
+	}
+
+	const double producedDuration = std::chrono::duration<double>(clock.now() - produceStartTime).count();
+
+	std::cout << "Pushed " << pushedCount << " bullets, " << pushedCount / producedDuration << " per second; the ring was full " << fullRingCount << " times" << std::endl;
+
+	return 0;
+}
+
+// a small scene whose values are multiples of a quarter, so that they survive a trip through decimal text exactly
+static void MakeSelfTestScene(std::vector<BulletManager::WallDefinition>& outWalls, std::vector<BulletManager::BulletDefinition>& outBullets)
+{
+	std::mt19937 generator(1);
+
+	std::uniform_int_distribution<int> coordinate(0, 4000 * 4);
+	std::uniform_int_distribution<int> offset(-80 * 4, 80 * 4);
+	std::uniform_int_distribution<int> speed(-200 * 4, 200 * 4);
+	std::uniform_int_distribution<int> startTime(0, 64);
+	std::uniform_int_distribution<int> lifetime(1, 3);
+
+	for (int wallIndex = 0; wallIndex < 2000; ++wallIndex)
+	{
+		const Vector2 start{ coordinate(generator) / 4.0f, coordinate(generator) / 4.0f };
+
+		outWalls.emplace_back(start, start + Vector2{ offset(generator) / 4.0f, offset(generator) / 4.0f });
+	}
+
+	for (int bulletIndex = 0; bulletIndex < 500; ++bulletIndex)
+	{
+		outBullets.emplace_back(Vector2{ coordinate(generator) / 4.0f, coordinate(generator) / 4.0f }, Vector2{ speed(generator) / 4.0f, speed(generator) / 4.0f }, startTime(generator) / 64.0f, static_cast<float>(lifetime(generator)));
+	}
+}
+
+static bool IsSameWall(const BulletManager::WallDefinition& first, const BulletManager::WallDefinition& second)
+{
+	return first.start.X == second.start.X && first.start.Y == second.start.Y && first.end.X == second.end.X && first.end.Y == second.end.Y;
+}
+
+static bool IsSameBullet(const BulletManager::BulletDefinition& first, const BulletManager::BulletDefinition& second)
+{
+	return first.startingPosition.X == second.startingPosition.X && first.startingPosition.Y == second.startingPosition.Y && first.velocity.X == second.velocity.X && first.velocity.Y == second.velocity.Y && first.startTime == second.startTime && first.lifetime == second.lifetime;
+}
+
+// the records a file format stores as they are, compared byte for byte
+template <class T>
+static bool AreRecordsEqual(const T* first, size_t firstCount, const T* second, size_t secondCount)
+{
+	return firstCount == secondCount && (firstCount == 0 || std::memcmp(first, second, sizeof(T) * firstCount) == 0);
+}
+
+static bool CheckJsonRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::WallDefinition>& walls, const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	const std::string wallsPath = pathPrefix + "walls.json";
+	const std::string bulletsPath = pathPrefix + "bullets.json";
+
+	// the shapes generate_walls.py and generate_bullets.py write
+	{
+		std::ofstream wallsStream(wallsPath);
+
+		wallsStream.precision(9);
+
+		wallsStream << "[";
+
+		for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
+		{
+			const BulletManager::WallDefinition& wall = walls[wallIndex];
+
+			wallsStream << (wallIndex > 0 ? ", " : "") << "{\"start\": {\"x\": " << wall.start.X << ", \"y\": " << wall.start.Y << "}, \"end\": {\"x\": " << wall.end.X << ", \"y\": " << wall.end.Y << "}}";
+		}
+
+		wallsStream << "]";
+
+		std::ofstream bulletsStream(bulletsPath);
+
+		bulletsStream.precision(9);
+
+		bulletsStream << "[";
+
+		for (size_t bulletIndex = 0; bulletIndex < bullets.size(); ++bulletIndex)
+		{
+			const BulletManager::BulletDefinition& bullet = bullets[bulletIndex];
+
+			bulletsStream << (bulletIndex > 0 ? ", " : "") << "{\"start\": {\"x\": " << bullet.startingPosition.X << ", \"y\": " << bullet.startingPosition.Y << "}, \"velocity\": {\"x\": " << bullet.velocity.X << ", \"y\": " << bullet.velocity.Y
+				<< "}, \"startTime\": " << bullet.startTime << ", \"lifetime\": " << bullet.lifetime << "}";
+		}
+
+		bulletsStream << "]";
+
+		if (!wallsStream || !bulletsStream)
+		{
+			return false;
+		}
+	}
+
+	std::vector<BulletManager::WallDefinition> loadedWalls;
+
+	std::vector<BulletManager::BulletDefinition> loadedBullets;
+
+	std::vector<BulletManager::Wall> streamedWalls;
+
+	std::vector<BulletManager::Bullet> streamedBullets;
+
+	// a few chunks, so that the split at object boundaries is taken
+	constexpr int chunksCount = 3;
+
+	const bool bWereRead = LoadWallsFromJson(wallsPath, loadedWalls) && LoadBulletsFromJson(bulletsPath, loadedBullets) && StreamWallsFromJson(wallsPath, streamedWalls, chunksCount) && StreamBulletsFromJson(bulletsPath, streamedBullets, chunksCount);
+
+	std::remove(wallsPath.c_str());
+	std::remove(bulletsPath.c_str());
+
+	if (!bWereRead || loadedWalls.size() != walls.size() || streamedWalls.size() != walls.size() || loadedBullets.size() != bullets.size() || streamedBullets.size() != bullets.size())
+	{
+		return false;
+	}
+
+	for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
+	{
+		if (!IsSameWall(walls[wallIndex], loadedWalls[wallIndex]) || !IsSameWall(walls[wallIndex], streamedWalls[wallIndex].definition))
+		{
+			return false;
+		}
+	}
+
+	for (size_t bulletIndex = 0; bulletIndex < bullets.size(); ++bulletIndex)
+	{
+		if (!IsSameBullet(bullets[bulletIndex], loadedBullets[bulletIndex]) || !IsSameBullet(bullets[bulletIndex], streamedBullets[bulletIndex].definition))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool CheckScenarioRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::WallDefinition>& walls, const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	const std::string scenarioPath = pathPrefix + "scenario.bscn";
+
+	bool bIsEqual = false;
+
+	if (WriteBinaryScenario(scenarioPath, walls, bullets))
+	{
+		MappedFile file;
+
+		ScenarioView view;
+
+		if (OpenBinaryScenario(scenarioPath, file, view) && view.wallsCount == walls.size())
+		{
+			bIsEqual = AreRecordsEqual(view.bullets, view.bulletsCount, bullets.data(), bullets.size());
+
+			for (size_t wallIndex = 0; bIsEqual && wallIndex < walls.size(); ++wallIndex)
+			{
+				bIsEqual = IsSameWall(walls[wallIndex], BulletManager::WallDefinition(view.walls[wallIndex].start, view.walls[wallIndex].end));
+			}
+		}
+	}
+
+	std::remove(scenarioPath.c_str());
+
+	return bIsEqual;
+}
+
+static bool CheckScheduleRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	const std::string schedulePath = pathPrefix + "schedule.bsch";
+
+	std::vector<BulletManager::BulletDefinition> expectedBullets(bullets);
+
+	std::stable_sort(expectedBullets.begin(), expectedBullets.end(), [](const BulletManager::BulletDefinition& first, const BulletManager::BulletDefinition& second)
+	{
+		return first.startTime < second.startTime;
+	});
+
+	std::vector<BulletManager::BulletDefinition> readBullets;
+
+	bool bIsFinished = false;
+
+	{
+		BulletScheduleReader reader;
+
+		if (WriteBulletSchedule(schedulePath, bullets) && reader.Open(schedulePath))
+		{
+			// in two parts, so that reading stops at the time given
+			const float middleTime = expectedBullets.empty() ? 0 : expectedBullets[expectedBullets.size() / 2].startTime;
+
+			reader.ReadUntil(middleTime, readBullets);
+
+			const bool bStoppedInTime = std::all_of(readBullets.begin(), readBullets.end(), [middleTime](const BulletManager::BulletDefinition& bullet) { return bullet.startTime < middleTime; });
+
+			reader.ReadUntil(std::numeric_limits<float>::max(), readBullets);
+
+			bIsFinished = bStoppedInTime && reader.IsFinished();
+		}
+	}
+
+	std::remove(schedulePath.c_str());
+
+	return bIsFinished && AreRecordsEqual(readBullets.data(), readBullets.size(), expectedBullets.data(), expectedBullets.size());
+}
+
+static bool CheckCheckpointRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::Wall>& walls, const std::vector<BulletManager::Bullet>& bullets)
+{
+	const std::string checkpointPath = pathPrefix + "checkpoint.bckp";
+
+	constexpr float currentTime = 1.5f;
+
+	const unsigned int nextBulletId = static_cast<unsigned int>(bullets.size()) + 7;
+
+	bool bIsEqual = false;
+
+	if (WriteCheckpointFile(checkpointPath.c_str(), currentTime, nextBulletId, walls.data(), walls.size(), bullets.data(), bullets.size()))
+	{
+		MappedFile file;
+
+		CheckpointView view;
+
+		if (OpenCheckpoint(checkpointPath, file, view) && view.currentTime == currentTime && view.nextBulletId == nextBulletId && view.wallsCount == walls.size())
+		{
+			bIsEqual = AreRecordsEqual(view.bullets, view.bulletsCount, bullets.data(), bullets.size());
+
+			for (size_t wallIndex = 0; bIsEqual && wallIndex < walls.size(); ++wallIndex)
+			{
+				bIsEqual = IsSameWall(walls[wallIndex].definition, BulletManager::WallDefinition(view.walls[wallIndex].start, view.walls[wallIndex].end)) && view.walls[wallIndex].timeDestroyed == walls[wallIndex].timeDestroyed;
+			}
+		}
+	}
+
+	std::remove(checkpointPath.c_str());
+
+	return bIsEqual;
+}
+
+static bool CheckWallGridRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::Wall>& walls)
+{
+	const std::string gridPath = pathPrefix + "grid.bgrd";
+
+	const unsigned long long wallsHash = WallGrid::HashWalls(walls);
+
+	WallGrid builtGrid;
+
+	builtGrid.Build(walls);
+
+	bool bIsEqual = false;
+
+	if (builtGrid.Save(gridPath, wallsHash))
+	{
+		WallGrid loadedGrid;
+
+		WallGrid mismatchedGrid;
+
+		// an index built for other walls must not be taken
+		if (loadedGrid.Load(gridPath, wallsHash, walls) && !mismatchedGrid.Load(gridPath, wallsHash + 1, walls) && loadedGrid.GetCellSize() == builtGrid.GetCellSize())
+		{
+			std::mt19937 generator(2);
+
+			std::uniform_real_distribution<float> coordinate(0, 4000);
+			std::uniform_real_distribution<float> extent(0, 300);
+
+			std::vector<int> builtWallIndices;
+
+			std::vector<int> loadedWallIndices;
+
+			bIsEqual = true;
+
+			for (int boxIndex = 0; bIsEqual && boxIndex < 200; ++boxIndex)
+			{
+				const Vector2 boxMin{ coordinate(generator), coordinate(generator) };
+
+				const Vector2 boxMax = boxMin + Vector2{ extent(generator), extent(generator) };
+
+				builtWallIndices.clear();
+				loadedWallIndices.clear();
+
+				builtGrid.GetWallsOverlappingBox(boxMin, boxMax, 0, static_cast<int>(walls.size()), builtWallIndices);
+				loadedGrid.GetWallsOverlappingBox(boxMin, boxMax, 0, static_cast<int>(walls.size()), loadedWallIndices);
+
+				bIsEqual = builtWallIndices == loadedWallIndices;
+			}
+		}
+	}
+
+	std::remove(gridPath.c_str());
+
+	return bIsEqual;
+}
+
+static bool CheckWallTilesRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::WallDefinition>& walls)
+{
+	const std::string tilesPath = pathPrefix + "tiles.btil";
+
+	const auto isWallBefore = [](const BulletManager::WallDefinition& first, const BulletManager::WallDefinition& second)
+	{
+		return std::make_tuple(first.start.X, first.start.Y, first.end.X, first.end.Y) < std::make_tuple(second.start.X, second.start.Y, second.end.X, second.end.Y);
+	};
+
+	bool bIsEqual = false;
+
+	if (WallTileStore::Write(tilesPath, walls, 500))
+	{
+		WallTileStore store;
+
+		std::vector<BulletManager::Wall> tileWalls;
+
+		std::vector<BulletManager::WallDefinition> readWalls;
+
+		bool bWereRead = store.Open(tilesPath);
+
+		for (int tileIndex = 0; bWereRead && tileIndex < store.GetTilesCount(); ++tileIndex)
+		{
+			tileWalls.clear();
+
+			bWereRead = store.ReadTile(tileIndex, tileWalls) && tileWalls.size() == store.GetTile(tileIndex).wallsCount;
+
+			for (const BulletManager::Wall& wall : tileWalls)
+			{
+				readWalls.push_back(wall.definition);
+
+				bWereRead &= wall.timeDestroyed < 0;
+			}
+		}
+
+		// the tiles hold every wall once, in an order of their own
+		std::vector<BulletManager::WallDefinition> expectedWalls(walls);
+
+		std::sort(expectedWalls.begin(), expectedWalls.end(), isWallBefore);
+		std::sort(readWalls.begin(), readWalls.end(), isWallBefore);
+
+		bIsEqual = bWereRead && readWalls.size() == expectedWalls.size() && std::equal(readWalls.begin(), readWalls.end(), expectedWalls.begin(), IsSameWall);
+
+		// the destroyed walls written back are read again
+		if (bIsEqual && store.GetTilesCount() > 0)
+		{
+			const int tileIndex = store.GetTilesCount() / 2;
+
+			tileWalls.clear();
+
+			bIsEqual = store.ReadTile(tileIndex, tileWalls);
+
+			for (size_t wallIndex = 0; wallIndex < tileWalls.size(); wallIndex += 2)
+			{
+				tileWalls[wallIndex].timeDestroyed = 0.25f * (wallIndex + 1);
+			}
+
+			std::vector<BulletManager::Wall> rereadWalls;
+
+			bIsEqual = bIsEqual && store.WriteTile(tileIndex, tileWalls.data()) && store.ReadTile(tileIndex, rereadWalls) && rereadWalls.size() == tileWalls.size();
+
+			for (size_t wallIndex = 0; bIsEqual && wallIndex < tileWalls.size(); ++wallIndex)
+			{
+				bIsEqual = IsSameWall(rereadWalls[wallIndex].definition, tileWalls[wallIndex].definition) && rereadWalls[wallIndex].timeDestroyed == tileWalls[wallIndex].timeDestroyed;
+			}
+		}
+	}
+
+	std::remove(tilesPath.c_str());
+
+	return bIsEqual;
+}
+
+// the state a trace rebuilds at its end has to be the one the manager that wrote it had
+static bool CheckTraceRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::WallDefinition>& walls, const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	const std::string tracePath = pathPrefix + "trace.btrc";
+
+	GraphicsState simulatedState;
+
+	GraphicsState tracedState;
+
+	bool bWasPlayed = false;
+
+	{
+		EventTraceWriter eventTrace;
+
+		if (eventTrace.Open(tracePath))
+		{
+			BulletManager bulletManager(walls, bullets);
+
+			bulletManager.SetEventTrace(&eventTrace);
+
+			for (int frameIndex = 0; frameIndex < 60; ++frameIndex)
+			{
+				bulletManager.Update(1.0f / 30);
+			}
+
+			bulletManager.SetEventTrace(nullptr);
+
+			eventTrace.Close();
+
+			bulletManager.GenerateState(simulatedState);
+
+			EventTracePlayer player;
+
+			if (player.Open(tracePath))
+			{
+				player.GenerateState(bulletManager.GetCurrentTime(), tracedState);
+
+				bWasPlayed = true;
+			}
+		}
+	}
+
+	std::remove(tracePath.c_str());
+
+	if (!bWasPlayed || simulatedState.walls.size() != tracedState.walls.size() || simulatedState.bullets.size() != tracedState.bullets.size())
+	{
+		return false;
+	}
+
+	const auto isWallBefore = [](const GraphicsState::Wall& first, const GraphicsState::Wall& second)
+	{
+		return std::make_tuple(first.start.X, first.start.Y, first.end.X, first.end.Y) < std::make_tuple(second.start.X, second.start.Y, second.end.X, second.end.Y);
+	};
+
+	const auto isBulletBefore = [](const GraphicsState::Bullet& first, const GraphicsState::Bullet& second)
+	{
+		return std::make_tuple(first.velocity.X, first.velocity.Y, first.location.X, first.location.Y) < std::make_tuple(second.velocity.X, second.velocity.Y, second.location.X, second.location.Y);
+	};
+
+	std::sort(simulatedState.walls.begin(), simulatedState.walls.end(), isWallBefore);
+	std::sort(tracedState.walls.begin(), tracedState.walls.end(), isWallBefore);
+
+	std::sort(simulatedState.bullets.begin(), simulatedState.bullets.end(), isBulletBefore);
+	std::sort(tracedState.bullets.begin(), tracedState.bullets.end(), isBulletBefore);
+
+	if (!AreRecordsEqual(simulatedState.walls.data(), simulatedState.walls.size(), tracedState.walls.data(), tracedState.walls.size()))
+	{
+		return false;
+	}
+
+	// the locations are evaluated from the legs again, which may round differently
+	constexpr float locationTolerance = 0.01f;
+
+	for (size_t bulletIndex = 0; bulletIndex < simulatedState.bullets.size(); ++bulletIndex)
+	{
+		const GraphicsState::Bullet& simulatedBullet = simulatedState.bullets[bulletIndex];
+		const GraphicsState::Bullet& tracedBullet = tracedState.bullets[bulletIndex];
+
+		if (simulatedBullet.velocity.X != tracedBullet.velocity.X || simulatedBullet.velocity.Y != tracedBullet.velocity.Y || (simulatedBullet.location - tracedBullet.location).GetMagnitude() > locationTolerance)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool CheckDumpRoundTrip(const std::string& pathPrefix, const std::vector<BulletManager::WallDefinition>& walls, const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	const std::string dumpPath = pathPrefix + "dump.bfr";
+
+	FlightRecorder::Dump dump;
+
+	{
+		BulletManager bulletManager(walls, bullets);
+
+		bulletManager.Update(0.5f);
+
+		bulletManager.TakeSnapshot(dump.snapshot);
+	}
+
+	for (int frameIndex = 0; frameIndex < 3; ++frameIndex)
+	{
+		FlightRecorder::FrameRecord frame;
+
+		frame.frameDurationMs = 10.0f * frameIndex;
+
+		frame.events.push_back({ FlightRecorder::FrameEvent::BulletAddition, 0.5f, static_cast<unsigned int>(frameIndex), bullets[frameIndex % bullets.size()] });
+		frame.events.push_back({ FlightRecorder::FrameEvent::ExpiredBulletsRemoval, 0.5f, 0, BulletManager::BulletDefinition() });
+		frame.events.push_back({ FlightRecorder::FrameEvent::Update, 1.0f / 60, 0, BulletManager::BulletDefinition() });
+		frame.events.push_back({ FlightRecorder::FrameEvent::Rewind, 0.5f, 0, BulletManager::BulletDefinition() });
+
+		dump.frames.push_back(frame);
+	}
+
+	FlightRecorder::Dump readDump;
+
+	const bool bWasRead = FlightRecorder::WriteDump(dumpPath, dump) && FlightRecorder::ReadDump(dumpPath, readDump);
+
+	std::remove(dumpPath.c_str());
+
+	if (!bWasRead || readDump.snapshot.currentTime != dump.snapshot.currentTime || readDump.frames.size() != dump.frames.size())
+	{
+		return false;
+	}
+
+	bool bIsEqual = AreRecordsEqual(readDump.snapshot.walls.data(), readDump.snapshot.walls.size(), dump.snapshot.walls.data(), dump.snapshot.walls.size())
+		&& AreRecordsEqual(readDump.snapshot.bullets.data(), readDump.snapshot.bullets.size(), dump.snapshot.bullets.data(), dump.snapshot.bullets.size());
+
+	for (size_t frameIndex = 0; bIsEqual && frameIndex < dump.frames.size(); ++frameIndex)
+	{
+		const FlightRecorder::FrameRecord& frame = dump.frames[frameIndex];
+		const FlightRecorder::FrameRecord& readFrame = readDump.frames[frameIndex];
+
+		bIsEqual = readFrame.frameDurationMs == frame.frameDurationMs && AreRecordsEqual(readFrame.events.data(), readFrame.events.size(), frame.events.data(), frame.events.size());
+	}
+
+	return bIsEqual;
+}
+
+static bool CheckCommandRingRoundTrip(const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	const std::string ringName = "/BulletsSelfTest" + std::to_string(std::random_device()());
+
+	constexpr size_t ringCapacity = 64;
+
+	BulletCommandRing consumer;
+
+	BulletCommandRing producer;
+
+	if (!consumer.Create(ringName, ringCapacity) || !producer.Open(ringName))
+	{
+		return false;
+	}
+
+	std::vector<BulletManager::BulletDefinition> pushedBullets;
+
+	std::vector<BulletManager::BulletDefinition> drainedBullets;
+
+	// round the ring a few times, so that the positions wrap
+	for (int passIndex = 0; passIndex < 3; ++passIndex)
+	{
+		size_t pushedCount = 0;
+
+		for (size_t bulletIndex = 0; bulletIndex < ringCapacity + 8; ++bulletIndex)
+		{
+			const BulletManager::BulletDefinition& bullet = bullets[(passIndex * ringCapacity + bulletIndex) % bullets.size()];
+
+			if (producer.TryPush(bullet))
+			{
+				pushedBullets.push_back(bullet);
+
+				++pushedCount;
+			}
+		}
+
+		// a full ring turns the rest away
+		if (pushedCount != ringCapacity)
+		{
+			return false;
+		}
+
+		constexpr float consumerTime = 2.0f;
+
+		consumer.Drain(consumerTime, drainedBullets);
+
+		if (producer.GetConsumerTime() != consumerTime)
+		{
+			return false;
+		}
+	}
+
+	return AreRecordsEqual(drainedBullets.data(), drainedBullets.size(), pushedBullets.data(), pushedBullets.size());
+}
+
+// writes every file format and shared memory layout and reads it back; the temporary files go to the working directory
+static int SelfTest()
+{
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	MakeSelfTestScene(walls, bullets);
+
+	std::vector<BulletManager::Wall> destroyedWalls;
+
+	for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
+	{
+		destroyedWalls.push_back({ walls[wallIndex], wallIndex % 3 == 0 ? 0.125f * wallIndex : -1 });
+	}
+
+	std::vector<BulletManager::Bullet> identifiedBullets;
+
+	for (size_t bulletIndex = 0; bulletIndex < bullets.size(); ++bulletIndex)
+	{
+		identifiedBullets.push_back({ bullets[bulletIndex], static_cast<unsigned int>(bulletIndex * 2 + 1) });
+	}
+
+	const std::string pathPrefix = "self_test_";
+
+	const std::pair<const char*, bool> checks[] =
+	{
+		{ "json", CheckJsonRoundTrip(pathPrefix, walls, bullets) },
+		{ "scenario", CheckScenarioRoundTrip(pathPrefix, walls, bullets) },
+		{ "schedule", CheckScheduleRoundTrip(pathPrefix, bullets) },
+		{ "checkpoint", CheckCheckpointRoundTrip(pathPrefix, destroyedWalls, identifiedBullets) },
+		{ "wall grid", CheckWallGridRoundTrip(pathPrefix, destroyedWalls) },
+		{ "wall tiles", CheckWallTilesRoundTrip(pathPrefix, walls) },
+		{ "trace", CheckTraceRoundTrip(pathPrefix, walls, bullets) },
+		{ "dump", CheckDumpRoundTrip(pathPrefix, walls, bullets) },
+		{ "command ring", CheckCommandRingRoundTrip(bullets) },
+	};
+
+	int failedChecksCount = 0;
+
+	for (const auto& check : checks)
+	{
+		std::cout << (check.second ? "Passed " : "FAILED ") << check.first << std::endl;
+
+		failedChecksCount += check.second ? 0 : 1;
+	}
+
+	return failedChecksCount > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		return PrintUsage();
+	}
+
+	const std::string command(argv[1]);
+
+	if (command == "replay" && argc == 3)
+	{
+		return Replay(argv[2]);
+	}
+
+	if (command == "convert" && argc == 5)
+	{
+		return Convert(argv[2], argv[3], argv[4]);
+	}
+
+	if (command == "bench-load" && argc == 5)
+	{
+		return BenchmarkLoading(argv[2], argv[3], argv[4]);
+	}
+
+	if (command == "make-schedule" && argc == 4)
+	{
+		return MakeSchedule(argv[2], argv[3]);
+	}
+
+	if (command == "run-schedule" && argc == 5)
+	{
+		return RunSchedule(argv[2], argv[3], std::stof(argv[4]));
+	}
+
+	if (command == "make-tiles" && argc == 5)
+	{
+		return MakeTiles(argv[2], argv[3], std::stof(argv[4]));
+	}
+
+	if (command == "run-tiles" && argc == 5)
+	{
+		return RunTiles(argv[2], argv[3], std::stof(argv[4]));
+	}
+
+	if (command == "solve" && (argc == 4 || argc == 5))
+	{
+		return Solve(argv[2], argv[3], argc == 5 ? argv[4] : "");
+	}
+
+	if (command == "bench-worlds" && argc == 6)
+	{
+		return BenchmarkWorlds(argv[2], argv[3], std::stoi(argv[4]), std::stof(argv[5]));
+	}
+
+	if (command == "bench-hash" && argc == 5)
+	{
+		return BenchmarkStateHash(argv[2], argv[3], std::stof(argv[4]));
+	}
+
+	if (command == "bench-regions" && argc == 6)
+	{
+		return BenchmarkRegions(argv[2], argv[3], std::stof(argv[4]), std::stoi(argv[5]));
+	}
+
+	if (command == "bench-cells" && argc == 6)
+	{
+		return BenchmarkCollisionCells(argv[2], argv[3], std::stof(argv[4]), std::stof(argv[5]));
+	}
+
+	if (command == "bench-dt" && argc == 5)
+	{
+		return BenchmarkDeltaTimes(argv[2], argv[3], std::stof(argv[4]));
+	}
+
+	if (command == "bench-broad-phase" && argc == 5)
+	{
+		return BenchmarkBroadPhase(argv[2], argv[3], std::stof(argv[4]));
+	}
+
+	if (command == "checkpoint" && argc == 6)
+	{
+		return RunWithCheckpoints(argv[2], argv[3], std::stof(argv[4]), argv[5]);
+	}
+
+	if (command == "rollback" && argc == 6)
+	{
+		return RunWithRollbacks(argv[2], argv[3], std::stof(argv[4]), std::stof(argv[5]));
+	}
+
+	if (command == "trajectories" && argc == 6)
+	{
+		return ExportTrajectories(argv[2], argv[3], std::stof(argv[4]), argv[5]);
+	}
+
+	if (command == "trace" && argc == 6)
+	{
+		return RecordTrace(argv[2], argv[3], std::stof(argv[4]), argv[5]);
+	}
+
+	if (command == "play-trace" && argc == 4)
+	{
+		return PlayTrace(argv[2], std::stoi(argv[3]));
+	}
+
+	if (command == "publish" && argc == 6)
+	{
+		return Publish(argv[2], argv[3], std::stof(argv[4]), argv[5]);
+	}
+
+	if (command == "watch" && argc == 4)
+	{
+		return Watch(argv[2], std::stof(argv[3]));
+	}
+
+	if (command == "run-ring" && argc == 6)
+	{
+		return RunRing(argv[2], std::stof(argv[3]), argv[4], std::stoi(argv[5]));
+	}
+
+	if (command == "shard-run" && argc == 7)
+	{
+		return RunShards(argv[2], argv[3], std::stof(argv[4]), std::stoi(argv[5]), std::stof(argv[6]));
+	}
+
+	if (command == "produce" && argc == 5)
+	{
+		return Produce(argv[2], std::stof(argv[3]), std::stof(argv[4]));
+	}
+
+	if (command == "self-test" && argc == 2)
+	{
+		return SelfTest();
+	}
+
+	return PrintUsage();
+}
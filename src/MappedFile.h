@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	bool Open(const std::string& path);
+
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+
+	const char* GetData() const { return static_cast<const char*>(data); }
+
+	size_t GetSize() const { return size; }
+
+private:
+	void* data = nullptr;
+
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -304,3 +304,14 @@ std::vector<StageLogic> RunStage(std::function<StageLogic(int)> allocator, int s
 	return stageLogic;
 }
 
+// runs the stages on the pool if there is one, otherwise one after another on the calling thread
+template <class StageLogic>
+std::vector<StageLogic> RunStage(std::function<StageLogic(int)> allocator, int stagesCount, ThreadPool* pool)
+{
+	if (pool == nullptr)
+	{
+		return RunStage<StageLogic>(allocator, stagesCount, false);
+	}
+
+	return RunStage<StageLogic>(allocator, stagesCount, *pool);
+}
@@ -0,0 +1,127 @@
+#include "Scenario.h"
+
+#include "BinaryIO.h"
+#include "MappedFile.h"
+
+#include <fstream>
+
+#include "nlohmann/json.hpp"
+
+static constexpr unsigned int scenarioMagic = 0x4E435342; // "BSCN"
+
+static constexpr unsigned int scenarioVersion = 1;
+
+static_assert(sizeof(PackedWall) == 4 * sizeof(float), "Packed walls are expected to be four floats");
+
+static_assert(sizeof(BulletManager::BulletDefinition) == 6 * sizeof(float), "Bullet definitions are stored as is and are expected to be six floats");
+
+static_assert(sizeof(ScenarioHeader) % alignof(float) == 0, "Scenario records must stay aligned after the header");
+
+static void from_json(const nlohmann::json& j, Vector2& outVector)
+{
+	outVector = Vector2{ j["x"].get<float>(), j["y"].get<float>() };
+}
+
+static void from_json(const nlohmann::json& j, BulletManager::WallDefinition& outWallDefinition)
+{
+	outWallDefinition = BulletManager::WallDefinition(j["start"].get<Vector2>(), j["end"].get<Vector2>());
+}
+
+static void from_json(const nlohmann::json& j, BulletManager::BulletDefinition& outBulletDefinition)
+{
+	constexpr float defaultStartTime = 0;
+	constexpr float defaultLifetime = 10;
+
+	outBulletDefinition = BulletManager::BulletDefinition(j["start"].get<Vector2>(), j["velocity"].get<Vector2>(), j.value("startTime", defaultStartTime), j.value("lifetime", defaultLifetime));
+}
+
+template <class T>
+static bool LoadFromJson(const std::string& jsonPath, std::vector<T>& outValues)
+{
+	std::ifstream inputStream(jsonPath);
+
+	nlohmann::json setupJson;
+
+	if (inputStream)
+	{
+		inputStream >> setupJson;
+	}
+
+	if (setupJson.is_array())
+	{
+		outValues = setupJson.get<std::vector<T>>();
+		return true;
+	}
+
+	return false;
+}
+
+bool LoadWallsFromJson(const std::string& jsonPath, std::vector<BulletManager::WallDefinition>& outWalls)
+{
+	return LoadFromJson(jsonPath, outWalls);
+}
+
+bool LoadBulletsFromJson(const std::string& jsonPath, std::vector<BulletManager::BulletDefinition>& outBullets)
+{
+	return LoadFromJson(jsonPath, outBullets);
+}
+
+bool WriteBinaryScenario(const std::string& path, const std::vector<BulletManager::WallDefinition>& walls, const std::vector<BulletManager::BulletDefinition>& bullets)
+{
+	std::ofstream stream(path, std::ios::binary);
+
+	if (!stream)
+	{
+		return false;
+	}
+
+	const ScenarioHeader header{ scenarioMagic, scenarioVersion, walls.size(), bullets.size() };
+
+	WriteBinary(stream, header);
+
+	for (const BulletManager::WallDefinition& wall : walls)
+	{
+		WriteBinary(stream, PackedWall{ wall.start, wall.end });
+	}
+
+	for (const BulletManager::BulletDefinition& bullet : bullets)
+	{
+		WriteBinary(stream, bullet);
+	}
+
+	return static_cast<bool>(stream);
+}
+
+bool OpenBinaryScenario(const std::string& path, MappedFile& file, ScenarioView& outView)
+{
+	if (!file.Open(path) || file.GetSize() < sizeof(ScenarioHeader))
+	{
+		return false;
+	}
+
+	const ScenarioHeader& header = *reinterpret_cast<const ScenarioHeader*>(file.GetData());
+
+	if (header.magic != scenarioMagic || header.version != scenarioVersion)
+	{
+		return false;
+	}
+
+	const size_t expectedSize = sizeof(ScenarioHeader) + header.wallsCount * sizeof(PackedWall) + header.bulletsCount * sizeof(BulletManager::BulletDefinition);
+
+	if (file.GetSize() < expectedSize)
+	{
+		return false;
+	}
+
+	const char* wallsData = file.GetData() + sizeof(ScenarioHeader);
+
+	const char* bulletsData = wallsData + header.wallsCount * sizeof(PackedWall);
+
+	outView.walls = reinterpret_cast<const PackedWall*>(wallsData);
+	outView.wallsCount = static_cast<size_t>(header.wallsCount);
+
+	outView.bullets = reinterpret_cast<const BulletManager::BulletDefinition*>(bulletsData);
+	outView.bulletsCount = static_cast<size_t>(header.bulletsCount);
+
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <string>
+
+#include <vector>
+
+class MappedFile;
+
+// Binary scenario layout: ScenarioHeader, then wallsCount PackedWall records, then bulletsCount BulletDefinition records.
+// All values are stored in native byte order so that a mapped file can be used in place.
+struct ScenarioHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long wallsCount;
+	unsigned long long bulletsCount;
+};
+
+struct PackedWall
+{
+	Vector2 start;
+	Vector2 end;
+};
+
+// Points into memory owned by someone else, usually a MappedFile
+struct ScenarioView
+{
+	const PackedWall* walls = nullptr;
+	size_t wallsCount = 0;
+
+	const BulletManager::BulletDefinition* bullets = nullptr;
+	size_t bulletsCount = 0;
+};
+
+bool LoadWallsFromJson(const std::string& jsonPath, std::vector<BulletManager::WallDefinition>& outWalls);
+
+bool LoadBulletsFromJson(const std::string& jsonPath, std::vector<BulletManager::BulletDefinition>& outBullets);
+
+bool WriteBinaryScenario(const std::string& path, const std::vector<BulletManager::WallDefinition>& walls, const std::vector<BulletManager::BulletDefinition>& bullets);
+
+// the view stays valid for as long as the file stays open
+bool OpenBinaryScenario(const std::string& path, MappedFile& file, ScenarioView& outView);
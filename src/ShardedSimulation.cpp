@@ -0,0 +1,578 @@
+#include "ShardedSimulation.h"
+
+#include "ParallelUtils.h"
+
+#include <algorithm>
+
+#include <atomic>
+
+#include <chrono>
+
+#include <cmath>
+
+#include <iostream>
+
+#include <limits>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Shared memory layout: ShardControl, then a ShardOutput per shard followed by room for bulletsCapacity bullets and
+// an index for every wall, then two sets of mailboxes, one for every pair of shards, each a ShardMailbox followed
+// by mailboxCapacity bullets and mailboxCapacity wall destructions. The shards post into the set of the interval's parity
+// and read the other one, which was filled before the previous barrier.
+struct ShardControl
+{
+	// a barrier for the shards and the coordinator
+	std::atomic<int> arrivedCount;
+	std::atomic<int> generation;
+	int participantsCount;
+
+	int bShouldStop;
+
+	// set by whoever finds a participant gone, so that nobody waits for it forever
+	std::atomic<int> bHasFailed;
+
+	int coordinatorProcessId;
+};
+
+struct ShardOutput
+{
+	ShardedSimulation::ShardStats stats;
+
+	unsigned long long bulletsCount;
+
+	unsigned long long destroyedWallsCount;
+};
+
+struct ShardMailbox
+{
+	unsigned long long bulletsCount;
+
+	unsigned long long wallsCount;
+};
+
+static constexpr size_t shardRecordAlignment = 64;
+
+static size_t AlignShardRecord(size_t size)
+{
+	return (size + shardRecordAlignment - 1) / shardRecordAlignment * shardRecordAlignment;
+}
+
+// returns false if the barrier was abandoned, checking isOthersAlive while waiting for a participant that may have died
+template <typename TIsOthersAlive>
+static bool WaitForShards(ShardControl& control, const TIsOthersAlive& isOthersAlive)
+{
+	const int generation = control.generation.load(std::memory_order_acquire);
+
+	if (control.arrivedCount.fetch_add(1, std::memory_order_acq_rel) + 1 == control.participantsCount)
+	{
+		control.arrivedCount.store(0, std::memory_order_relaxed);
+
+		control.generation.fetch_add(1, std::memory_order_release);
+
+		return true;
+	}
+
+	// the others may take a whole interval, so stop spinning after a while
+	for (int attempt = 0; control.generation.load(std::memory_order_acquire) == generation; ++attempt)
+	{
+		if (control.bHasFailed.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		if (attempt < 1000)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+			// about every 5 ms, asking for the processes costs a system call
+			if (attempt % 100 == 0 && !isOthersAlive())
+			{
+				control.bHasFailed.store(1, std::memory_order_release);
+
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+ShardedSimulation::ShardedSimulation(const std::vector<BulletManager::WallDefinition>& inWalls, const std::vector<BulletManager::BulletDefinition>& inBullets, const Settings& inSettings) :
+	walls(inWalls), bullets(inBullets), settings(inSettings), destroyedWalls(inWalls.size(), false)
+{
+	settings.shardsCount = std::max(1, settings.shardsCount);
+
+	framesPerInterval = std::max(1, static_cast<int>(std::lround(settings.syncInterval / settings.frameTime)));
+
+	if (settings.ghostMargin < 0)
+	{
+		float maxSpeed = 0;
+
+		for (const BulletManager::BulletDefinition& bullet : bullets)
+		{
+			maxSpeed = std::max(maxSpeed, bullet.velocity.GetMagnitude());
+		}
+
+		settings.ghostMargin = maxSpeed * framesPerInterval * settings.frameTime;
+	}
+
+	std::vector<float> sortedMiddlesX;
+
+	sortedMiddlesX.reserve(walls.size());
+
+	for (const BulletManager::WallDefinition& wall : walls)
+	{
+		sortedMiddlesX.push_back((wall.start.X + wall.end.X) / 2);
+	}
+
+	std::sort(sortedMiddlesX.begin(), sortedMiddlesX.end());
+
+	splitsX.assign(settings.shardsCount - 1, 0);
+
+	for (int splitIndex = 0; splitIndex < settings.shardsCount - 1 && !walls.empty(); ++splitIndex)
+	{
+		splitsX[splitIndex] = sortedMiddlesX[(walls.size() * (splitIndex + 1)) / settings.shardsCount];
+	}
+}
+
+ShardedSimulation::~ShardedSimulation()
+{
+	Stop();
+}
+
+int ShardedSimulation::GetShardIndex(float x) const
+{
+	return static_cast<int>(std::upper_bound(splitsX.begin(), splitsX.end(), x) - splitsX.begin());
+}
+
+void ShardedSimulation::GetWallHolders(int wallIndex, int& outFirstShard, int& outLastShard) const
+{
+	const BulletManager::WallDefinition& wall = walls[wallIndex];
+
+	outFirstShard = GetShardIndex(std::fmin(wall.start.X, wall.end.X) - settings.ghostMargin);
+	outLastShard = GetShardIndex(std::fmax(wall.start.X, wall.end.X) + settings.ghostMargin);
+}
+
+ShardOutput* ShardedSimulation::GetOutput(int shardIndex) const
+{
+	char* const outputs = reinterpret_cast<char*>(control) + AlignShardRecord(sizeof(ShardControl));
+
+	return reinterpret_cast<ShardOutput*>(outputs + shardIndex * outputSize);
+}
+
+ShardMailbox* ShardedSimulation::GetMailbox(int parity, int fromShard, int toShard) const
+{
+	char* const mailboxes = reinterpret_cast<char*>(GetOutput(settings.shardsCount));
+
+	const int shardsCount = settings.shardsCount;
+
+	return reinterpret_cast<ShardMailbox*>(mailboxes + ((parity * shardsCount + fromShard) * shardsCount + toShard) * mailboxSize);
+}
+
+const ShardedSimulation::ShardStats& ShardedSimulation::GetShardStats(int shardIndex) const
+{
+	return GetOutput(shardIndex)->stats;
+}
+
+float ShardedSimulation::GetCurrentTime() const
+{
+	return intervalsCount * framesPerInterval * settings.frameTime;
+}
+
+bool ShardedSimulation::Start()
+{
+#ifdef _WIN32
+	std::cout << "Sharded simulation needs fork and POSIX shared memory" << std::endl;
+	return false;
+#else
+	const int shardsCount = settings.shardsCount;
+
+	outputSize = AlignShardRecord(sizeof(ShardOutput) + settings.bulletsCapacity * sizeof(GraphicsState::Bullet) + walls.size() * sizeof(int));
+
+	mailboxSize = AlignShardRecord(sizeof(ShardMailbox) + settings.mailboxCapacity * (sizeof(BulletManager::BulletDefinition) + sizeof(BulletManager::WallDestruction)));
+
+	regionSize = AlignShardRecord(sizeof(ShardControl)) + shardsCount * outputSize + 2 * shardsCount * shardsCount * mailboxSize;
+
+	// anonymous, the shards are forked from this process
+	void* const region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (region == MAP_FAILED)
+	{
+		return false;
+	}
+
+	control = static_cast<ShardControl*>(region);
+
+	control->arrivedCount.store(0, std::memory_order_relaxed);
+	control->generation.store(0, std::memory_order_relaxed);
+	control->participantsCount = shardsCount + 1;
+	control->bShouldStop = 0;
+	control->bHasFailed.store(0, std::memory_order_relaxed);
+	control->coordinatorProcessId = getpid();
+
+	for (int shardIndex = 0; shardIndex < shardsCount; ++shardIndex)
+	{
+		ShardOutput& output = *GetOutput(shardIndex);
+
+		output.stats = ShardStats();
+		output.bulletsCount = 0;
+		output.destroyedWallsCount = 0;
+	}
+
+	for (int shardIndex = 0; shardIndex < shardsCount; ++shardIndex)
+	{
+		const pid_t processId = fork();
+
+		if (processId == 0)
+		{
+			RunShard(shardIndex);
+
+			_exit(0);
+		}
+
+		if (processId < 0)
+		{
+			// the shards started so far would wait for the missing ones forever
+			for (int startedProcessId : shardProcessIds)
+			{
+				kill(startedProcessId, SIGKILL);
+
+				waitpid(startedProcessId, nullptr, 0);
+			}
+
+			shardProcessIds.clear();
+
+			munmap(control, regionSize);
+
+			control = nullptr;
+
+			return false;
+		}
+
+		shardProcessIds.push_back(processId);
+	}
+
+	return true;
+#endif
+}
+
+bool ShardedSimulation::AreShardsAlive()
+{
+#ifdef _WIN32
+	return true;
+#else
+	bool bAreAlive = true;
+
+	for (int& processId : shardProcessIds)
+	{
+		if (processId > 0 && waitpid(processId, nullptr, WNOHANG) == processId)
+		{
+			// reaped, so Stop doesn't wait for it
+			processId = -1;
+		}
+
+		bAreAlive = bAreAlive && processId > 0;
+	}
+
+	return bAreAlive;
+#endif
+}
+
+bool ShardedSimulation::Step(GraphicsState& outGraphicsState)
+{
+	if (control == nullptr || control->bHasFailed.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	const auto isOthersAlive = [this]() { return AreShardsAlive(); };
+
+	// the shards run the interval between the two
+	if (!WaitForShards(*control, isOthersAlive) || !WaitForShards(*control, isOthersAlive))
+	{
+		return false;
+	}
+
+	++intervalsCount;
+
+	outGraphicsState.bullets.clear();
+	outGraphicsState.destroyedWalls.clear();
+
+	for (int shardIndex = 0; shardIndex < settings.shardsCount; ++shardIndex)
+	{
+		const ShardOutput& output = *GetOutput(shardIndex);
+
+		const GraphicsState::Bullet* const shardBullets = reinterpret_cast<const GraphicsState::Bullet*>(reinterpret_cast<const char*>(&output) + sizeof(ShardOutput));
+
+		const int* const shardDestroyedWalls = reinterpret_cast<const int*>(shardBullets + settings.bulletsCapacity);
+
+		outGraphicsState.bullets.insert(outGraphicsState.bullets.end(), shardBullets, shardBullets + output.bulletsCount);
+
+		for (unsigned long long destroyedIndex = 0; destroyedIndex < output.destroyedWallsCount; ++destroyedIndex)
+		{
+			const int wallIndex = shardDestroyedWalls[destroyedIndex];
+
+			// a wall held by two shards may have been destroyed in both
+			if (!destroyedWalls[wallIndex])
+			{
+				destroyedWalls[wallIndex] = true;
+
+				outGraphicsState.destroyedWalls.push_back({ walls[wallIndex].start, walls[wallIndex].end });
+			}
+		}
+	}
+
+	outGraphicsState.walls.clear();
+
+	for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
+	{
+		if (!destroyedWalls[wallIndex])
+		{
+			outGraphicsState.walls.push_back({ walls[wallIndex].start, walls[wallIndex].end });
+		}
+	}
+
+	return true;
+}
+
+void ShardedSimulation::Stop()
+{
+#ifndef _WIN32
+	if (control == nullptr)
+	{
+		return;
+	}
+
+	control->bShouldStop = 1;
+
+	const bool bHaveShardsLeft = WaitForShards(*control, [this]() { return AreShardsAlive(); });
+
+	for (int processId : shardProcessIds)
+	{
+		if (processId <= 0)
+		{
+			continue;
+		}
+
+		// a shard still busy with the interval when another died wouldn't notice before it is done
+		if (!bHaveShardsLeft)
+		{
+			kill(processId, SIGKILL);
+		}
+
+		waitpid(processId, nullptr, 0);
+	}
+
+	shardProcessIds.clear();
+
+	munmap(control, regionSize);
+
+	control = nullptr;
+#endif
+}
+
+void ShardedSimulation::RunShard(int shardIndex)
+{
+	const int shardsCount = settings.shardsCount;
+
+	const float slabMinX = shardIndex > 0 ? splitsX[shardIndex - 1] : -std::numeric_limits<float>::max();
+	const float slabMaxX = shardIndex < shardsCount - 1 ? splitsX[shardIndex] : std::numeric_limits<float>::max();
+
+	std::vector<BulletManager::WallDefinition> shardWalls;
+
+	std::vector<int> shardWallIndices;
+
+	std::vector<int> localWallIndices(walls.size(), -1);
+
+	for (int wallIndex = 0; wallIndex < static_cast<int>(walls.size()); ++wallIndex)
+	{
+		int firstShard;
+		int lastShard;
+
+		GetWallHolders(wallIndex, firstShard, lastShard);
+
+		if (firstShard <= shardIndex && shardIndex <= lastShard)
+		{
+			localWallIndices[wallIndex] = static_cast<int>(shardWalls.size());
+
+			shardWalls.push_back(walls[wallIndex]);
+			shardWallIndices.push_back(wallIndex);
+		}
+	}
+
+	std::vector<BulletManager::BulletDefinition> shardBullets;
+
+	for (const BulletManager::BulletDefinition& bullet : bullets)
+	{
+		if (GetShardIndex(bullet.startingPosition.X) == shardIndex)
+		{
+			shardBullets.push_back(bullet);
+		}
+	}
+
+	BulletManager bulletManager(shardWalls, shardBullets);
+
+	std::unique_ptr<ThreadPool> threadPool;
+
+	if (settings.threadsPerShard > 1)
+	{
+		threadPool = std::make_unique<ThreadPool>(settings.threadsPerShard);
+	}
+
+	bulletManager.SetThreadPool(threadPool.get(), settings.threadsPerShard);
+
+	std::vector<BulletManager::WallDestruction> destructionLog;
+
+	bulletManager.SetWallDestructionLog(&destructionLog);
+
+	std::vector<BulletManager::BulletDefinition> handedOffBullets;
+
+	GraphicsState graphicsState;
+
+	ShardOutput& output = *GetOutput(shardIndex);
+
+	GraphicsState::Bullet* const outputBullets = reinterpret_cast<GraphicsState::Bullet*>(reinterpret_cast<char*>(&output) + sizeof(ShardOutput));
+
+	int* const outputDestroyedWalls = reinterpret_cast<int*>(outputBullets + settings.bulletsCapacity);
+
+	std::chrono::high_resolution_clock clock;
+
+	// orphans get adopted by another process, so the coordinator is gone once the parent changes
+	const auto isOthersAlive = [this]() { return getppid() == control->coordinatorProcessId; };
+
+	for (int intervalIndex = 0;; ++intervalIndex)
+	{
+		if (!WaitForShards(*control, isOthersAlive) || control->bShouldStop)
+		{
+			break;
+		}
+
+		// what the others posted at the end of the previous interval
+		for (int fromShard = 0; fromShard < shardsCount && intervalIndex > 0; ++fromShard)
+		{
+			const ShardMailbox& mailbox = *GetMailbox((intervalIndex - 1) % 2, fromShard, shardIndex);
+
+			const BulletManager::BulletDefinition* const mailboxBullets = reinterpret_cast<const BulletManager::BulletDefinition*>(reinterpret_cast<const char*>(&mailbox) + sizeof(ShardMailbox));
+
+			const BulletManager::WallDestruction* const mailboxWalls = reinterpret_cast<const BulletManager::WallDestruction*>(mailboxBullets + settings.mailboxCapacity);
+
+			for (unsigned long long bulletIndex = 0; bulletIndex < mailbox.bulletsCount; ++bulletIndex)
+			{
+				const BulletManager::BulletDefinition& bullet = mailboxBullets[bulletIndex];
+
+				bulletManager.AddBullet(bullet.startingPosition, bullet.velocity, bullet.startTime, bullet.lifetime);
+			}
+
+			for (unsigned long long destructionIndex = 0; destructionIndex < mailbox.wallsCount; ++destructionIndex)
+			{
+				const BulletManager::WallDestruction& destruction = mailboxWalls[destructionIndex];
+
+				if (localWallIndices[destruction.wallIndex] >= 0 && bulletManager.DestroyWall(localWallIndices[destruction.wallIndex], destruction.time))
+				{
+					++output.stats.remoteDestroyedWallsCount;
+				}
+			}
+
+			output.stats.receivedBulletsCount += mailbox.bulletsCount;
+		}
+
+		const auto simulationStartTime = clock.now();
+
+		for (int frameIndex = 0; frameIndex < framesPerInterval; ++frameIndex)
+		{
+			bulletManager.Update(settings.frameTime);
+		}
+
+		output.stats.simulationSeconds += std::chrono::duration<double>(clock.now() - simulationStartTime).count();
+
+		const int parity = intervalIndex % 2;
+
+		for (int toShard = 0; toShard < shardsCount; ++toShard)
+		{
+			GetMailbox(parity, shardIndex, toShard)->bulletsCount = 0;
+			GetMailbox(parity, shardIndex, toShard)->wallsCount = 0;
+		}
+
+		handedOffBullets.clear();
+
+		bulletManager.HandOffBulletsOutside({ slabMinX, -std::numeric_limits<float>::max() }, { slabMaxX, std::numeric_limits<float>::max() }, handedOffBullets);
+
+		for (const BulletManager::BulletDefinition& bullet : handedOffBullets)
+		{
+			ShardMailbox& mailbox = *GetMailbox(parity, shardIndex, GetShardIndex(BulletManager::EvaluateBulletLocation(bullet, bulletManager.GetCurrentTime()).X));
+
+			if (mailbox.bulletsCount == settings.mailboxCapacity)
+			{
+				++output.stats.droppedMessagesCount;
+				continue;
+			}
+
+			reinterpret_cast<BulletManager::BulletDefinition*>(reinterpret_cast<char*>(&mailbox) + sizeof(ShardMailbox))[mailbox.bulletsCount++] = bullet;
+
+			++output.stats.sentBulletsCount;
+		}
+
+		output.destroyedWallsCount = 0;
+
+		for (const BulletManager::WallDestruction& destruction : destructionLog)
+		{
+			const int wallIndex = shardWallIndices[destruction.wallIndex];
+
+			outputDestroyedWalls[output.destroyedWallsCount++] = wallIndex;
+
+			int firstShard;
+			int lastShard;
+
+			GetWallHolders(wallIndex, firstShard, lastShard);
+
+			for (int toShard = firstShard; toShard <= lastShard; ++toShard)
+			{
+				ShardMailbox& mailbox = *GetMailbox(parity, shardIndex, toShard);
+
+				if (toShard == shardIndex)
+				{
+					continue;
+				}
+
+				if (mailbox.wallsCount == settings.mailboxCapacity)
+				{
+					++output.stats.droppedMessagesCount;
+					continue;
+				}
+
+				BulletManager::BulletDefinition* const mailboxBullets = reinterpret_cast<BulletManager::BulletDefinition*>(reinterpret_cast<char*>(&mailbox) + sizeof(ShardMailbox));
+
+				reinterpret_cast<BulletManager::WallDestruction*>(mailboxBullets + settings.mailboxCapacity)[mailbox.wallsCount++] = { wallIndex, destruction.time, destruction.bulletId };
+			}
+		}
+
+		output.stats.destroyedWallsCount += destructionLog.size();
+
+		destructionLog.clear();
+
+		bulletManager.GenerateState(graphicsState);
+
+		output.bulletsCount = std::min<unsigned long long>(graphicsState.bullets.size(), settings.bulletsCapacity);
+
+		std::copy(graphicsState.bullets.begin(), graphicsState.bullets.begin() + output.bulletsCount, outputBullets);
+
+		output.stats.droppedBulletsCount += graphicsState.bullets.size() - output.bulletsCount;
+
+		output.stats.bulletsCount = bulletManager.GetBulletsCount();
+
+		if (!WaitForShards(*control, isOthersAlive))
+		{
+			break;
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include "Graphics.h"
+
+#include <vector>
+
+// Runs a world as several processes, each simulating one vertical slab of it with a BulletManager of its own.
+// A shard owns the walls whose middle lies in its slab and holds copies of the other walls within the ghost margin of it;
+// it simulates the bullets located in the slab. The shards advance in lockstep intervals, and at the end of each one
+// they post, into mailboxes in memory shared between the processes, the bullets that left their slab and the walls
+// they destroyed that other shards hold as well, and publish their bullets and destroyed walls for the coordinator to merge.
+// Within an interval a shard doesn't see the other shards' bullets or destructions, so a wall held twice can be hit in both
+// shards and bullets past the ghost margin miss walls; shorter intervals get closer to a single process. POSIX only
+class ShardedSimulation
+{
+public:
+	struct Settings
+	{
+		int shardsCount = 2;
+
+		// simulated time between two exchanges, rounded to whole frames
+		float syncInterval = 1.0f / 60;
+
+		float frameTime = 1.0f / 60;
+
+		int threadsPerShard = 1;
+
+		// how far outside its slab a shard keeps copies of walls; negative for the distance the fastest bullet flies in an interval,
+		// so that no bullet gets further out of its slab before it is handed off
+		float ghostMargin = -1;
+
+		// per mailbox, for bullets and for destroyed walls each
+		size_t mailboxCapacity = 4096;
+
+		// the bullets each shard can publish per interval
+		size_t bulletsCapacity = 65536;
+	};
+
+	struct ShardStats
+	{
+		unsigned long long bulletsCount = 0;
+
+		unsigned long long sentBulletsCount = 0;
+		unsigned long long receivedBulletsCount = 0;
+
+		// by the shard's own bullets, and applied from the other shards' messages
+		unsigned long long destroyedWallsCount = 0;
+		unsigned long long remoteDestroyedWallsCount = 0;
+
+		// messages that didn't fit into a mailbox and bullets that didn't fit into the output
+		unsigned long long droppedMessagesCount = 0;
+		unsigned long long droppedBulletsCount = 0;
+
+		double simulationSeconds = 0;
+	};
+
+	ShardedSimulation(const std::vector<BulletManager::WallDefinition>& inWalls, const std::vector<BulletManager::BulletDefinition>& inBullets, const Settings& inSettings);
+
+	~ShardedSimulation();
+
+	ShardedSimulation(const ShardedSimulation&) = delete;
+	ShardedSimulation& operator=(const ShardedSimulation&) = delete;
+
+	// maps the shared memory and forks the shards
+	bool Start();
+
+	// runs one interval in every shard and merges their outputs; the destroyed walls are the ones of this interval.
+	// Returns false once a shard has died, the others are then told to leave
+	bool Step(GraphicsState& outGraphicsState);
+
+	// waits for the shards to leave, kills them if one has died
+	void Stop();
+
+	float GetCurrentTime() const;
+
+	// as of the last Step
+	const ShardStats& GetShardStats(int shardIndex) const;
+
+private:
+	int GetShardIndex(float x) const;
+
+	// the shards holding the wall, a range since the slabs are in order
+	void GetWallHolders(int wallIndex, int& outFirstShard, int& outLastShard) const;
+
+	struct ShardOutput* GetOutput(int shardIndex) const;
+
+	struct ShardMailbox* GetMailbox(int parity, int fromShard, int toShard) const;
+
+	// reaps the shards that exited, returns false if any did
+	bool AreShardsAlive();
+
+	void RunShard(int shardIndex);
+
+	std::vector<BulletManager::WallDefinition> walls;
+
+	std::vector<BulletManager::BulletDefinition> bullets;
+
+	Settings settings;
+
+	int framesPerInterval = 1;
+
+	// the slab of shard i ends where the one of shard i + 1 starts, at splitsX[i]
+	std::vector<float> splitsX;
+
+	std::vector<bool> destroyedWalls;
+
+	std::vector<int> shardProcessIds;
+
+	struct ShardControl* control = nullptr;
+
+	size_t regionSize = 0;
+
+	size_t outputSize = 0;
+
+	size_t mailboxSize = 0;
+
+	int intervalsCount = 0;
+};
@@ -0,0 +1,276 @@
+#include "SharedState.h"
+
+#include <algorithm>
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr unsigned int sharedStateMagic = 0x54534253; // "SBST"
+
+static constexpr unsigned int sharedStateVersion = 1;
+
+static_assert(sizeof(SharedStateSlot) % alignof(GraphicsState::Wall) == 0, "Slot records must stay aligned after the slot header");
+
+static size_t GetSlotSize(size_t wallsCapacity, size_t bulletsCapacity)
+{
+	const size_t slotSize = sizeof(SharedStateSlot) + wallsCapacity * sizeof(GraphicsState::Wall) + bulletsCapacity * sizeof(GraphicsState::Bullet);
+
+	// keeps the next slot's counters aligned
+	return (slotSize + alignof(SharedStateSlot) - 1) / alignof(SharedStateSlot) * alignof(SharedStateSlot);
+}
+
+SharedStatePublisher::~SharedStatePublisher()
+{
+#ifndef _WIN32
+	if (header != nullptr)
+	{
+		munmap(header, regionSize);
+
+		shm_unlink(name.c_str());
+	}
+#endif
+}
+
+bool SharedStatePublisher::Create(const std::string& inName, size_t wallsCapacity, size_t bulletsCapacity)
+{
+#ifdef _WIN32
+	std::cout << "Shared state publication needs POSIX shared memory" << std::endl;
+	return false;
+#else
+	name = inName;
+
+	const size_t slotSize = GetSlotSize(wallsCapacity, bulletsCapacity);
+
+	regionSize = sizeof(SharedStateHeader) + 2 * slotSize;
+
+	const int fileDescriptor = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	const bool bWasResized = ftruncate(fileDescriptor, static_cast<off_t>(regionSize)) == 0;
+
+	void* const region = bWasResized ? mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0) : MAP_FAILED;
+
+	close(fileDescriptor);
+
+	if (region == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	header = static_cast<SharedStateHeader*>(region);
+
+	header->magic = sharedStateMagic;
+	header->version = sharedStateVersion;
+	header->wallsCapacity = wallsCapacity;
+	header->bulletsCapacity = bulletsCapacity;
+	header->slotSize = slotSize;
+	header->generation.store(0, std::memory_order_relaxed);
+
+	for (unsigned long long slotIndex = 0; slotIndex < 2; ++slotIndex)
+	{
+		SharedStateSlot& slot = GetSlot(slotIndex);
+
+		slot.sequence.store(0, std::memory_order_relaxed);
+		slot.wallsCount = 0;
+		slot.bulletsCount = 0;
+	}
+
+	return true;
+#endif
+}
+
+SharedStateSlot& SharedStatePublisher::GetSlot(unsigned long long generation) const
+{
+	char* const slots = reinterpret_cast<char*>(header) + sizeof(SharedStateHeader);
+
+	return *reinterpret_cast<SharedStateSlot*>(slots + (generation % 2) * header->slotSize);
+}
+
+bool SharedStatePublisher::BeginPublish(size_t wallsCount, size_t bulletsCount, GraphicsState::Wall*& outWalls, GraphicsState::Bullet*& outBullets)
+{
+	if (header == nullptr || wallsCount > header->wallsCapacity || bulletsCount > header->bulletsCapacity)
+	{
+		++droppedFramesCount;
+		return false;
+	}
+
+	SharedStateSlot& slot = GetSlot(header->generation.load(std::memory_order_relaxed) + 1);
+
+	// odd while written
+	slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.wallsCount = wallsCount;
+	slot.bulletsCount = bulletsCount;
+
+	char* const records = reinterpret_cast<char*>(&slot) + sizeof(SharedStateSlot);
+
+	outWalls = reinterpret_cast<GraphicsState::Wall*>(records);
+	outBullets = reinterpret_cast<GraphicsState::Bullet*>(records + header->wallsCapacity * sizeof(GraphicsState::Wall));
+
+	return true;
+}
+
+void SharedStatePublisher::EndPublish(float time, unsigned int wallsRevision)
+{
+	const unsigned long long generation = header->generation.load(std::memory_order_relaxed) + 1;
+
+	SharedStateSlot& slot = GetSlot(generation);
+
+	slot.time = time;
+	slot.wallsRevision = wallsRevision;
+
+	slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+	header->generation.store(generation, std::memory_order_release);
+}
+
+SharedStateReader::~SharedStateReader()
+{
+#ifndef _WIN32
+	if (header != nullptr)
+	{
+		munmap(const_cast<SharedStateHeader*>(header), regionSize);
+	}
+#endif
+}
+
+bool SharedStateReader::Open(const std::string& name)
+{
+#ifdef _WIN32
+	std::cout << "Shared state publication needs POSIX shared memory" << std::endl;
+	return false;
+#else
+	const int fileDescriptor = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStatus;
+
+	void* region = MAP_FAILED;
+
+	if (fstat(fileDescriptor, &fileStatus) == 0 && static_cast<size_t>(fileStatus.st_size) >= sizeof(SharedStateHeader))
+	{
+		regionSize = static_cast<size_t>(fileStatus.st_size);
+
+		region = mmap(nullptr, regionSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	}
+
+	close(fileDescriptor);
+
+	if (region == MAP_FAILED)
+	{
+		return false;
+	}
+
+	header = static_cast<const SharedStateHeader*>(region);
+
+	if (header->magic != sharedStateMagic || header->version != sharedStateVersion || regionSize < sizeof(SharedStateHeader) + 2 * header->slotSize)
+	{
+		munmap(region, regionSize);
+
+		header = nullptr;
+
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+unsigned long long SharedStateReader::GetGeneration() const
+{
+	return header != nullptr ? header->generation.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedStateReader::BeginRead(SharedStateView& outView) const
+{
+	const unsigned long long generation = GetGeneration();
+
+	if (generation == 0)
+	{
+		return false;
+	}
+
+	const char* const slots = reinterpret_cast<const char*>(header) + sizeof(SharedStateHeader);
+
+	const SharedStateSlot& slot = *reinterpret_cast<const SharedStateSlot*>(slots + (generation % 2) * header->slotSize);
+
+	outView.slot = &slot;
+
+	outView.sequence = slot.sequence.load(std::memory_order_acquire);
+
+	if (outView.sequence % 2 != 0)
+	{
+		return false;
+	}
+
+	const char* const records = reinterpret_cast<const char*>(&slot) + sizeof(SharedStateSlot);
+
+	outView.time = slot.time;
+	outView.wallsRevision = slot.wallsRevision;
+
+	// the counts may be torn as well, they are only trusted within the capacities
+	outView.wallsCount = static_cast<size_t>(std::min(slot.wallsCount, header->wallsCapacity));
+	outView.bulletsCount = static_cast<size_t>(std::min(slot.bulletsCount, header->bulletsCapacity));
+
+	outView.walls = reinterpret_cast<const GraphicsState::Wall*>(records);
+	outView.bullets = reinterpret_cast<const GraphicsState::Bullet*>(records + header->wallsCapacity * sizeof(GraphicsState::Wall));
+
+	return true;
+}
+
+bool SharedStateReader::IsStillValid(const SharedStateView& view) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return view.slot != nullptr && view.slot->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+bool SharedStateReader::Read(GraphicsState& outGraphicsState) const
+{
+	constexpr int maxAttempts = 16;
+
+	for (int attempt = 0; attempt < maxAttempts; ++attempt)
+	{
+		SharedStateView view;
+
+		if (!BeginRead(view))
+		{
+			if (GetGeneration() == 0)
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		outGraphicsState.walls.assign(view.walls, view.walls + view.wallsCount);
+		outGraphicsState.bullets.assign(view.bullets, view.bullets + view.bulletsCount);
+
+		if (IsStillValid(view))
+		{
+			outGraphicsState.destroyedWalls.clear();
+			outGraphicsState.wallsRevision = view.wallsRevision;
+
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Graphics.h"
+
+#include <atomic>
+
+#include <string>
+
+// Shared memory layout: SharedStateHeader, then two slots, each a SharedStateSlot followed by room for
+// wallsCapacity walls and then bulletsCapacity bullets. The publisher fills the slot readers aren't pointed at
+// and then moves the generation on; every slot also has a sequence that is odd while it's written, so a reader
+// that was overtaken by two frames finds out and reads again.
+struct SharedStateHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long wallsCapacity;
+	unsigned long long bulletsCapacity;
+	unsigned long long slotSize;
+
+	// the latest complete slot is generation % 2
+	std::atomic<unsigned long long> generation;
+};
+
+struct SharedStateSlot
+{
+	std::atomic<unsigned int> sequence;
+	float time;
+	unsigned int wallsRevision;
+	unsigned int padding;
+	unsigned long long wallsCount;
+	unsigned long long bulletsCount;
+};
+
+// Publishes frames into a POSIX shared memory object that any number of local processes can map
+class SharedStatePublisher
+{
+public:
+	~SharedStatePublisher();
+
+	// the capacities are fixed for the life of the object, frames that don't fit are dropped
+	bool Create(const std::string& name, size_t wallsCapacity, size_t bulletsCapacity);
+
+	// points at the room for the frame in the slot being written; false if the frame doesn't fit
+	bool BeginPublish(size_t wallsCount, size_t bulletsCount, GraphicsState::Wall*& outWalls, GraphicsState::Bullet*& outBullets);
+
+	void EndPublish(float time, unsigned int wallsRevision);
+
+	size_t GetDroppedFramesCount() const { return droppedFramesCount; }
+
+private:
+	SharedStateSlot& GetSlot(unsigned long long generation) const;
+
+	std::string name;
+
+	SharedStateHeader* header = nullptr;
+
+	size_t regionSize = 0;
+
+	size_t droppedFramesCount = 0;
+};
+
+// A frame read in place; the data may be overwritten while it's used, IsStillValid tells afterwards
+struct SharedStateView
+{
+	float time = 0;
+
+	unsigned int wallsRevision = 0;
+
+	const GraphicsState::Wall* walls = nullptr;
+	size_t wallsCount = 0;
+
+	const GraphicsState::Bullet* bullets = nullptr;
+	size_t bulletsCount = 0;
+
+	const SharedStateSlot* slot = nullptr;
+
+	unsigned int sequence = 0;
+};
+
+class SharedStateReader
+{
+public:
+	~SharedStateReader();
+
+	bool Open(const std::string& name);
+
+	// the latest complete frame, false if none has been published yet
+	bool BeginRead(SharedStateView& outView) const;
+
+	// false if the publisher wrote into the frame while it was read
+	bool IsStillValid(const SharedStateView& view) const;
+
+	// copies the latest frame, retrying while the publisher overtakes it
+	bool Read(GraphicsState& outGraphicsState) const;
+
+	unsigned long long GetGeneration() const;
+
+private:
+	const SharedStateHeader* header = nullptr;
+
+	size_t regionSize = 0;
+};
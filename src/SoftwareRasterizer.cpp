@@ -0,0 +1,382 @@
+#include "SoftwareRasterizer.h"
+
+#include "Graphics.h"
+
+#include "ParallelUtils.h"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BULLETS_RASTERIZER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static constexpr int bandHeight = 32;
+
+static constexpr unsigned int backgroundColour = 0xFF000000;
+
+static constexpr unsigned int wallColour = 0xFFC80000;
+
+static unsigned int ResolvePixel(unsigned short density, unsigned char wallCoverage, const unsigned int* heatPalette)
+{
+	if (density > 0)
+	{
+		return heatPalette[density < 255 ? density : 255];
+	}
+
+	return wallCoverage != 0 ? wallColour : backgroundColour;
+}
+
+// bullets on top of walls on top of the background
+static void ResolveRow(const unsigned short* density, const unsigned char* wallCoverage, const unsigned int* heatPalette, unsigned int* pixels, int count)
+{
+	int index = 0;
+
+#ifdef BULLETS_RASTERIZER_SSE2
+	// most of a frame is usually empty, so runs of 8 empty pixels are filled with the background at once
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i background = _mm_set1_epi32(static_cast<int>(backgroundColour));
+
+	for (; index + 8 <= count; index += 8)
+	{
+		const __m128i densities = _mm_loadu_si128(reinterpret_cast<const __m128i*>(density + index));
+		const __m128i coverage = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(wallCoverage + index));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(densities, coverage), zero)) == 0xFFFF)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + index), background);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + index + 4), background);
+
+			continue;
+		}
+
+		for (int pixel = index; pixel < index + 8; ++pixel)
+		{
+			pixels[pixel] = ResolvePixel(density[pixel], wallCoverage[pixel], heatPalette);
+		}
+	}
+#endif
+
+	for (; index < count; ++index)
+	{
+		pixels[index] = ResolvePixel(density[index], wallCoverage[index], heatPalette);
+	}
+}
+
+// Liang-Barsky; false if nothing of the segment is inside the box
+static bool ClipSegment(Vector2& start, Vector2& end, const Vector2& boxMin, const Vector2& boxMax)
+{
+	const Vector2 change = end - start;
+
+	const float directions[4] = { -change.X, change.X, -change.Y, change.Y };
+	const float distances[4] = { start.X - boxMin.X, boxMax.X - start.X, start.Y - boxMin.Y, boxMax.Y - start.Y };
+
+	float enterFraction = 0;
+	float exitFraction = 1;
+
+	for (int sideIndex = 0; sideIndex < 4; ++sideIndex)
+	{
+		if (directions[sideIndex] == 0)
+		{
+			if (distances[sideIndex] < 0)
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		const float fraction = distances[sideIndex] / directions[sideIndex];
+
+		if (directions[sideIndex] < 0)
+		{
+			enterFraction = std::fmax(enterFraction, fraction);
+		}
+		else
+		{
+			exitFraction = std::fmin(exitFraction, fraction);
+		}
+	}
+
+	if (enterFraction > exitFraction)
+	{
+		return false;
+	}
+
+	const Vector2 originalStart = start;
+
+	start = originalStart + change * enterFraction;
+	end = originalStart + change * exitFraction;
+
+	return true;
+}
+
+struct SoftwareRasterizer::BinBulletsStage
+{
+	// counts the bullets of every band when there are no band offsets, writes their pixel indices from the offsets otherwise
+	BinBulletsStage(SoftwareRasterizer& rasterizer, const std::vector<GraphicsState::Bullet>& bullets, std::pair<int, int> bulletsInterval, const Vector2& viewOrigin, float viewScale, std::vector<int> bandOffsets) :
+		rasterizer(rasterizer), bullets(bullets), bulletsInterval(bulletsInterval), viewOrigin(viewOrigin), viewScale(viewScale), bandOffsets(std::move(bandOffsets))
+	{
+	}
+
+	void DoWork()
+	{
+		bandCounts.assign(rasterizer.bandsCount, 0);
+
+		unsigned int* const output = bandOffsets.empty() ? nullptr : rasterizer.binnedBullets.data();
+
+		for (int bulletIndex = bulletsInterval.first; bulletIndex < bulletsInterval.second; ++bulletIndex)
+		{
+			const Vector2 location = (bullets[bulletIndex].location - viewOrigin) * viewScale;
+
+			if (location.X < 0 || location.Y < 0 || location.X >= rasterizer.width || location.Y >= rasterizer.height)
+			{
+				continue;
+			}
+
+			const int x = static_cast<int>(location.X);
+			const int y = static_cast<int>(location.Y);
+
+			const int band = y / bandHeight;
+
+			if (output != nullptr)
+			{
+				output[bandOffsets[band] + bandCounts[band]] = static_cast<unsigned int>(y * rasterizer.width + x);
+			}
+
+			++bandCounts[band];
+		}
+	}
+
+	SoftwareRasterizer& rasterizer;
+
+	const std::vector<GraphicsState::Bullet>& bullets;
+
+	std::pair<int, int> bulletsInterval;
+
+	Vector2 viewOrigin;
+
+	float viewScale;
+
+	std::vector<int> bandOffsets;
+
+	std::vector<int> bandCounts;
+};
+
+struct SoftwareRasterizer::RasterizeBandStage
+{
+	RasterizeBandStage(SoftwareRasterizer& rasterizer, const std::vector<GraphicsState::Wall>& walls, int firstBand, int endBand, const Vector2& viewOrigin, float viewScale) :
+		rasterizer(rasterizer), walls(walls), firstBand(firstBand), endBand(endBand), viewOrigin(viewOrigin), viewScale(viewScale)
+	{
+	}
+
+	void DoWork()
+	{
+		const int width = rasterizer.width;
+
+		const int firstRow = firstBand * bandHeight;
+		const int endRow = std::min(rasterizer.height, endBand * bandHeight);
+
+		if (firstRow >= endRow)
+		{
+			return;
+		}
+
+		const size_t firstPixel = static_cast<size_t>(firstRow) * width;
+		const size_t pixelsCount = static_cast<size_t>(endRow - firstRow) * width;
+
+		unsigned short* const density = rasterizer.density.data();
+		unsigned char* const wallCoverage = rasterizer.wallCoverage.data();
+
+		std::memset(density + firstPixel, 0, pixelsCount * sizeof(unsigned short));
+		std::memset(wallCoverage + firstPixel, 0, pixelsCount);
+
+		for (int bulletIndex = rasterizer.bandBulletStarts[firstBand]; bulletIndex < rasterizer.bandBulletStarts[endBand]; ++bulletIndex)
+		{
+			unsigned short& pixelDensity = density[rasterizer.binnedBullets[bulletIndex]];
+
+			if (pixelDensity < 0xFFFF)
+			{
+				++pixelDensity;
+			}
+		}
+
+		// keep the clipped ends strictly inside the rows of the stage
+		const Vector2 clipMin{ 0, static_cast<float>(firstRow) };
+		const Vector2 clipMax{ width - 0.001f, endRow - 0.001f };
+
+		for (const GraphicsState::Wall& wall : walls)
+		{
+			Vector2 start = (wall.start - viewOrigin) * viewScale;
+			Vector2 end = (wall.end - viewOrigin) * viewScale;
+
+			if (!ClipSegment(start, end, clipMin, clipMax))
+			{
+				continue;
+			}
+
+			const Vector2 change = end - start;
+
+			const int stepsCount = static_cast<int>(std::ceil(std::fmax(std::abs(change.X), std::abs(change.Y)))) + 1;
+
+			for (int stepIndex = 0; stepIndex <= stepsCount; ++stepIndex)
+			{
+				const Vector2 location = start + change * (static_cast<float>(stepIndex) / stepsCount);
+
+				const int x = static_cast<int>(location.X);
+				const int y = static_cast<int>(location.Y);
+
+				if (x >= 0 && x < width && y >= firstRow && y < endRow)
+				{
+					wallCoverage[static_cast<size_t>(y) * width + x] = 1;
+				}
+			}
+		}
+
+		for (int row = firstRow; row < endRow; ++row)
+		{
+			const size_t rowStart = static_cast<size_t>(row) * width;
+
+			ResolveRow(density + rowStart, wallCoverage + rowStart, rasterizer.heatPalette.data(), rasterizer.pixels.data() + rowStart, width);
+		}
+	}
+
+	SoftwareRasterizer& rasterizer;
+
+	const std::vector<GraphicsState::Wall>& walls;
+
+	int firstBand;
+
+	int endBand;
+
+	Vector2 viewOrigin;
+
+	float viewScale;
+};
+
+SoftwareRasterizer::SoftwareRasterizer(int inThreadsCount) : threadsCount(std::max(1, inThreadsCount)), threadPool(std::make_unique<ThreadPool>(threadsCount))
+{
+	// green for a single bullet like the SDL path, then yellow, red and white on a logarithmic scale
+	heatPalette.resize(256, backgroundColour);
+
+	for (int bulletsCount = 1; bulletsCount < 256; ++bulletsCount)
+	{
+		const float heat = std::log2(static_cast<float>(bulletsCount)) / 8;
+
+		float red;
+		float green;
+		float blue;
+
+		if (heat < 1.0f / 3)
+		{
+			red = heat * 3;
+			green = 1;
+			blue = 0;
+		}
+		else if (heat < 2.0f / 3)
+		{
+			red = 1;
+			green = 2 - heat * 3;
+			blue = 0;
+		}
+		else
+		{
+			red = 1;
+			green = heat * 3 - 2;
+			blue = heat * 3 - 2;
+		}
+
+		const auto toChannel = [](float value) { return static_cast<unsigned int>(std::fmin(1.0f, std::fmax(0.0f, value)) * 255); };
+
+		heatPalette[bulletsCount] = 0xFF000000 | (toChannel(red) << 16) | (toChannel(green) << 8) | toChannel(blue);
+	}
+}
+
+SoftwareRasterizer::~SoftwareRasterizer() = default;
+
+void SoftwareRasterizer::Resize(int inWidth, int inHeight)
+{
+	if (inWidth == width && inHeight == height)
+	{
+		return;
+	}
+
+	width = inWidth;
+	height = inHeight;
+
+	bandsCount = (height + bandHeight - 1) / bandHeight;
+
+	const size_t pixelsCount = static_cast<size_t>(width) * height;
+
+	pixels.assign(pixelsCount, backgroundColour);
+	density.assign(pixelsCount, 0);
+	wallCoverage.assign(pixelsCount, 0);
+
+	bandBulletStarts.assign(bandsCount + 1, 0);
+}
+
+void SoftwareRasterizer::Render(const GraphicsState& graphicsState, int inWidth, int inHeight, const Vector2& viewOrigin, float viewScale)
+{
+	Resize(inWidth, inHeight);
+
+	if (bandsCount == 0)
+	{
+		return;
+	}
+
+	const std::vector<GraphicsState::Bullet>& bullets = graphicsState.bullets;
+
+	constexpr int minimalBulletsPerStage = 16 * 1024;
+
+	const int binStagesCount = std::max(1, std::min(threadsCount, static_cast<int>(bullets.size() / minimalBulletsPerStage)));
+
+	const auto getBulletsInterval = [&bullets, binStagesCount](int stageIndex)
+	{
+		const int bulletsCount = static_cast<int>(bullets.size());
+
+		return std::make_pair((bulletsCount * stageIndex) / binStagesCount, (bulletsCount * (stageIndex + 1)) / binStagesCount);
+	};
+
+	const std::vector<BinBulletsStage> countStages = RunStage<BinBulletsStage>([&](int stageIndex)
+	{
+		return BinBulletsStage(*this, bullets, getBulletsInterval(stageIndex), viewOrigin, viewScale, std::vector<int>());
+	}, binStagesCount, *threadPool);
+
+	// every stage writes its bullets of a band after the ones of the previous stages
+	std::vector<std::vector<int>> stageBandOffsets(binStagesCount, std::vector<int>(bandsCount));
+
+	int binnedBulletsCount = 0;
+
+	for (int band = 0; band < bandsCount; ++band)
+	{
+		bandBulletStarts[band] = binnedBulletsCount;
+
+		for (int stageIndex = 0; stageIndex < binStagesCount; ++stageIndex)
+		{
+			stageBandOffsets[stageIndex][band] = binnedBulletsCount;
+
+			binnedBulletsCount += countStages[stageIndex].bandCounts[band];
+		}
+	}
+
+	bandBulletStarts[bandsCount] = binnedBulletsCount;
+
+	binnedBullets.resize(binnedBulletsCount);
+
+	RunStage<BinBulletsStage>([&](int stageIndex)
+	{
+		return BinBulletsStage(*this, bullets, getBulletsInterval(stageIndex), viewOrigin, viewScale, std::move(stageBandOffsets[stageIndex]));
+	}, binStagesCount, *threadPool);
+
+	// a few more stages than threads evens out bands that are busier than others
+	const int rasterStagesCount = std::min(bandsCount, threadsCount * 2);
+
+	RunStage<RasterizeBandStage>([&](int stageIndex)
+	{
+		return RasterizeBandStage(*this, graphicsState.walls, (bandsCount * stageIndex) / rasterStagesCount, (bandsCount * (stageIndex + 1)) / rasterStagesCount, viewOrigin, viewScale);
+	}, rasterStagesCount, *threadPool);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Common.h"
+
+#include <memory>
+
+#include <vector>
+
+struct GraphicsState;
+
+class ThreadPool;
+
+// Draws walls and bullets into a CPU framebuffer, for bullet counts the SDL primitives can't keep up with.
+// The frame is split into bands of rows that are rasterised in parallel; bullets are binned into the bands first
+// so that every band only touches its own bullets. Every bullet is a single pixel and pixels hit by several
+// bullets are coloured by a heat palette.
+class SoftwareRasterizer
+{
+public:
+	explicit SoftwareRasterizer(int inThreadsCount);
+
+	~SoftwareRasterizer();
+
+	void Render(const GraphicsState& graphicsState, int inWidth, int inHeight, const Vector2& viewOrigin, float viewScale);
+
+	// ARGB8888, width pixels per row
+	const unsigned int* GetPixels() const { return pixels.data(); }
+
+	int GetPitch() const { return width * static_cast<int>(sizeof(unsigned int)); }
+
+	struct BinBulletsStage;
+
+	struct RasterizeBandStage;
+
+private:
+	void Resize(int inWidth, int inHeight);
+
+	int threadsCount;
+
+	std::unique_ptr<ThreadPool> threadPool;
+
+	int width = 0;
+
+	int height = 0;
+
+	int bandsCount = 0;
+
+	std::vector<unsigned int> pixels;
+
+	// bullets per pixel
+	std::vector<unsigned short> density;
+
+	std::vector<unsigned char> wallCoverage;
+
+	// pixel indices of the bullets on screen, grouped by band
+	std::vector<int> bandBulletStarts;
+
+	std::vector<unsigned int> binnedBullets;
+
+	// colours for 0..255 bullets in a pixel
+	std::vector<unsigned int> heatPalette;
+};
@@ -0,0 +1,537 @@
+#include "StreamingJsonLoader.h"
+
+#include "MappedFile.h"
+
+#include "ParallelUtils.h"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <cstring>
+
+namespace
+{
+	struct JsonCursor
+	{
+		JsonCursor(const char* inPosition, const char* inEnd) : position(inPosition), end(inEnd)
+		{
+		}
+
+		void SkipWhitespace()
+		{
+			while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+			{
+				++position;
+			}
+		}
+
+		bool TryConsume(char expected)
+		{
+			SkipWhitespace();
+
+			if (position < end && *position == expected)
+			{
+				++position;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool Expect(char expected)
+		{
+			if (!TryConsume(expected))
+			{
+				bFailed = true;
+			}
+
+			return !bFailed;
+		}
+
+		bool ParseKey(const char*& outKey, size_t& outKeyLength)
+		{
+			if (!Expect('"'))
+			{
+				return false;
+			}
+
+			outKey = position;
+
+			while (position < end && *position != '"')
+			{
+				position += (*position == '\\') ? 2 : 1;
+			}
+
+			if (position >= end)
+			{
+				bFailed = true;
+				return false;
+			}
+
+			outKeyLength = position - outKey;
+
+			++position;
+
+			return Expect(':');
+		}
+
+		bool ParseNumber(float& outNumber)
+		{
+			SkipWhitespace();
+
+			const bool bIsNegative = position < end && *position == '-';
+
+			if (bIsNegative)
+			{
+				++position;
+			}
+
+			const char* const digitsStart = position;
+
+			double value = 0;
+
+			while (position < end && *position >= '0' && *position <= '9')
+			{
+				value = value * 10 + (*position - '0');
+				++position;
+			}
+
+			if (position < end && *position == '.')
+			{
+				++position;
+
+				double fractionScale = 0.1;
+
+				while (position < end && *position >= '0' && *position <= '9')
+				{
+					value += (*position - '0') * fractionScale;
+					fractionScale *= 0.1;
+					++position;
+				}
+			}
+
+			if (position == digitsStart)
+			{
+				bFailed = true;
+				return false;
+			}
+
+			if (position < end && (*position == 'e' || *position == 'E'))
+			{
+				++position;
+
+				const bool bIsExponentNegative = position < end && *position == '-';
+
+				if (position < end && (*position == '-' || *position == '+'))
+				{
+					++position;
+				}
+
+				// past the range of doubles, whatever the digits before it, the value is already 0 or infinite
+				constexpr int maxExponent = 1000;
+
+				int exponent = 0;
+
+				while (position < end && *position >= '0' && *position <= '9')
+				{
+					exponent = std::min(maxExponent, exponent * 10 + (*position - '0'));
+					++position;
+				}
+
+				for (int exponentIndex = 0; exponentIndex < exponent; ++exponentIndex)
+				{
+					value = bIsExponentNegative ? value / 10 : value * 10;
+				}
+			}
+
+			outNumber = static_cast<float>(bIsNegative ? -value : value);
+
+			// too large for a float
+			if (!std::isfinite(outNumber))
+			{
+				bFailed = true;
+				return false;
+			}
+
+			return true;
+		}
+
+		// skips a value of a key we don't care about
+		bool SkipValue()
+		{
+			SkipWhitespace();
+
+			int depth = 0;
+
+			while (position < end)
+			{
+				const char character = *position;
+
+				if (character == '"')
+				{
+					++position;
+
+					while (position < end && *position != '"')
+					{
+						position += (*position == '\\') ? 2 : 1;
+					}
+				}
+				else if (character == '{' || character == '[')
+				{
+					++depth;
+				}
+				else if (character == '}' || character == ']')
+				{
+					if (depth == 0)
+					{
+						return true;
+					}
+
+					--depth;
+				}
+				else if (character == ',' && depth == 0)
+				{
+					return true;
+				}
+
+				++position;
+			}
+
+			bFailed = true;
+			return false;
+		}
+
+		template <class TFieldParser>
+		bool ParseObject(TFieldParser parseField)
+		{
+			if (!Expect('{'))
+			{
+				return false;
+			}
+
+			if (TryConsume('}'))
+			{
+				return true;
+			}
+
+			do
+			{
+				const char* key;
+				size_t keyLength;
+
+				if (!ParseKey(key, keyLength) || !parseField(key, keyLength))
+				{
+					bFailed = true;
+					return false;
+				}
+			} while (TryConsume(','));
+
+			return Expect('}');
+		}
+
+		bool ParseVector(Vector2& outVector)
+		{
+			return ParseObject([this, &outVector](const char* key, size_t keyLength)
+			{
+				if (IsKey(key, keyLength, "x"))
+				{
+					return ParseNumber(outVector.X);
+				}
+
+				if (IsKey(key, keyLength, "y"))
+				{
+					return ParseNumber(outVector.Y);
+				}
+
+				return SkipValue();
+			});
+		}
+
+		static bool IsKey(const char* key, size_t keyLength, const char* expectedKey)
+		{
+			return keyLength == std::strlen(expectedKey) && std::memcmp(key, expectedKey, keyLength) == 0;
+		}
+
+		const char* position;
+
+		const char* end;
+
+		bool bFailed = false;
+	};
+
+	bool ParseWall(JsonCursor& cursor, BulletManager::Wall& outWall)
+	{
+		Vector2 start = Vector2::Zero;
+		Vector2 end = Vector2::Zero;
+
+		const bool bWasParsed = cursor.ParseObject([&cursor, &start, &end](const char* key, size_t keyLength)
+		{
+			if (JsonCursor::IsKey(key, keyLength, "start"))
+			{
+				return cursor.ParseVector(start);
+			}
+
+			if (JsonCursor::IsKey(key, keyLength, "end"))
+			{
+				return cursor.ParseVector(end);
+			}
+
+			return cursor.SkipValue();
+		});
+
+		outWall.definition = BulletManager::WallDefinition(start, end);
+		outWall.timeDestroyed = -1;
+
+		return bWasParsed;
+	}
+
+	bool ParseBullet(JsonCursor& cursor, BulletManager::Bullet& outBullet)
+	{
+		Vector2 start = Vector2::Zero;
+		Vector2 velocity = Vector2::Zero;
+		float startTime = 0;
+		float lifetime = 10;
+
+		const bool bWasParsed = cursor.ParseObject([&cursor, &start, &velocity, &startTime, &lifetime](const char* key, size_t keyLength)
+		{
+			if (JsonCursor::IsKey(key, keyLength, "start"))
+			{
+				return cursor.ParseVector(start);
+			}
+
+			if (JsonCursor::IsKey(key, keyLength, "velocity"))
+			{
+				return cursor.ParseVector(velocity);
+			}
+
+			if (JsonCursor::IsKey(key, keyLength, "startTime"))
+			{
+				return cursor.ParseNumber(startTime);
+			}
+
+			if (JsonCursor::IsKey(key, keyLength, "lifetime"))
+			{
+				return cursor.ParseNumber(lifetime);
+			}
+
+			return cursor.SkipValue();
+		});
+
+		outBullet.definition = BulletManager::BulletDefinition(start, velocity, startTime, lifetime);
+
+		return bWasParsed;
+	}
+
+	// finds the first top level object of the array that starts at or after the position;
+	// the records only nest objects under keys, so "}, {" can only separate two top level objects
+	const char* FindNextRecordStart(const char* position, const char* end)
+	{
+		for (; position < end; ++position)
+		{
+			if (*position != '}')
+			{
+				continue;
+			}
+
+			JsonCursor cursor(position + 1, end);
+
+			if (cursor.TryConsume(',') && cursor.TryConsume('{'))
+			{
+				return cursor.position - 1;
+			}
+		}
+
+		return end;
+	}
+
+	struct CountRecordsStage
+	{
+		CountRecordsStage(const char* inChunkStart, const char* inChunkEnd) : chunkStart(inChunkStart), chunkEnd(inChunkEnd)
+		{
+		}
+
+		void DoWork()
+		{
+			int depth = 0;
+
+			for (const char* position = chunkStart; position < chunkEnd; ++position)
+			{
+				const char character = *position;
+
+				if (character == '"')
+				{
+					++position;
+
+					while (position < chunkEnd && *position != '"')
+					{
+						position += (*position == '\\') ? 2 : 1;
+					}
+				}
+				else if (character == '{')
+				{
+					if (depth == 0)
+					{
+						++recordsCount;
+					}
+
+					++depth;
+				}
+				else if (character == '}')
+				{
+					--depth;
+				}
+				else if (character == ']' && depth == 0)
+				{
+					// end of the array
+					return;
+				}
+			}
+		}
+
+		const char* chunkStart;
+
+		const char* chunkEnd;
+
+		int recordsCount = 0;
+	};
+
+	template <class TRecord>
+	struct ParseRecordsStage
+	{
+		typedef bool (*RecordParser)(JsonCursor&, TRecord&);
+
+		ParseRecordsStage(const char* inChunkStart, const char* inFileEnd, int inRecordsCount, TRecord* inOutput, RecordParser inParseRecord) :
+			chunkStart(inChunkStart), fileEnd(inFileEnd), recordsCount(inRecordsCount), output(inOutput), parseRecord(inParseRecord)
+		{
+		}
+
+		void DoWork()
+		{
+			JsonCursor cursor(chunkStart, fileEnd);
+
+			for (int recordIndex = 0; recordIndex < recordsCount; ++recordIndex)
+			{
+				if (recordIndex > 0 && !cursor.Expect(','))
+				{
+					break;
+				}
+
+				if (!parseRecord(cursor, output[recordIndex]))
+				{
+					break;
+				}
+			}
+
+			bFailed = cursor.bFailed;
+		}
+
+		const char* chunkStart;
+
+		const char* fileEnd;
+
+		int recordsCount;
+
+		TRecord* output;
+
+		RecordParser parseRecord;
+
+		bool bFailed = false;
+	};
+
+	template <class TRecord>
+	bool StreamRecordsFromJson(const std::string& jsonPath, std::vector<TRecord>& outRecords, int chunksCount, typename ParseRecordsStage<TRecord>::RecordParser parseRecord)
+	{
+		MappedFile file;
+
+		if (!file.Open(jsonPath))
+		{
+			return false;
+		}
+
+		const char* const fileEnd = file.GetData() + file.GetSize();
+
+		JsonCursor cursor(file.GetData(), fileEnd);
+
+		if (!cursor.Expect('['))
+		{
+			return false;
+		}
+
+		if (cursor.TryConsume(']'))
+		{
+			outRecords.clear();
+			return true;
+		}
+
+		const char* const arrayStart = cursor.position;
+
+		// tiny files are not worth the threads
+		constexpr size_t minimalChunkSize = 64 * 1024;
+
+		const size_t arraySize = fileEnd - arrayStart;
+
+		if (chunksCount < 1 || arraySize / chunksCount < minimalChunkSize)
+		{
+			chunksCount = static_cast<int>(arraySize / minimalChunkSize) + 1;
+		}
+
+		std::vector<const char*> chunkStarts(chunksCount + 1);
+
+		chunkStarts[0] = arrayStart;
+		chunkStarts[chunksCount] = fileEnd;
+
+		for (int chunkIndex = 1; chunkIndex < chunksCount; ++chunkIndex)
+		{
+			const char* const approximateStart = arrayStart + (arraySize * chunkIndex) / chunksCount;
+
+			chunkStarts[chunkIndex] = FindNextRecordStart(std::max(approximateStart, chunkStarts[chunkIndex - 1]), fileEnd);
+		}
+
+		const bool bUseThreads = chunksCount > 1;
+
+		const std::vector<CountRecordsStage> countStages = RunStage<CountRecordsStage>([&chunkStarts](int chunkIndex)
+		{
+			return CountRecordsStage(chunkStarts[chunkIndex], chunkStarts[chunkIndex + 1]);
+		}, chunksCount, bUseThreads);
+
+		std::vector<int> chunkOffsets(chunksCount + 1, 0);
+
+		for (int chunkIndex = 0; chunkIndex < chunksCount; ++chunkIndex)
+		{
+			chunkOffsets[chunkIndex + 1] = chunkOffsets[chunkIndex] + countStages[chunkIndex].recordsCount;
+		}
+
+		outRecords.resize(chunkOffsets[chunksCount]);
+
+		TRecord* const output = outRecords.data();
+
+		const std::vector<ParseRecordsStage<TRecord>> parseStages = RunStage<ParseRecordsStage<TRecord>>([&chunkStarts, &chunkOffsets, fileEnd, output, parseRecord](int chunkIndex)
+		{
+			const int recordsCount = chunkOffsets[chunkIndex + 1] - chunkOffsets[chunkIndex];
+
+			return ParseRecordsStage<TRecord>(chunkStarts[chunkIndex], fileEnd, recordsCount, output + chunkOffsets[chunkIndex], parseRecord);
+		}, chunksCount, bUseThreads);
+
+		for (const ParseRecordsStage<TRecord>& stage : parseStages)
+		{
+			if (stage.bFailed)
+			{
+				outRecords.clear();
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+bool StreamWallsFromJson(const std::string& jsonPath, std::vector<BulletManager::Wall>& outWalls, int chunksCount)
+{
+	return StreamRecordsFromJson(jsonPath, outWalls, chunksCount, &ParseWall);
+}
+
+bool StreamBulletsFromJson(const std::string& jsonPath, std::vector<BulletManager::Bullet>& outBullets, int chunksCount)
+{
+	return StreamRecordsFromJson(jsonPath, outBullets, chunksCount, &ParseBullet);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <string>
+
+#include <vector>
+
+// Reads the walls.json/bullets.json arrays without building a DOM.
+// The file is mapped and split into chunks at object boundaries; the chunks are counted and then
+// parsed in parallel straight into the final storage, so nothing is allocated besides the output.
+// Only the shapes written by generate_walls.py and generate_bullets.py are understood.
+bool StreamWallsFromJson(const std::string& jsonPath, std::vector<BulletManager::Wall>& outWalls, int chunksCount);
+
+bool StreamBulletsFromJson(const std::string& jsonPath, std::vector<BulletManager::Bullet>& outBullets, int chunksCount);
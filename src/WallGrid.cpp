@@ -0,0 +1,492 @@
+#include "WallGrid.h"
+
+#include "BinaryIO.h"
+
+#include <cmath>
+
+#include <cstdio>
+
+#include <cstring>
+
+#include <fstream>
+
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WALL_GRID_USE_SSE 1
+#endif
+
+static constexpr unsigned int wallGridMagic = 0x44524742; // "BGRD"
+
+static constexpr unsigned int wallGridVersion = 1;
+
+struct WallGridFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long wallsHash;
+	unsigned long long wallsCount;
+	unsigned long long wallIndicesCount;
+	float originX;
+	float originY;
+	float cellSize;
+	int cellsX;
+	int cellsY;
+	int reserved;
+};
+
+static_assert(sizeof(WallGridFileHeader) % alignof(int) == 0, "Cell arrays must stay aligned after the header");
+
+template <class TVisitor>
+void WallGrid::ForEachCellOnSegment(const Vector2& start, const Vector2& end, TVisitor visitor) const
+{
+	// walk the columns the segment spans and take the rows it covers inside each column
+	const Vector2 left = (start.X <= end.X ? start : end) - origin;
+	const Vector2 right = (start.X <= end.X ? end : start) - origin;
+
+	const int firstColumn = GetCellCoordinate(left.X, cellsX);
+	const int lastColumn = GetCellCoordinate(right.X, cellsX);
+
+	const float width = right.X - left.X;
+
+	for (int column = firstColumn; column <= lastColumn; ++column)
+	{
+		const float columnStartX = std::fmax(left.X, column * cellSize);
+		const float columnEndX = std::fmin(right.X, (column + 1) * cellSize);
+
+		float columnStartY = left.Y;
+		float columnEndY = right.Y;
+
+		if (width > 0)
+		{
+			columnStartY = left.Y + (right.Y - left.Y) * ((columnStartX - left.X) / width);
+			columnEndY = left.Y + (right.Y - left.Y) * ((columnEndX - left.X) / width);
+		}
+
+		const int firstRow = GetCellCoordinate(std::fmin(columnStartY, columnEndY), cellsY);
+		const int lastRow = GetCellCoordinate(std::fmax(columnStartY, columnEndY), cellsY);
+
+		for (int row = firstRow; row <= lastRow; ++row)
+		{
+			visitor(row * cellsX + column);
+		}
+	}
+}
+
+void WallGrid::Build(const std::vector<BulletManager::Wall>& walls)
+{
+	mappedFile.Close();
+
+	Vector2 boundsMin{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	Vector2 boundsMax{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+	for (const BulletManager::Wall& wall : walls)
+	{
+		boundsMin.X = std::fmin(boundsMin.X, std::fmin(wall.definition.start.X, wall.definition.end.X));
+		boundsMin.Y = std::fmin(boundsMin.Y, std::fmin(wall.definition.start.Y, wall.definition.end.Y));
+		boundsMax.X = std::fmax(boundsMax.X, std::fmax(wall.definition.start.X, wall.definition.end.X));
+		boundsMax.Y = std::fmax(boundsMax.Y, std::fmax(wall.definition.start.Y, wall.definition.end.Y));
+	}
+
+	if (walls.empty())
+	{
+		boundsMin = Vector2::Zero;
+		boundsMax = Vector2::Zero;
+	}
+
+	// aim for about one cell per wall
+	constexpr int maxCellsPerAxis = 1024;
+
+	const int cellsPerAxis = std::max(1, std::min(maxCellsPerAxis, static_cast<int>(std::sqrt(static_cast<double>(walls.size())))));
+
+	const float extent = std::fmax(boundsMax.X - boundsMin.X, boundsMax.Y - boundsMin.Y);
+
+	origin = boundsMin;
+	cellSize = extent > 0 ? extent / cellsPerAxis : 1;
+	cellsX = std::max(1, std::min(cellsPerAxis, static_cast<int>(std::ceil((boundsMax.X - boundsMin.X) / cellSize))));
+	cellsY = std::max(1, std::min(cellsPerAxis, static_cast<int>(std::ceil((boundsMax.Y - boundsMin.Y) / cellSize))));
+
+	FillCells(walls);
+}
+
+void WallGrid::Build(const std::vector<BulletManager::Wall>& walls, const WallGrid& layout)
+{
+	mappedFile.Close();
+
+	origin = layout.origin;
+	cellSize = layout.cellSize;
+	cellsX = layout.cellsX;
+	cellsY = layout.cellsY;
+
+	FillCells(walls);
+}
+
+void WallGrid::GetColumnsSpan(float minX, float maxX, float& outMinX, float& outMaxX) const
+{
+	outMinX = origin.X + GetCellCoordinate(minX - origin.X, cellsX) * cellSize;
+	outMaxX = origin.X + (GetCellCoordinate(maxX - origin.X, cellsX) + 1) * cellSize;
+}
+
+void WallGrid::FillCells(const std::vector<BulletManager::Wall>& walls)
+{
+	const int cellsCount = cellsX * cellsY;
+
+	ownedCellStarts.assign(cellsCount + 1, 0);
+
+	for (const BulletManager::Wall& wall : walls)
+	{
+		ForEachCellOnSegment(wall.definition.start, wall.definition.end, [this](int cellIndex) { ++ownedCellStarts[cellIndex + 1]; });
+	}
+
+	for (int cellIndex = 0; cellIndex < cellsCount; ++cellIndex)
+	{
+		ownedCellStarts[cellIndex + 1] += ownedCellStarts[cellIndex];
+	}
+
+	ownedWallIndices.resize(ownedCellStarts[cellsCount]);
+
+	std::vector<int> cellFillPositions(ownedCellStarts.begin(), ownedCellStarts.end() - 1);
+
+	for (int wallIndex = 0; wallIndex < static_cast<int>(walls.size()); ++wallIndex)
+	{
+		const BulletManager::Wall& wall = walls[wallIndex];
+
+		ForEachCellOnSegment(wall.definition.start, wall.definition.end, [this, &cellFillPositions, wallIndex](int cellIndex)
+		{
+			ownedWallIndices[cellFillPositions[cellIndex]++] = wallIndex;
+		});
+	}
+
+	cellStarts = ownedCellStarts.data();
+	wallIndices = ownedWallIndices.data();
+
+	indexedWallsCount = walls.size();
+
+	FillEntryBounds(walls);
+}
+
+void WallGrid::FillEntryBounds(const std::vector<BulletManager::Wall>& walls)
+{
+	const size_t entriesCount = static_cast<size_t>(cellStarts[cellsX * cellsY]);
+
+	entriesMinX.resize(entriesCount);
+	entriesMinY.resize(entriesCount);
+	entriesMaxX.resize(entriesCount);
+	entriesMaxY.resize(entriesCount);
+	entriesFlags.resize(entriesCount);
+
+	std::vector<int> wallCellsCounts(walls.size(), 0);
+
+	for (size_t entry = 0; entry < entriesCount; ++entry)
+	{
+		++wallCellsCounts[wallIndices[entry]];
+	}
+
+	for (size_t entry = 0; entry < entriesCount; ++entry)
+	{
+		const BulletManager::WallDefinition& wall = walls[wallIndices[entry]].definition;
+
+		entriesMinX[entry] = std::fmin(wall.start.X, wall.end.X);
+		entriesMinY[entry] = std::fmin(wall.start.Y, wall.end.Y);
+		entriesMaxX[entry] = std::fmax(wall.start.X, wall.end.X);
+		entriesMaxY[entry] = std::fmax(wall.start.Y, wall.end.Y);
+
+		// the same left end ForEachCellOnSegment takes
+		const Vector2& left = wall.start.X <= wall.end.X ? wall.start : wall.end;
+		const Vector2& right = wall.start.X <= wall.end.X ? wall.end : wall.start;
+
+		entriesFlags[entry] = (wallCellsCounts[wallIndices[entry]] > 1 ? entryCrossesCellsFlag : 0) | (left.Y <= right.Y ? entryRisesFlag : 0);
+	}
+}
+
+size_t WallGrid::GetWallsOverlappingBox(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, std::vector<int>& outWallIndices) const
+{
+	return AppendWallsInBox(boxMin, boxMax, startWallIndex, endWallIndex, true, outWallIndices);
+}
+
+size_t WallGrid::GetWallsInCells(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, std::vector<int>& outWallIndices) const
+{
+	return AppendWallsInBox(boxMin, boxMax, startWallIndex, endWallIndex, false, outWallIndices);
+}
+
+size_t WallGrid::AppendWallsInBox(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, bool bTestBoxes, std::vector<int>& outWallIndices) const
+{
+	if (boxMax.X < origin.X || boxMax.Y < origin.Y || boxMin.X > origin.X + cellsX * cellSize || boxMin.Y > origin.Y + cellsY * cellSize)
+	{
+		return 0;
+	}
+
+	const CellRange cellRange{ GetCellCoordinate(boxMin.X - origin.X, cellsX), GetCellCoordinate(boxMax.X - origin.X, cellsX), GetCellCoordinate(boxMin.Y - origin.Y, cellsY), GetCellCoordinate(boxMax.Y - origin.Y, cellsY) };
+
+	size_t comparedWallsCount = 0;
+
+	for (int cellY = cellRange.minY; cellY <= cellRange.maxY; ++cellY)
+	{
+		for (int cellX = cellRange.minX; cellX <= cellRange.maxX; ++cellX)
+		{
+			const int cellIndex = cellY * cellsX + cellX;
+
+			const int* const cellStart = wallIndices + cellStarts[cellIndex];
+			const int* const cellEnd = wallIndices + cellStarts[cellIndex + 1];
+
+			// the lists are sorted by wall index, so the range of walls is a contiguous part of the cell
+			const int* const rangeStart = std::lower_bound(cellStart, cellEnd, startWallIndex);
+			const int* const rangeEnd = std::lower_bound(rangeStart, cellEnd, endWallIndex);
+
+			comparedWallsCount += AppendOverlappingEntries(static_cast<int>(rangeStart - wallIndices), static_cast<int>(rangeEnd - wallIndices), cellIndex, cellRange, boxMin, boxMax, bTestBoxes, outWallIndices);
+		}
+	}
+
+	return comparedWallsCount;
+}
+
+bool WallGrid::IsFirstCellOfEntry(int entry, int cellIndex, const CellRange& cellRange) const
+{
+	if (!(entriesFlags[entry] & entryCrossesCellsFlag) || cellIndex == cellRange.minY * cellsX + cellRange.minX)
+	{
+		return true;
+	}
+
+	const bool bIsRising = (entriesFlags[entry] & entryRisesFlag) != 0;
+
+	const Vector2 left{ entriesMinX[entry], bIsRising ? entriesMinY[entry] : entriesMaxY[entry] };
+	const Vector2 right{ entriesMaxX[entry], bIsRising ? entriesMaxY[entry] : entriesMinY[entry] };
+
+	// the cells are visited row by row, so the first one is the lowest index in the range; the walk is the one that filled the cells
+	bool bIsFirst = true;
+
+	ForEachCellOnSegment(left, right, [this, cellIndex, &cellRange, &bIsFirst](int wallCellIndex)
+	{
+		const int cellX = wallCellIndex % cellsX;
+		const int cellY = wallCellIndex / cellsX;
+
+		if (wallCellIndex < cellIndex && cellRange.minX <= cellX && cellX <= cellRange.maxX && cellRange.minY <= cellY && cellY <= cellRange.maxY)
+		{
+			bIsFirst = false;
+		}
+	});
+
+	return bIsFirst;
+}
+
+size_t WallGrid::AppendOverlappingEntries(int startEntry, int endEntry, int cellIndex, const CellRange& cellRange, const Vector2& boxMin, const Vector2& boxMax, bool bTestBoxes, std::vector<int>& outWallIndices) const
+{
+	// a box within one cell can't meet a wall twice
+	const bool bIsSingleCell = cellRange.minX == cellRange.maxX && cellRange.minY == cellRange.maxY;
+
+	size_t firstEntriesCount = 0;
+
+	int entry = startEntry;
+
+#ifdef WALL_GRID_USE_SSE
+	const __m128 boxMinX = _mm_set1_ps(boxMin.X);
+	const __m128 boxMinY = _mm_set1_ps(boxMin.Y);
+	const __m128 boxMaxX = _mm_set1_ps(boxMax.X);
+	const __m128 boxMaxY = _mm_set1_ps(boxMax.Y);
+
+	for (; entry + 4 <= endEntry; entry += 4)
+	{
+		const __m128 overlapsX = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(entriesMinX.data() + entry), boxMaxX), _mm_cmple_ps(boxMinX, _mm_loadu_ps(entriesMaxX.data() + entry)));
+		const __m128 overlapsY = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(entriesMinY.data() + entry), boxMaxY), _mm_cmple_ps(boxMinY, _mm_loadu_ps(entriesMaxY.data() + entry)));
+
+		const int overlapMask = bTestBoxes ? _mm_movemask_ps(_mm_and_ps(overlapsX, overlapsY)) : 0xf;
+
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			if (!bIsSingleCell && !IsFirstCellOfEntry(entry + lane, cellIndex, cellRange))
+			{
+				continue;
+			}
+
+			++firstEntriesCount;
+
+			if ((overlapMask >> lane) & 1)
+			{
+				outWallIndices.push_back(wallIndices[entry + lane]);
+			}
+		}
+	}
+#endif
+
+	for (; entry < endEntry; ++entry)
+	{
+		if (!bIsSingleCell && !IsFirstCellOfEntry(entry, cellIndex, cellRange))
+		{
+			continue;
+		}
+
+		++firstEntriesCount;
+
+		if (!bTestBoxes || (entriesMinX[entry] <= boxMax.X && boxMin.X <= entriesMaxX[entry] && entriesMinY[entry] <= boxMax.Y && boxMin.Y <= entriesMaxY[entry]))
+		{
+			outWallIndices.push_back(wallIndices[entry]);
+		}
+	}
+
+	return firstEntriesCount;
+}
+
+bool WallGrid::Save(const std::string& path, unsigned long long wallsHash) const
+{
+	if (!IsBuilt())
+	{
+		return false;
+	}
+
+	// written next to the index and renamed over it once complete, so that a crash never leaves a torn index under the path
+	const std::string partialPath = path + ".tmp";
+
+	{
+		std::ofstream stream(partialPath, std::ios::binary);
+
+		if (!stream)
+		{
+			return false;
+		}
+
+		const unsigned long long wallIndicesCount = static_cast<unsigned long long>(cellStarts[cellsX * cellsY]);
+
+		const WallGridFileHeader header{ wallGridMagic, wallGridVersion, wallsHash, indexedWallsCount, wallIndicesCount, origin.X, origin.Y, cellSize, cellsX, cellsY, 0 };
+
+		WriteBinary(stream, header);
+
+		stream.write(reinterpret_cast<const char*>(cellStarts), sizeof(int) * (cellsX * cellsY + 1));
+
+		stream.write(reinterpret_cast<const char*>(wallIndices), sizeof(int) * wallIndicesCount);
+
+		stream.close();
+
+		if (!stream)
+		{
+			std::remove(partialPath.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	// rename doesn't replace an existing file there
+	std::remove(path.c_str());
+#endif
+
+	if (std::rename(partialPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(partialPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool WallGrid::Load(const std::string& path, unsigned long long wallsHash, const std::vector<BulletManager::Wall>& walls)
+{
+	MappedFile file;
+
+	if (!file.Open(path) || file.GetSize() < sizeof(WallGridFileHeader))
+	{
+		return false;
+	}
+
+	WallGridFileHeader header;
+
+	std::memcpy(&header, file.GetData(), sizeof(header));
+
+	if (header.magic != wallGridMagic || header.version != wallGridVersion || header.wallsHash != wallsHash || header.wallsCount != walls.size())
+	{
+		return false;
+	}
+
+	// the cells are indexed with ints, which also keeps the size below from overflowing
+	constexpr unsigned long long maxCount = static_cast<unsigned long long>(std::numeric_limits<int>::max());
+
+	if (!(header.cellSize > 0) || !std::isfinite(header.cellSize) || header.cellsX <= 0 || header.cellsY <= 0
+		|| static_cast<unsigned long long>(header.cellsX) * static_cast<unsigned long long>(header.cellsY) >= maxCount || header.wallIndicesCount > maxCount)
+	{
+		return false;
+	}
+
+	const size_t cellStartsCount = static_cast<size_t>(header.cellsX) * header.cellsY + 1;
+
+	if (file.GetSize() != sizeof(WallGridFileHeader) + sizeof(int) * (cellStartsCount + header.wallIndicesCount))
+	{
+		return false;
+	}
+
+	const int* const mappedCellStarts = reinterpret_cast<const int*>(file.GetData() + sizeof(WallGridFileHeader));
+	const int* const mappedWallIndices = mappedCellStarts + cellStartsCount;
+
+	// every lookup trusts these, so a broken file must not get past here
+	if (mappedCellStarts[0] != 0 || static_cast<unsigned long long>(mappedCellStarts[cellStartsCount - 1]) != header.wallIndicesCount)
+	{
+		return false;
+	}
+
+	const int wallsCount = static_cast<int>(walls.size());
+
+	for (size_t cellIndex = 0; cellIndex + 1 < cellStartsCount; ++cellIndex)
+	{
+		if (mappedCellStarts[cellIndex] > mappedCellStarts[cellIndex + 1])
+		{
+			return false;
+		}
+
+		// the lists are searched with lower_bound, so they have to stay sorted
+		for (int entryIndex = mappedCellStarts[cellIndex]; entryIndex < mappedCellStarts[cellIndex + 1]; ++entryIndex)
+		{
+			const int wallIndex = mappedWallIndices[entryIndex];
+
+			if (wallIndex < 0 || wallIndex >= wallsCount || (entryIndex > mappedCellStarts[cellIndex] && wallIndex <= mappedWallIndices[entryIndex - 1]))
+			{
+				return false;
+			}
+		}
+	}
+
+	ownedCellStarts.clear();
+	ownedWallIndices.clear();
+
+	origin = Vector2{ header.originX, header.originY };
+	cellSize = header.cellSize;
+	cellsX = header.cellsX;
+	cellsY = header.cellsY;
+
+	indexedWallsCount = static_cast<size_t>(header.wallsCount);
+
+	cellStarts = mappedCellStarts;
+	wallIndices = mappedWallIndices;
+
+	mappedFile = std::move(file);
+
+	FillEntryBounds(walls);
+
+	return true;
+}
+
+unsigned long long WallGrid::HashWalls(const std::vector<BulletManager::Wall>& walls)
+{
+	// FNV-1a over the wall endpoints
+	unsigned long long hash = 14695981039346656037ull;
+
+	const auto hashBytes = [&hash](const void* data, size_t size)
+	{
+		const unsigned char* const bytes = static_cast<const unsigned char*>(data);
+
+		for (size_t byteIndex = 0; byteIndex < size; ++byteIndex)
+		{
+			hash ^= bytes[byteIndex];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	const unsigned long long wallsCount = walls.size();
+
+	hashBytes(&wallsCount, sizeof(wallsCount));
+
+	for (const BulletManager::Wall& wall : walls)
+	{
+		hashBytes(&wall.definition.start, sizeof(Vector2));
+		hashBytes(&wall.definition.end, sizeof(Vector2));
+	}
+
+	return hash;
+}
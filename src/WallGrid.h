@@ -0,0 +1,155 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+
+#include <string>
+
+#include <vector>
+
+// Uniform grid over the bounding box of the walls. Every cell lists the walls whose segment crosses it.
+// The lists are stored back to back (cellStarts/wallIndices) and every list is sorted by wall index,
+// which lets a filter stage that owns a range of walls pick its part of a cell with a binary search.
+// The arrays either live in owned vectors or point into a mapped index file.
+// Every entry of the lists also has the bounding box of its wall, in coordinate arrays laid out like wallIndices,
+// so that the boxes of a cell are contiguous and can be compared with the box of a bullet sweep four at a time.
+class WallGrid
+{
+public:
+	WallGrid() = default;
+
+	WallGrid(const WallGrid&) = delete;
+	WallGrid& operator=(const WallGrid&) = delete;
+
+	void Build(const std::vector<BulletManager::Wall>& walls);
+
+	// uses the cells of another grid, so that a box finds the same walls as it does there among the ones in both
+	void Build(const std::vector<BulletManager::Wall>& walls, const WallGrid& layout);
+
+	bool Save(const std::string& path, unsigned long long wallsHash) const;
+
+	// fails if the file is missing, broken or was built for different walls; the wall bounds are taken from the walls
+	bool Load(const std::string& path, unsigned long long wallsHash, const std::vector<BulletManager::Wall>& walls);
+
+	static unsigned long long HashWalls(const std::vector<BulletManager::Wall>& walls);
+
+	bool IsBuilt() const { return cellStarts != nullptr; }
+
+	float GetCellSize() const { return cellSize; }
+
+	// the box the cells cover; walls outside of it aren't indexed
+	void GetBounds(Vector2& outMin, Vector2& outMax) const
+	{
+		outMin = origin;
+		outMax = origin + Vector2{ cellsX * cellSize, cellsY * cellSize };
+	}
+
+	// the x range of the columns of cells that cover the one given
+	void GetColumnsSpan(float minX, float maxX, float& outMinX, float& outMaxX) const;
+
+	// calls visitor(wallIndex) for the walls in [startWallIndex, endWallIndex) that cross any cell overlapping the box;
+	// a wall crossing several of those cells is visited several times
+	template <class TVisitor>
+	void ForEachWallInBox(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, TVisitor visitor) const
+	{
+		if (boxMax.X < origin.X || boxMax.Y < origin.Y || boxMin.X > origin.X + cellsX * cellSize || boxMin.Y > origin.Y + cellsY * cellSize)
+		{
+			return;
+		}
+
+		const int minCellX = GetCellCoordinate(boxMin.X - origin.X, cellsX);
+		const int maxCellX = GetCellCoordinate(boxMax.X - origin.X, cellsX);
+		const int minCellY = GetCellCoordinate(boxMin.Y - origin.Y, cellsY);
+		const int maxCellY = GetCellCoordinate(boxMax.Y - origin.Y, cellsY);
+
+		for (int cellY = minCellY; cellY <= maxCellY; ++cellY)
+		{
+			for (int cellX = minCellX; cellX <= maxCellX; ++cellX)
+			{
+				const int cellIndex = cellY * cellsX + cellX;
+
+				const int* const cellEnd = wallIndices + cellStarts[cellIndex + 1];
+
+				for (const int* wallIndex = std::lower_bound(wallIndices + cellStarts[cellIndex], cellEnd, startWallIndex); wallIndex != cellEnd && *wallIndex < endWallIndex; ++wallIndex)
+				{
+					visitor(*wallIndex);
+				}
+			}
+		}
+	}
+
+	// appends the walls in [startWallIndex, endWallIndex) that cross a cell overlapping the box and whose bounding box overlaps it,
+	// with SSE where available; a wall crossing several of those cells is taken only from the first of them.
+	// Returns how many walls were compared
+	size_t GetWallsOverlappingBox(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, std::vector<int>& outWallIndices) const;
+
+	// the same without comparing the bounding boxes, every wall of the cells is appended once
+	size_t GetWallsInCells(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, std::vector<int>& outWallIndices) const;
+
+private:
+	int GetCellCoordinate(float offset, int cellsCount) const
+	{
+		const int coordinate = static_cast<int>(offset / cellSize);
+
+		return coordinate < 0 ? 0 : (coordinate >= cellsCount ? cellsCount - 1 : coordinate);
+	}
+
+	void FillCells(const std::vector<BulletManager::Wall>& walls);
+
+	// the boxes of the walls of every entry of wallIndices
+	void FillEntryBounds(const std::vector<BulletManager::Wall>& walls);
+
+	// the cells overlapping a box
+	struct CellRange
+	{
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+
+	size_t AppendWallsInBox(const Vector2& boxMin, const Vector2& boxMax, int startWallIndex, int endWallIndex, bool bTestBoxes, std::vector<int>& outWallIndices) const;
+
+	// returns how many of the entries were the first entry of their wall in the cells of the range
+	size_t AppendOverlappingEntries(int startEntry, int endEntry, int cellIndex, const CellRange& cellRange, const Vector2& boxMin, const Vector2& boxMax, bool bTestBoxes, std::vector<int>& outWallIndices) const;
+
+	// whether no cell before this one in the range lists the wall of the entry too
+	bool IsFirstCellOfEntry(int entry, int cellIndex, const CellRange& cellRange) const;
+
+	template <class TVisitor>
+	void ForEachCellOnSegment(const Vector2& start, const Vector2& end, TVisitor visitor) const;
+
+	Vector2 origin = Vector2::Zero;
+
+	float cellSize = 1;
+
+	int cellsX = 0;
+
+	int cellsY = 0;
+
+	size_t indexedWallsCount = 0;
+
+	const int* cellStarts = nullptr;
+
+	const int* wallIndices = nullptr;
+
+	std::vector<int> ownedCellStarts;
+
+	std::vector<int> ownedWallIndices;
+
+	std::vector<float> entriesMinX;
+	std::vector<float> entriesMinY;
+	std::vector<float> entriesMaxX;
+	std::vector<float> entriesMaxY;
+
+	// whether the wall of the entry crosses several cells, and whether it rises from its left end, which puts its segment back together from the box
+	static constexpr unsigned char entryCrossesCellsFlag = 1;
+	static constexpr unsigned char entryRisesFlag = 2;
+
+	std::vector<unsigned char> entriesFlags;
+
+	MappedFile mappedFile;
+};
@@ -0,0 +1,222 @@
+#include "WallTileStore.h"
+
+#include "BinaryIO.h"
+
+#include <algorithm>
+
+static constexpr unsigned int wallTileStoreMagic = 0x4C495442; // "BTIL"
+
+static constexpr unsigned int wallTileStoreVersion = 1;
+
+struct WallTileStoreHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	int tilesX;
+	int tilesY;
+	float originX;
+	float originY;
+	float tileSize;
+	float maxWallOverhang;
+	unsigned long long wallsCount;
+};
+
+bool WallTileStore::Open(const std::string& path)
+{
+	stream.close();
+	stream.clear();
+	stream.open(path, std::ios::binary | std::ios::in | std::ios::out);
+
+	tiles.clear();
+
+	WallTileStoreHeader header;
+
+	if (!ReadBinary(stream, header) || header.magic != wallTileStoreMagic || header.version != wallTileStoreVersion || header.tilesX <= 0 || header.tilesY <= 0 || header.tileSize <= 0)
+	{
+		return false;
+	}
+
+	origin = Vector2{ header.originX, header.originY };
+	tileSize = header.tileSize;
+	maxWallOverhang = header.maxWallOverhang;
+	tilesX = header.tilesX;
+	tilesY = header.tilesY;
+
+	tiles.resize(static_cast<size_t>(tilesX) * tilesY);
+
+	stream.read(reinterpret_cast<char*>(tiles.data()), sizeof(TileInfo) * tiles.size());
+
+	if (!stream)
+	{
+		tiles.clear();
+		return false;
+	}
+
+	recordsOffset = sizeof(WallTileStoreHeader) + sizeof(TileInfo) * tiles.size();
+
+	return true;
+}
+
+bool WallTileStore::ReadTile(int tileIndex, std::vector<BulletManager::Wall>& outWalls)
+{
+	const TileInfo& tile = tiles[tileIndex];
+
+	std::vector<WallRecord> records(tile.wallsCount);
+
+	stream.seekg(recordsOffset + tile.firstWall * sizeof(WallRecord));
+
+	stream.read(reinterpret_cast<char*>(records.data()), sizeof(WallRecord) * records.size());
+
+	if (!stream)
+	{
+		stream.clear();
+		return false;
+	}
+
+	outWalls.reserve(outWalls.size() + records.size());
+
+	for (const WallRecord& record : records)
+	{
+		BulletManager::Wall wall{ BulletManager::WallDefinition(record.start, record.end) };
+
+		wall.timeDestroyed = record.timeDestroyed;
+
+		outWalls.push_back(wall);
+	}
+
+	return true;
+}
+
+bool WallTileStore::WriteTile(int tileIndex, const BulletManager::Wall* walls)
+{
+	const TileInfo& tile = tiles[tileIndex];
+
+	std::vector<WallRecord> records;
+
+	records.reserve(tile.wallsCount);
+
+	for (unsigned int wallIndex = 0; wallIndex < tile.wallsCount; ++wallIndex)
+	{
+		const BulletManager::Wall& wall = walls[wallIndex];
+
+		records.push_back({ wall.definition.start, wall.definition.end, wall.timeDestroyed });
+	}
+
+	stream.seekp(recordsOffset + tile.firstWall * sizeof(WallRecord));
+
+	stream.write(reinterpret_cast<const char*>(records.data()), sizeof(WallRecord) * records.size());
+
+	stream.flush();
+
+	if (!stream)
+	{
+		stream.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool WallTileStore::Write(const std::string& path, const std::vector<BulletManager::WallDefinition>& walls, float tileSize)
+{
+	if (tileSize <= 0)
+	{
+		return false;
+	}
+
+	Vector2 boundsMin{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	Vector2 boundsMax{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+	for (const BulletManager::WallDefinition& wall : walls)
+	{
+		boundsMin = Vector2{ std::fmin(boundsMin.X, std::fmin(wall.start.X, wall.end.X)), std::fmin(boundsMin.Y, std::fmin(wall.start.Y, wall.end.Y)) };
+		boundsMax = Vector2{ std::fmax(boundsMax.X, std::fmax(wall.start.X, wall.end.X)), std::fmax(boundsMax.Y, std::fmax(wall.start.Y, wall.end.Y)) };
+	}
+
+	if (walls.empty())
+	{
+		boundsMin = Vector2::Zero;
+		boundsMax = Vector2::Zero;
+	}
+
+	const int tilesX = std::max(1, static_cast<int>(std::ceil((boundsMax.X - boundsMin.X) / tileSize)));
+	const int tilesY = std::max(1, static_cast<int>(std::ceil((boundsMax.Y - boundsMin.Y) / tileSize)));
+
+	const auto getTileCoordinate = [tileSize](float offset, int tilesCount)
+	{
+		return std::max(0, std::min(tilesCount - 1, static_cast<int>(std::floor(offset / tileSize))));
+	};
+
+	std::vector<int> wallTiles(walls.size());
+
+	std::vector<TileInfo> tiles(static_cast<size_t>(tilesX) * tilesY, TileInfo{ 0, 0, 0, Vector2{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max() }, Vector2{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() } });
+
+	float maxWallOverhang = 0;
+
+	for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
+	{
+		const BulletManager::WallDefinition& wall = walls[wallIndex];
+
+		const Vector2 midpoint = (wall.start + wall.end) / 2;
+
+		const int tileX = getTileCoordinate(midpoint.X - boundsMin.X, tilesX);
+		const int tileY = getTileCoordinate(midpoint.Y - boundsMin.Y, tilesY);
+
+		const int tileIndex = tileY * tilesX + tileX;
+
+		wallTiles[wallIndex] = tileIndex;
+
+		TileInfo& tile = tiles[tileIndex];
+
+		++tile.wallsCount;
+
+		const Vector2 wallMin{ std::fmin(wall.start.X, wall.end.X), std::fmin(wall.start.Y, wall.end.Y) };
+		const Vector2 wallMax{ std::fmax(wall.start.X, wall.end.X), std::fmax(wall.start.Y, wall.end.Y) };
+
+		tile.wallsMin = Vector2{ std::fmin(tile.wallsMin.X, wallMin.X), std::fmin(tile.wallsMin.Y, wallMin.Y) };
+		tile.wallsMax = Vector2{ std::fmax(tile.wallsMax.X, wallMax.X), std::fmax(tile.wallsMax.Y, wallMax.Y) };
+
+		const Vector2 tileMin = boundsMin + Vector2{ tileX * tileSize, tileY * tileSize };
+		const Vector2 tileMax = tileMin + Vector2{ tileSize, tileSize };
+
+		maxWallOverhang = std::fmax(maxWallOverhang, std::fmax(std::fmax(tileMin.X - wallMin.X, tileMin.Y - wallMin.Y), std::fmax(wallMax.X - tileMax.X, wallMax.Y - tileMax.Y)));
+	}
+
+	unsigned long long firstWall = 0;
+
+	for (TileInfo& tile : tiles)
+	{
+		tile.firstWall = firstWall;
+
+		firstWall += tile.wallsCount;
+	}
+
+	std::vector<WallRecord> records(walls.size());
+
+	std::vector<unsigned long long> tileFillPositions(tiles.size());
+
+	for (size_t tileIndex = 0; tileIndex < tiles.size(); ++tileIndex)
+	{
+		tileFillPositions[tileIndex] = tiles[tileIndex].firstWall;
+	}
+
+	for (size_t wallIndex = 0; wallIndex < walls.size(); ++wallIndex)
+	{
+		records[tileFillPositions[wallTiles[wallIndex]]++] = WallRecord{ walls[wallIndex].start, walls[wallIndex].end, -1 };
+	}
+
+	std::ofstream outputStream(path, std::ios::binary);
+
+	if (!outputStream)
+	{
+		return false;
+	}
+
+	WriteBinary(outputStream, WallTileStoreHeader{ wallTileStoreMagic, wallTileStoreVersion, tilesX, tilesY, boundsMin.X, boundsMin.Y, tileSize, maxWallOverhang, walls.size() });
+
+	outputStream.write(reinterpret_cast<const char*>(tiles.data()), sizeof(TileInfo) * tiles.size());
+
+	outputStream.write(reinterpret_cast<const char*>(records.data()), sizeof(WallRecord) * records.size());
+
+	return static_cast<bool>(outputStream);
+}
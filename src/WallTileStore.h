@@ -0,0 +1,96 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include <cmath>
+
+#include <fstream>
+
+#include <string>
+
+#include <vector>
+
+// Walls split into square spatial tiles on disk.
+// Tile file layout: WallTileStoreHeader, the tile directory, then the wall records of every tile back to back.
+// A wall belongs to the tile that contains its midpoint; the directory keeps the bounds of each tile's walls
+// so that a tile is only needed when something can reach those bounds.
+class WallTileStore
+{
+public:
+	struct TileInfo
+	{
+		unsigned long long firstWall;
+		unsigned int wallsCount;
+		unsigned int reserved;
+		Vector2 wallsMin;
+		Vector2 wallsMax;
+	};
+
+	typedef BulletManagerSnapshot::Wall WallRecord;
+
+	bool Open(const std::string& path);
+
+	int GetTilesCount() const { return static_cast<int>(tiles.size()); }
+
+	const TileInfo& GetTile(int tileIndex) const { return tiles[tileIndex]; }
+
+	// calls visitor(tileIndex) for the tiles whose walls overlap the box
+	template <class TVisitor>
+	void ForEachTileInBox(const Vector2& boxMin, const Vector2& boxMax, TVisitor visitor) const
+	{
+		// walls reach at most maxWallOverhang outside of their own tile
+		const int minTileX = GetTileCoordinate(boxMin.X - maxWallOverhang - origin.X, tilesX);
+		const int maxTileX = GetTileCoordinate(boxMax.X + maxWallOverhang - origin.X, tilesX);
+		const int minTileY = GetTileCoordinate(boxMin.Y - maxWallOverhang - origin.Y, tilesY);
+		const int maxTileY = GetTileCoordinate(boxMax.Y + maxWallOverhang - origin.Y, tilesY);
+
+		for (int tileY = minTileY; tileY <= maxTileY; ++tileY)
+		{
+			for (int tileX = minTileX; tileX <= maxTileX; ++tileX)
+			{
+				const int tileIndex = tileY * tilesX + tileX;
+
+				const TileInfo& tile = tiles[tileIndex];
+
+				if (tile.wallsCount == 0 || boxMax.X < tile.wallsMin.X || boxMax.Y < tile.wallsMin.Y || boxMin.X > tile.wallsMax.X || boxMin.Y > tile.wallsMax.Y)
+				{
+					continue;
+				}
+
+				visitor(tileIndex);
+			}
+		}
+	}
+
+	// appends the walls of the tile, with their destruction state, to the output
+	bool ReadTile(int tileIndex, std::vector<BulletManager::Wall>& outWalls);
+
+	// stores the destruction state of the tile's walls, which must be in the order ReadTile returned them
+	bool WriteTile(int tileIndex, const BulletManager::Wall* walls);
+
+	static bool Write(const std::string& path, const std::vector<BulletManager::WallDefinition>& walls, float tileSize);
+
+private:
+	int GetTileCoordinate(float offset, int tilesCount) const
+	{
+		const int coordinate = static_cast<int>(std::floor(offset / tileSize));
+
+		return coordinate < 0 ? 0 : (coordinate >= tilesCount ? tilesCount - 1 : coordinate);
+	}
+
+	std::fstream stream;
+
+	std::vector<TileInfo> tiles;
+
+	unsigned long long recordsOffset = 0;
+
+	Vector2 origin = Vector2::Zero;
+
+	float tileSize = 1;
+
+	float maxWallOverhang = 0;
+
+	int tilesX = 0;
+
+	int tilesY = 0;
+};
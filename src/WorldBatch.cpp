@@ -0,0 +1,86 @@
+#include "WorldBatch.h"
+
+#include "BulletManager.h"
+
+#include "ParallelUtils.h"
+
+#include <algorithm>
+
+struct WorldBatch::UpdateWorldsStage
+{
+	UpdateWorldsStage(BulletManager* const* firstWorld, BulletManager* const* endWorld, float deltaTime) : firstWorld(firstWorld), endWorld(endWorld), deltaTime(deltaTime)
+	{
+	}
+
+	void DoWork()
+	{
+		for (BulletManager* const* world = firstWorld; world != endWorld; ++world)
+		{
+			(*world)->Update(deltaTime);
+		}
+	}
+
+	BulletManager* const* firstWorld;
+
+	BulletManager* const* endWorld;
+
+	float deltaTime;
+};
+
+WorldBatch::WorldBatch(ThreadPool& inThreadPool, int inThreadsCount) : threadPool(inThreadPool), threadsCount(std::max(1, inThreadsCount))
+{
+}
+
+void WorldBatch::AddWorld(BulletManager& world)
+{
+	const bool bIsLarge = world.GetWallsCount() + world.GetBulletsCount() >= largeWorldThreshold;
+
+	world.SetThreadPool(bIsLarge ? &threadPool : nullptr, bIsLarge ? threadsCount : 1);
+
+	worlds.push_back({ &world, bIsLarge });
+}
+
+void WorldBatch::Update(float deltaTime)
+{
+	smallWorlds.clear();
+	largeWorlds.clear();
+
+	// worlds grow and shrink with their bullets, so they are sorted again every tick
+	for (BatchedWorld& batchedWorld : worlds)
+	{
+		BulletManager* const world = batchedWorld.world;
+
+		const bool bIsLarge = world->GetWallsCount() + world->GetBulletsCount() >= largeWorldThreshold;
+
+		if (bIsLarge != batchedWorld.bIsLarge)
+		{
+			world->SetThreadPool(bIsLarge ? &threadPool : nullptr, bIsLarge ? threadsCount : 1);
+
+			batchedWorld.bIsLarge = bIsLarge;
+		}
+
+		(bIsLarge ? largeWorlds : smallWorlds).push_back(world);
+	}
+
+	if (!smallWorlds.empty())
+	{
+		// a few jobs per thread so that a slow world doesn't leave the other threads idle
+		constexpr int jobsPerThread = 4;
+
+		const int jobsCount = std::min(static_cast<int>(smallWorlds.size()), threadsCount * jobsPerThread);
+
+		BulletManager* const* const firstWorld = smallWorlds.data();
+
+		const int worldsCount = static_cast<int>(smallWorlds.size());
+
+		RunStage<UpdateWorldsStage>([firstWorld, worldsCount, jobsCount, deltaTime](int jobIndex)
+		{
+			return UpdateWorldsStage(firstWorld + (worldsCount * jobIndex) / jobsCount, firstWorld + (worldsCount * (jobIndex + 1)) / jobsCount, deltaTime);
+		}, jobsCount, threadPool);
+	}
+
+	for (BulletManager* world : largeWorlds)
+	{
+		world->Update(deltaTime);
+	}
+}
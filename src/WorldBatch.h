@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+
+#include <vector>
+
+class BulletManager;
+
+class ThreadPool;
+
+// Steps many independent worlds on one shared pool.
+// Small worlds are updated whole as jobs of the pool, with their stages on the job's thread;
+// large worlds are updated one at a time from the calling thread with their stages spread over the pool.
+class WorldBatch
+{
+public:
+	WorldBatch(ThreadPool& inThreadPool, int inThreadsCount);
+
+	// the world is not owned, it has to outlive the batch; it is given its pool here and again whenever it crosses the threshold
+	void AddWorld(BulletManager& world);
+
+	void Update(float deltaTime);
+
+	size_t GetWorldsCount() const { return worlds.size(); }
+
+	// walls plus bullets from which a world gets the whole pool for its stages
+	size_t largeWorldThreshold = 50000;
+
+	struct UpdateWorldsStage;
+
+private:
+	ThreadPool& threadPool;
+
+	int threadsCount;
+
+	struct BatchedWorld
+	{
+		BulletManager* world;
+
+		// which pool the world was given last, handed over again only when it crosses the threshold
+		bool bIsLarge;
+	};
+
+	std::vector<BatchedWorld> worlds;
+
+	std::vector<BulletManager*> smallWorlds;
+
+	std::vector<BulletManager*> largeWorlds;
+};
@@ -0,0 +1,312 @@
+#include "WorldRegions.h"
+
+#include "ParallelUtils.h"
+
+#include <algorithm>
+
+#include <cmath>
+
+#include <limits>
+
+// bullets this close to the cells of a region's walls are lent to it, covering the padding of the sweeps and the rounding at the cell borders
+static constexpr float haloPadding = 0.1f;
+
+struct WorldRegions::BuildStage
+{
+	BuildStage(WorldRegions& owner, const std::vector<BulletManager::Wall>& walls, const WallGrid& layout, int regionIndex) : owner(&owner), walls(&walls), layout(&layout), regionIndex(regionIndex)
+	{
+	}
+
+	void DoWork()
+	{
+		Region& region = *owner->regions[regionIndex];
+
+		for (int wallIndex = 0; wallIndex < static_cast<int>(walls->size()); ++wallIndex)
+		{
+			if (owner->wallRegions[wallIndex] != regionIndex)
+			{
+				continue;
+			}
+
+			const BulletManager::Wall& wall = (*walls)[wallIndex];
+
+			region.walls.push_back(wall);
+			region.wallIndices.push_back(wallIndex);
+
+			float columnsMinX;
+			float columnsMaxX;
+
+			layout->GetColumnsSpan(std::fmin(wall.definition.start.X, wall.definition.end.X), std::fmax(wall.definition.start.X, wall.definition.end.X), columnsMinX, columnsMaxX);
+
+			region.wallsMinX = std::fmin(region.wallsMinX, columnsMinX);
+			region.wallsMaxX = std::fmax(region.wallsMaxX, columnsMaxX);
+		}
+
+		region.wallGrid.Build(region.walls, *layout);
+	}
+
+	WorldRegions* owner;
+
+	const std::vector<BulletManager::Wall>* walls;
+
+	const WallGrid* layout;
+
+	int regionIndex;
+};
+
+struct WorldRegions::HandOutStage
+{
+	HandOutStage(WorldRegions& owner, const std::vector<BulletManager::Bullet>& bullets, int regionIndex, std::pair<int, int> newBullets, float startTime, float endTime) :
+		owner(&owner), bullets(&bullets), regionIndex(regionIndex), newBullets(newBullets), startTime(startTime), endTime(endTime)
+	{
+	}
+
+	void DoWork()
+	{
+		Region& region = *owner->regions[regionIndex];
+
+		for (int targetIndex = 0; targetIndex < owner->GetRegionsCount(); ++targetIndex)
+		{
+			region.outgoingBulletIndices[targetIndex].clear();
+			region.outgoingHaloBulletIndices[targetIndex].clear();
+		}
+
+		region.bulletIndices.clear();
+
+		// the ids and the bullets are both in order, expired bullets are simply not found
+		auto searchStart = bullets->begin();
+
+		for (unsigned int bulletId : region.bulletIds)
+		{
+			searchStart = std::lower_bound(searchStart, bullets->end(), bulletId, [](const BulletManager::Bullet& bullet, unsigned int id)
+			{
+				return bullet.id < id;
+			});
+
+			if (searchStart == bullets->end())
+			{
+				break;
+			}
+
+			if (searchStart->id == bulletId)
+			{
+				HandOut(static_cast<int>(searchStart - bullets->begin()), false);
+			}
+		}
+
+		// every region hands out a part of the bullets added since the previous step
+		for (int bulletIndex = newBullets.first; bulletIndex < newBullets.second; ++bulletIndex)
+		{
+			HandOut(bulletIndex, true);
+		}
+	}
+
+	void HandOut(int bulletIndex, bool bIsNew)
+	{
+		Region& region = *owner->regions[regionIndex];
+
+		const BulletManager::BulletDefinition& bullet = (*bullets)[bulletIndex].definition;
+
+		const float locationX = BulletManager::EvaluateBulletLocation(bullet, startTime).X;
+
+		const int homeIndex = owner->GetRegionIndex(locationX);
+
+		if (homeIndex == regionIndex)
+		{
+			region.bulletIndices.push_back(bulletIndex);
+		}
+		else
+		{
+			region.outgoingBulletIndices[homeIndex].push_back(bulletIndex);
+
+			migratedBulletsCount += bIsNew ? 0 : 1;
+		}
+
+		const float flightStartTime = std::fmax(startTime, bullet.startTime);
+		const float flightEndTime = std::fmin(endTime, bullet.startTime + bullet.lifetime);
+
+		if (flightEndTime < flightStartTime)
+		{
+			return;
+		}
+
+		// reflections keep the speed, so this bounds the path whatever it hits
+		const float reach = bullet.velocity.GetMagnitude() * (flightEndTime - flightStartTime) + haloPadding;
+
+		for (int targetIndex = 0; targetIndex < owner->GetRegionsCount(); ++targetIndex)
+		{
+			const Region& target = *owner->regions[targetIndex];
+
+			if (targetIndex != homeIndex && target.wallsMinX <= locationX + reach && locationX - reach <= target.wallsMaxX)
+			{
+				region.outgoingHaloBulletIndices[targetIndex].push_back(bulletIndex);
+			}
+		}
+	}
+
+	WorldRegions* owner;
+
+	const std::vector<BulletManager::Bullet>* bullets;
+
+	int regionIndex;
+
+	std::pair<int, int> newBullets;
+
+	float startTime;
+	float endTime;
+
+	size_t migratedBulletsCount = 0;
+};
+
+struct WorldRegions::TakeInStage
+{
+	TakeInStage(WorldRegions& owner, const std::vector<BulletManager::Bullet>& bullets, int regionIndex) : owner(&owner), bullets(&bullets), regionIndex(regionIndex)
+	{
+	}
+
+	void DoWork()
+	{
+		Region& region = *owner->regions[regionIndex];
+
+		for (const std::unique_ptr<Region>& source : owner->regions)
+		{
+			const std::vector<int>& incomingBulletIndices = source->outgoingBulletIndices[regionIndex];
+
+			region.bulletIndices.insert(region.bulletIndices.end(), incomingBulletIndices.begin(), incomingBulletIndices.end());
+		}
+
+		std::sort(region.bulletIndices.begin(), region.bulletIndices.end());
+
+		region.bulletIds.resize(region.bulletIndices.size());
+
+		for (size_t ownedIndex = 0; ownedIndex < region.bulletIndices.size(); ++ownedIndex)
+		{
+			region.bulletIds[ownedIndex] = (*bullets)[region.bulletIndices[ownedIndex]].id;
+		}
+
+		for (const std::unique_ptr<Region>& source : owner->regions)
+		{
+			const std::vector<int>& haloBulletIndices = source->outgoingHaloBulletIndices[regionIndex];
+
+			region.bulletIndices.insert(region.bulletIndices.end(), haloBulletIndices.begin(), haloBulletIndices.end());
+
+			haloBulletsCount += haloBulletIndices.size();
+		}
+	}
+
+	WorldRegions* owner;
+
+	const std::vector<BulletManager::Bullet>* bullets;
+
+	int regionIndex;
+
+	size_t haloBulletsCount = 0;
+};
+
+void WorldRegions::Build(const std::vector<BulletManager::Wall>& walls, const WallGrid& layout, int regionsCount, ThreadPool* pool)
+{
+	const int wallsCount = static_cast<int>(walls.size());
+
+	std::vector<float> middlesX(wallsCount);
+
+	for (int wallIndex = 0; wallIndex < wallsCount; ++wallIndex)
+	{
+		middlesX[wallIndex] = (walls[wallIndex].definition.start.X + walls[wallIndex].definition.end.X) / 2;
+	}
+
+	std::vector<float> sortedMiddlesX(middlesX);
+
+	std::sort(sortedMiddlesX.begin(), sortedMiddlesX.end());
+
+	splitsX.assign(regionsCount - 1, 0);
+
+	for (int splitIndex = 0; splitIndex < regionsCount - 1 && wallsCount > 0; ++splitIndex)
+	{
+		splitsX[splitIndex] = sortedMiddlesX[(static_cast<size_t>(wallsCount) * (splitIndex + 1)) / regionsCount];
+	}
+
+	regions.clear();
+
+	for (int regionIndex = 0; regionIndex < regionsCount; ++regionIndex)
+	{
+		regions.push_back(std::make_unique<Region>());
+
+		regions.back()->wallsMinX = std::numeric_limits<float>::max();
+		regions.back()->wallsMaxX = -std::numeric_limits<float>::max();
+
+		regions.back()->outgoingBulletIndices.resize(regionsCount);
+		regions.back()->outgoingHaloBulletIndices.resize(regionsCount);
+	}
+
+	wallRegions.resize(wallsCount);
+	wallLocalIndices.resize(wallsCount);
+
+	std::vector<int> ownedWallsCounts(regionsCount, 0);
+
+	for (int wallIndex = 0; wallIndex < wallsCount; ++wallIndex)
+	{
+		const int regionIndex = GetRegionIndex(middlesX[wallIndex]);
+
+		wallRegions[wallIndex] = regionIndex;
+		wallLocalIndices[wallIndex] = ownedWallsCounts[regionIndex]++;
+	}
+
+	RunStage<BuildStage>([this, &walls, &layout](int regionIndex) { return BuildStage(*this, walls, layout, regionIndex); }, regionsCount, pool);
+
+	assignedBulletId = 0;
+}
+
+void WorldRegions::BeginStep(const std::vector<BulletManager::Bullet>& bullets, unsigned int nextBulletId, float startTime, float endTime, ThreadPool* pool)
+{
+	const int regionsCount = GetRegionsCount();
+
+	const int firstNewBullet = static_cast<int>(std::lower_bound(bullets.begin(), bullets.end(), assignedBulletId, [](const BulletManager::Bullet& bullet, unsigned int id)
+	{
+		return bullet.id < id;
+	}) - bullets.begin());
+
+	const int newBulletsCount = static_cast<int>(bullets.size()) - firstNewBullet;
+
+	if (assignedBulletId == 0)
+	{
+		// every bullet is new, none is owned
+		for (const std::unique_ptr<Region>& region : regions)
+		{
+			region->bulletIds.clear();
+		}
+	}
+
+	const auto handOutStages = RunStage<HandOutStage>([&](int regionIndex)
+	{
+		const std::pair<int, int> newBullets(firstNewBullet + (newBulletsCount * regionIndex) / regionsCount, firstNewBullet + (newBulletsCount * (regionIndex + 1)) / regionsCount);
+
+		return HandOutStage(*this, bullets, regionIndex, newBullets, startTime, endTime);
+	}, regionsCount, pool);
+
+	const auto takeInStages = RunStage<TakeInStage>([&](int regionIndex) { return TakeInStage(*this, bullets, regionIndex); }, regionsCount, pool);
+
+	migratedBulletsCount = 0;
+	haloBulletsCount = 0;
+
+	for (const HandOutStage& stage : handOutStages)
+	{
+		migratedBulletsCount += stage.migratedBulletsCount;
+	}
+
+	for (const TakeInStage& stage : takeInStages)
+	{
+		haloBulletsCount += stage.haloBulletsCount;
+	}
+
+	assignedBulletId = nextBulletId;
+}
+
+void WorldRegions::MarkWallDestroyed(int wallIndex, float time)
+{
+	regions[wallRegions[wallIndex]]->walls[wallLocalIndices[wallIndex]].timeDestroyed = time;
+}
+
+int WorldRegions::GetRegionIndex(float x) const
+{
+	return static_cast<int>(std::upper_bound(splitsX.begin(), splitsX.end(), x) - splitsX.begin());
+}
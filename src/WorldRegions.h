@@ -0,0 +1,96 @@
+#pragma once
+
+#include "BulletManager.h"
+
+#include "WallGrid.h"
+
+#include <memory>
+
+#include <vector>
+
+// Splits the world into vertical slabs holding about the same number of walls, one region per stage.
+// A region owns the walls whose middle lies in its slab, as copies with a wall grid of their own, and the bullets
+// located in the slab when a step begins. Walls reaching over a border stay with their owner and widen its bounds
+// to the grid columns they cross; bullets of other regions whose sweeps can get within those bounds during the step
+// are lent to it as halo bullets. The region grids use the cells of the manager's grid, so a bullet meets the same
+// candidate walls as it would there, each in one region only, and the hits come out the same.
+// Bullets that left their slab move to the new region through handoff queues at the start of the next step.
+class WorldRegions
+{
+public:
+	struct Region
+	{
+		// copies of the owned walls, kept destroyed along with the manager's
+		std::vector<BulletManager::Wall> walls;
+
+		// the index in the manager's walls of every owned wall
+		std::vector<int> wallIndices;
+
+		WallGrid wallGrid;
+
+		// covers the grid columns the owned walls cross
+		float wallsMinX = 0;
+		float wallsMaxX = 0;
+
+		// ids of the owned bullets, in order
+		std::vector<unsigned int> bulletIds;
+
+		// indices in the manager's bullets for the current step: the owned bullets, then the halo bullets
+		std::vector<int> bulletIndices;
+
+		// filled at the start of a step, by target region
+		std::vector<std::vector<int>> outgoingBulletIndices;
+
+		std::vector<std::vector<int>> outgoingHaloBulletIndices;
+	};
+
+	bool IsBuilt() const { return !regions.empty(); }
+
+	int GetRegionsCount() const { return static_cast<int>(regions.size()); }
+
+	const Region& GetRegion(int regionIndex) const { return *regions[regionIndex]; }
+
+	// splits the walls; the regions copy their walls and build their grids with the cells of the layout on the pool,
+	// so that their memory is first touched by a worker. Every bullet is handed out again by the next step
+	void Build(const std::vector<BulletManager::Wall>& walls, const WallGrid& layout, int regionsCount, class ThreadPool* pool);
+
+	// forgets which region owns which bullet, e.g. after bullets were put back by a rewind
+	void ResetBullets() { assignedBulletId = 0; }
+
+	// resolves the owned bullets, hands the ones that moved and the ones added since the previous step to their region,
+	// and lends every region the bullets that can reach its walls before the end time
+	void BeginStep(const std::vector<BulletManager::Bullet>& bullets, unsigned int nextBulletId, float startTime, float endTime, class ThreadPool* pool);
+
+	void MarkWallDestroyed(int wallIndex, float time);
+
+	// of the last step
+	size_t GetMigratedBulletsCount() const { return migratedBulletsCount; }
+
+	size_t GetHaloBulletsCount() const { return haloBulletsCount; }
+
+private:
+	int GetRegionIndex(float x) const;
+
+	struct HandOutStage;
+
+	struct TakeInStage;
+
+	struct BuildStage;
+
+	std::vector<std::unique_ptr<Region>> regions;
+
+	// the slab of region i ends where the one of region i + 1 starts, at splitsX[i]
+	std::vector<float> splitsX;
+
+	// the owner of every wall of the manager and the wall's index in it
+	std::vector<int> wallRegions;
+
+	std::vector<int> wallLocalIndices;
+
+	// bullets with this id or above haven't been given to a region yet
+	unsigned int assignedBulletId = 0;
+
+	size_t migratedBulletsCount = 0;
+
+	size_t haloBulletsCount = 0;
+};
@@ -4,50 +4,114 @@
 
 #include "Graphics.h"
 #include "BulletManager.h"
+#include "FlightRecorder.h"
 
 #include <chrono>
 
-#include <fstream>
+#include <memory>
 
-#include "nlohmann/json.hpp"
+#include "MappedFile.h"
+#include "Scenario.h"
+#include "StreamingJsonLoader.h"
+#include "BulletSchedule.h"
 
-static void from_json(const nlohmann::json& j, Vector2& outVector)
-{
-	outVector = Vector2{ j["x"].get<float>(), j["y"].get<float>() };
-}
+#include <thread>
 
-static void from_json(const nlohmann::json& j, BulletManager::WallDefinition& outWallDefinition)
-{
-	outWallDefinition = BulletManager::WallDefinition(j["start"].get<Vector2>(), j["end"].get<Vector2>());
-}
+#include <random>
 
-static void from_json(const nlohmann::json& j, BulletManager::BulletDefinition& outBulletDefinition)
+static std::unique_ptr<BulletManager> CreateBulletManager(const std::string& scenarioFilePath, const std::string& wallSetupFilePath, const std::string& bulletSetupFilePath)
 {
-	outBulletDefinition = BulletManager::BulletDefinition(j["start"].get<Vector2>(), j["velocity"].get<Vector2>(), 0, 10);
+	MappedFile scenarioFile;
+
+	ScenarioView scenario;
+
+	if (OpenBinaryScenario(scenarioFilePath, scenarioFile, scenario))
+	{
+		return std::make_unique<BulletManager>(scenario);
+	}
+
+	const int chunksCount = static_cast<int>(std::thread::hardware_concurrency());
+
+	std::vector<BulletManager::Wall> walls;
+
+	if (!StreamWallsFromJson(wallSetupFilePath, walls, chunksCount))
+	{
+		walls = { { BulletManager::WallDefinition({ 10, 100 }, { 100, 100 }) } };
+	}
+
+	std::vector<BulletManager::Bullet> bullets;
+
+	StreamBulletsFromJson(bulletSetupFilePath, bullets, chunksCount);
+
+	return std::make_unique<BulletManager>(std::move(walls), std::move(bullets));
 }
 
-template <class T>
-static std::vector<T> loadFromJson(std::string jsonPath, std::vector<T> defaultValue)
+static int BenchmarkRender()
 {
-	std::ifstream wallsSetupInputStream(jsonPath);
+	constexpr int width = 640;
+	constexpr int height = 480;
+
+	constexpr int framesToRender = 10;
 
-	nlohmann::json wallSetupJson;
+	GraphicsSystem graphics(width, height);
 
-	if (wallsSetupInputStream)
+	if (!graphics.bWereGraphicsInitialized)
 	{
-		wallsSetupInputStream >> wallSetupJson;
+		return 1;
 	}
 
-	if (wallSetupJson.is_array())
+	std::mt19937 randomEngine(0);
+
+	std::uniform_real_distribution<float> xDistribution(0, width);
+	std::uniform_real_distribution<float> yDistribution(0, height);
+
+	std::chrono::high_resolution_clock clock;
+
+	for (const int elementsCount : { 10000, 100000, 1000000 })
 	{
-		return wallSetupJson.get<std::vector<T>>();
+		GraphicsState graphicsState;
+
+		for (int elementIndex = 0; elementIndex < elementsCount; ++elementIndex)
+		{
+			graphicsState.walls.push_back({ { xDistribution(randomEngine), yDistribution(randomEngine) }, { xDistribution(randomEngine), yDistribution(randomEngine) } });
+
+			graphicsState.bullets.push_back({ { xDistribution(randomEngine), yDistribution(randomEngine) }, Vector2::Zero });
+		}
+
+		graphics.Render(graphicsState);
+
+		const auto timeBeforeRender = clock.now();
+
+		for (int frameIndex = 0; frameIndex < framesToRender; ++frameIndex)
+		{
+			graphics.Render(graphicsState);
+		}
+
+		const auto renderMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - timeBeforeRender).count() / framesToRender;
+
+		const char* const renderPath = static_cast<size_t>(elementsCount) > graphics.softwareRasterizerBulletsThreshold ? "software rasteriser" : "software renderer";
+
+		std::cout << elementsCount << " walls and bullets: " << (renderMicroseconds / 1000.0) << " ms per frame (" << renderPath << ")" << std::endl;
 	}
 
-	return defaultValue;
+	return 0;
 }
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "--bench-render")
+	{
+		return BenchmarkRender();
+	}
+
+	// off unless asked for: every snapshot copies all the bullets on the frame thread, and slow frames are written to disk
+	std::string flightRecorderDirectory;
+
+	if (argc > 2 && std::string(argv[1]) == "--flight-recorder")
+	{
+		flightRecorderDirectory = argv[2];
+	}
+
 	GraphicsSystem SDL;
 
 	if (!SDL.bWereGraphicsInitialized)
@@ -76,20 +140,65 @@ int main(int, char**)
 
 	constexpr auto maxSimulationTickDuration = std::chrono::seconds(1);
 
+	const std::string scenarioFilePath("scenario.bscn");
+
 	const std::string wallSetupFilePath("walls.json");
 	
 	const std::string bulletSetupFilePath("bullets.json");
 
-	const auto walls = loadFromJson<BulletManager::WallDefinition>(wallSetupFilePath, { BulletManager::WallDefinition({ 10, 100 }, { 100, 100 }) });
+	const std::string wallIndexFilePath("walls.grid");
+
+	const std::unique_ptr<BulletManager> bulletManager = CreateBulletManager(scenarioFilePath, wallSetupFilePath, bulletSetupFilePath);
+
+	bulletManager->LoadOrBuildWallIndex(wallIndexFilePath);
+
+	const std::string bulletScheduleFilePath("bullets.bsch");
+
+	std::unique_ptr<BulletScheduleReader> bulletSchedule = std::make_unique<BulletScheduleReader>();
+
+	if (bulletSchedule->Open(bulletScheduleFilePath))
+	{
+		// an update never covers more than maxSimulationTickDuration
+		constexpr float bulletScheduleLookAhead = static_cast<float>(maxSimulationTickDuration.count());
+
+		bulletManager->SetBulletSchedule(std::move(bulletSchedule), bulletScheduleLookAhead);
+	}
+
+	constexpr int flightRecorderFramesToKeep = 120;
+
+	constexpr float slowFrameThresholdMs = static_cast<float>(targetDeltaTime.count());
+
+	std::unique_ptr<FlightRecorder> flightRecorder;
+
+	if (!flightRecorderDirectory.empty())
+	{
+		const bool bHasSeparator = flightRecorderDirectory.back() == '/' || flightRecorderDirectory.back() == '\\';
+
+		flightRecorder = std::make_unique<FlightRecorder>(flightRecorderFramesToKeep, slowFrameThresholdMs, flightRecorderDirectory + (bHasSeparator ? "" : "/") + "slow_frame_");
+
+		bulletManager->SetFlightRecorder(flightRecorder.get());
+	}
+
+	constexpr float rewindWindow = 10;
+
+	constexpr float rewindStep = 1;
 
-	const auto bullets = loadFromJson<BulletManager::BulletDefinition>(bulletSetupFilePath, { });
+	bulletManager->SetRewindWindow(rewindWindow);
 
-	BulletManager bulletManager(walls, bullets);
+	bool bIsPaused = false;
+
+	// kept between frames so that its buffers are reused
+	GraphicsState graphicsState1;
 
 	while (bShouldRun)
 	{
 		const auto tickStartTime = clock.now();
 
+		if (flightRecorder)
+		{
+			flightRecorder->BeginFrame(*bulletManager);
+		}
+
 		++TickId;
 
 		while (true)
@@ -107,6 +216,16 @@ int main(int, char**)
 
 			bShouldRun &= !bHasReceivedExitRequest;
 
+			if (Result == InputResult::TogglePause)
+			{
+				bIsPaused = !bIsPaused;
+			}
+
+			if (Result == InputResult::Rewind)
+			{
+				bulletManager->RewindTo(std::fmax(bulletManager->GetEarliestRewindTime(), bulletManager->GetCurrentTime() - rewindStep));
+			}
+
 			if (Result == InputResult::LaunchBullet)
 			{
 				std::cout << "Input " << StartInput.X << ":" << StartInput.Y << " to " << EndInput.X << ":" << EndInput.Y << std::endl;
@@ -136,15 +255,21 @@ int main(int, char**)
 
 		const float timeDilation = 1.0f;
 
-		bulletManager.Update(timeDilation * deltaTimeSeconds);
+		if (!bIsPaused)
+		{
+			bulletManager->Update(timeDilation * deltaTimeSeconds);
+		}
 		
 		const auto timeAfterCalculation = clock.now();
 
 		std::cout << "Calculated for " << (std::chrono::duration_cast<std::chrono::milliseconds>(timeAfterCalculation - timeBeforeBulletManagerUpdate)).count() << std::endl;
 
-		GraphicsState graphicsState1;
+		Vector2 viewMin;
+		Vector2 viewMax;
 
-		bulletManager.GenerateState(graphicsState1);
+		SDL.GetViewBox(viewMin, viewMax);
+
+		bulletManager->GenerateState(graphicsState1, viewMin, viewMax);
 
 
 		SDL.Render(graphicsState1);
@@ -155,6 +280,11 @@ int main(int, char**)
 
 		const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(tickTimeAtTickEnd - tickStartTime);
 
+		if (flightRecorder)
+		{
+			flightRecorder->EndFrame(static_cast<float>(std::chrono::duration_cast<std::chrono::microseconds>(tickTimeAtTickEnd - tickStartTime).count()) / 1000);
+		}
+
 		const auto extraTickTime = targetDeltaTime - elapsedMs;
 
 		//if (extraTickTime.count() > 0)